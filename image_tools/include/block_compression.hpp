@@ -36,5 +36,15 @@ namespace image_tools
 
 	void decompress(VkFormat format, const uint8_t* in, image& out, int w, int h);
 	void decompress(vk::Format format, const uint8_t* in, image& out, int w, int h);
+
+	/*
+	 * Scales `in` to w x h and builds `levels` mip levels from it, each one downsampled from the
+	 * previous one. The levels are compressed in parallel (split into strips of block rows) using
+	 * up to `threads` threads including the calling one, 0 means one per hardware thread. Callers that
+	 * already run several of these at once should pass their share. `offsets` receives the start of every
+	 * level in `out`. Levels smaller than a block are padded by repeating their edge pixels.
+	 */
+	void compress_mip_chain(VkFormat format, const image& in, std::vector<uint8_t>& out, std::vector<VkDeviceSize>& offsets,
+		int w, int h, int levels, unsigned int threads);
 #endif
 }
@@ -15,7 +15,13 @@ namespace image_tools
 			image(int w, int h, uint8_t* pointer);
 
 			color& at(int x, int y);
+			color at(int x, int y) const;
 			glm::vec4 scaled(int x, int y, int w, int h) const;
+			// half the size (but at least 1x1), filtered with a [1 3 3 1] tent in linear space
+			image downsampled(bool srgb) const;
+
+			int get_width() const;
+			int get_height() const;
 
 			operator const uint8_t*();
 
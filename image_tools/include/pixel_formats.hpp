@@ -0,0 +1,33 @@
+#pragma once
+#include <bits/stdint-uintn.h>
+#include "image.hpp"
+
+#ifdef WITH_VULKAN
+#include <vulkan/vulkan_core.h>
+#endif
+
+namespace image_tools
+{
+	enum class tonemap
+	{
+		// values outside of [0, 1] are clamped
+		Clamp,
+		// x / (1 + x) for the color channels of floating point formats, so highlights keep some detail
+		Reinhard
+	};
+
+	// true if AVX2 and F16C kernels are available on this CPU (and were compiled in)
+	bool has_simd_conversion();
+
+#ifdef WITH_VULKAN
+	bool is_conversion_supported(VkFormat format);
+
+	/*
+	 * Converts w x h tightly packed texels of an uncompressed color or depth format (as written by
+	 * vkCmdCopyImageToBuffer, so only the depth aspect of depth/stencil formats) to RGBA8. Depth is
+	 * written as gray, missing color channels are 0 and missing alpha is opaque. `simd` can be
+	 * disabled to compare against the scalar kernels, both produce identical results.
+	 */
+	void convert(VkFormat format, const uint8_t* in, image& out, int w, int h, tonemap t = tonemap::Clamp, bool simd = true);
+#endif
+}
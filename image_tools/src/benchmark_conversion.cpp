@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+#include "pixel_formats.hpp"
+
+using namespace image_tools;
+
+struct format_info
+{
+	VkFormat format;
+	const char* name;
+	size_t texelSize;
+	bool hdr;
+};
+
+static const format_info formats[] = {
+	{VK_FORMAT_R8G8B8A8_UNORM,				"R8G8B8A8_UNORM",				4, false},
+	{VK_FORMAT_B8G8R8A8_UNORM,				"B8G8R8A8_UNORM",				4, false},
+	{VK_FORMAT_A2B10G10R10_UNORM_PACK32,	"A2B10G10R10_UNORM_PACK32",		4, false},
+	{VK_FORMAT_R16G16B16A16_UNORM,			"R16G16B16A16_UNORM",			8, false},
+	{VK_FORMAT_R16G16_SFLOAT,				"R16G16_SFLOAT",				4, true},
+	{VK_FORMAT_R16G16B16A16_SFLOAT,			"R16G16B16A16_SFLOAT",			8, true},
+	{VK_FORMAT_R32G32B32A32_SFLOAT,			"R32G32B32A32_SFLOAT",			16, true},
+	{VK_FORMAT_B10G11R11_UFLOAT_PACK32,		"B10G11R11_UFLOAT_PACK32",		4, true},
+	{VK_FORMAT_D16_UNORM,					"D16_UNORM",					2, false},
+	{VK_FORMAT_D24_UNORM_S8_UINT,			"D24_UNORM_S8_UINT",			4, false},
+	{VK_FORMAT_D32_SFLOAT,					"D32_SFLOAT",					4, false},
+};
+
+// best of `iterations` runs in milliseconds, the input is the same every time, so the minimum is the least noisy
+static double measure(const format_info& f, const std::vector<uint8_t>& in, image& out, int w, int h, tonemap t, bool simd, int iterations)
+{
+	double best = 1e100;
+	for(int i=0; i<iterations; i++)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		convert(f.format, in.data(), out, w, h, t, simd);
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	}
+	return best;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc != 1 && argc != 4)
+	{
+		std::cerr << "Usage: " << argv[0] << " [width] [height] [iterations]" << std::endl;
+		return 2;
+	}
+
+	int width		= argc == 4 ? std::atoi(argv[1]) : 3840;
+	int height		= argc == 4 ? std::atoi(argv[2]) : 2160;
+	int iterations	= argc == 4 ? std::atoi(argv[3]) : 10;
+	if(width <= 0 || height <= 0 || iterations <= 0)
+	{
+		std::cerr << "Width, height and iterations must be positive" << std::endl;
+		return 2;
+	}
+
+	bool simd = has_simd_conversion();
+	std::cout << "Converting " << width << "x" << height << " texels, best of " << iterations << " runs"
+		<< (simd ? "" : " (no AVX2/F16C, SIMD kernels unavailable)") << std::endl;
+
+	// random bits include NaNs, infinities and denormals, which must convert the same way in both kernels
+	std::mt19937 rng(1234);
+	double megapixels = double(width) * height / 1e6;
+	bool mismatch = false;
+	for(const format_info& f : formats)
+	{
+		std::vector<uint8_t> in(f.texelSize * width * height);
+		std::generate(in.begin(), in.end(), [&rng](){ return static_cast<uint8_t>(rng()); });
+
+		for(tonemap t : {tonemap::Clamp, tonemap::Reinhard})
+		{
+			if(t == tonemap::Reinhard && !f.hdr)
+				continue;
+
+			image scalarOut(width, height);
+			image simdOut(width, height);
+			double scalarTime = measure(f, in, scalarOut, width, height, t, false, iterations);
+			double simdTime = measure(f, in, simdOut, width, height, t, true, iterations);
+
+			bool same = std::equal(scalarOut.cbegin(), scalarOut.cend(), simdOut.cbegin());
+			mismatch |= !same;
+
+			std::cout << std::left << std::setw(26) << f.name << std::setw(9) << (t == tonemap::Reinhard ? "reinhard" : "clamp")
+				<< std::right << std::fixed << std::setprecision(2)
+				<< " scalar " << std::setw(8) << scalarTime << " ms (" << std::setw(8) << megapixels / scalarTime * 1000 << " MPix/s)"
+				<< "  simd " << std::setw(8) << simdTime << " ms (" << std::setw(8) << megapixels / simdTime * 1000 << " MPix/s)"
+				<< "  x" << std::setprecision(1) << scalarTime / simdTime
+				<< (same ? "" : "  MISMATCH") << std::endl;
+		}
+	}
+	return mismatch ? 1 : 0;
+}
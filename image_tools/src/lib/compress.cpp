@@ -7,6 +7,7 @@
 #include <iostream>
 #include <algorithm>
 #include <iterator>
+#include <mutex>
 #include <bc7enc16.h>
 
 namespace image_tools
@@ -210,17 +211,14 @@ namespace image_tools
 		}
 	}
 
-	static bool bc7_init = false;
+	static std::once_flag bc7_init;
 	void compressBC7(const image &in, std::vector<uint8_t> &out, int w, int h)
 	{
 		out.resize(w * h);
 		std::fill(out.begin(), out.end(), 0x00);
 
-		if(!bc7_init)
-		{
-			bc7enc16_compress_block_init();
-			bc7_init = true;
-		}
+		// mip levels are compressed in parallel, so this has to be thread-safe
+		std::call_once(bc7_init, bc7enc16_compress_block_init);
 
 		bc7enc16_compress_block_params params;
 		bc7enc16_compress_block_params_init(&params);
@@ -1,5 +1,8 @@
 #include "image.hpp"
+#include <algorithm>
+#include <array>
 #include <bits/stdint-uintn.h>
+#include <cassert>
 #include <cmath>
 
 namespace image_tools
@@ -33,6 +36,14 @@ namespace image_tools
 		return data.at(y*width + x);
 	}
 
+	image::color image::at(int x, int y) const
+	{
+		return data[y*width + x];
+	}
+
+	int image::get_width() const { return width; }
+	int image::get_height() const { return height; }
+
 	constexpr glm::ivec4 color_to_ivec4(image::color c)
 	{
 		int r = (c>>(0*8)) & 0xff;
@@ -71,6 +82,92 @@ namespace image_tools
 		return glm::vec4(sum) / (float)(scanX * scanY * 255.0f);
 	}
 
+	namespace
+	{
+		const std::array<float, 256>& srgb_to_linear_table()
+		{
+			static const std::array<float, 256> table = []{
+				std::array<float, 256> t;
+				for(int i=0; i<256; i++)
+				{
+					float c = i / 255.0f;
+					t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				}
+				return t;
+			}();
+			return table;
+		}
+
+		// fine enough that every 8 bit value round trips
+		constexpr int linear_steps = 4096;
+		const std::array<uint8_t, linear_steps+1>& linear_to_srgb_table()
+		{
+			static const std::array<uint8_t, linear_steps+1> table = []{
+				std::array<uint8_t, linear_steps+1> t;
+				for(int i=0; i<=linear_steps; i++)
+				{
+					float c = i / (float)linear_steps;
+					float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f/2.4f) - 0.055f;
+					t[i] = std::clamp(s * 255.0f + 0.5f, 0.0f, 255.0f);
+				}
+				return t;
+			}();
+			return table;
+		}
+	}
+
+	image image::downsampled(bool srgb) const
+	{
+		const auto& toLinear = srgb_to_linear_table();
+		const auto& toSrgb = linear_to_srgb_table();
+		constexpr std::array<float, 4> weights = {1.0f/8, 3.0f/8, 3.0f/8, 1.0f/8};
+
+		int w = std::max(width / 2, 1);
+		int h = std::max(height / 2, 1);
+
+		auto channel = [srgb, &toLinear](color c, int i) {
+			uint8_t v = (c >> (i*8)) & 0xff;
+			return (srgb && i < 3) ? toLinear[v] : v / 255.0f;
+		};
+
+		// horizontal pass over all rows, then vertical pass
+		std::vector<glm::vec4> rows(w * height);
+		for(int y=0; y<height; y++)
+		{
+			for(int x=0; x<w; x++)
+			{
+				glm::vec4 sum(0.0f);
+				for(int k=0; k<4; k++)
+				{
+					color c = data[y*width + std::clamp(2*x - 1 + k, 0, width - 1)];
+					sum += weights[k] * glm::vec4(channel(c, 0), channel(c, 1), channel(c, 2), channel(c, 3));
+				}
+				rows[y*w + x] = sum;
+			}
+		}
+
+		image out(w, h);
+		for(int y=0; y<h; y++)
+		{
+			for(int x=0; x<w; x++)
+			{
+				glm::vec4 sum(0.0f);
+				for(int k=0; k<4; k++)
+					sum += weights[k] * rows[std::clamp(2*y - 1 + k, 0, height - 1)*w + x];
+				sum = glm::clamp(sum, 0.0f, 1.0f);
+
+				color c = 0;
+				for(int i=0; i<4; i++)
+				{
+					uint8_t v = (srgb && i < 3) ? toSrgb[(int)(sum[i] * linear_steps + 0.5f)] : (uint8_t)(sum[i] * 255.0f + 0.5f);
+					c |= (color)v << (i*8);
+				}
+				out.data[y*w + x] = c;
+			}
+		}
+		return out;
+	}
+
 	image::color color(glm::vec4 rgba)
 	{
 		int r = rgba.r * 255.0f;
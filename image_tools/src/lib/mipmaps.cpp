@@ -0,0 +1,146 @@
+#ifdef WITH_VULKAN
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vulkan/vulkan_core.h>
+
+#include "block_compression.hpp"
+
+namespace image_tools
+{
+	namespace
+	{
+		// rows per compression task, small enough that a single large level still keeps all threads busy
+		constexpr int strip_height = 64;
+
+		bool is_srgb(VkFormat format)
+		{
+			switch(format)
+			{
+				case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+				case VK_FORMAT_BC3_SRGB_BLOCK:
+				case VK_FORMAT_BC7_SRGB_BLOCK:
+				case VK_FORMAT_R8G8B8A8_SRGB:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		int block_size(VkFormat format)
+		{
+			switch(format)
+			{
+				case VK_FORMAT_R8G8B8A8_UNORM:
+				case VK_FORMAT_R8G8B8A8_SRGB:
+					return 1;
+				default:
+					return 4;
+			}
+		}
+
+		struct strip
+		{
+			const image* level;
+			int y;
+			int width;
+			int height;
+			std::vector<uint8_t> out;
+		};
+
+		// copies the rows of the strip, padded to whole blocks by repeating the edge pixels
+		image extract(const strip& s)
+		{
+			image out(s.width, s.height);
+			for(int y=0; y<s.height; y++)
+			{
+				int yy = std::min(s.y + y, s.level->get_height() - 1);
+				for(int x=0; x<s.width; x++)
+					out.at(x, y) = s.level->at(std::min(x, s.level->get_width() - 1), yy);
+			}
+			return out;
+		}
+	}
+
+	void compress_mip_chain(VkFormat format, const image& in, std::vector<uint8_t>& out, std::vector<VkDeviceSize>& offsets,
+		int w, int h, int levels, unsigned int threads)
+	{
+		bool srgb = is_srgb(format);
+		int block = block_size(format);
+
+		std::vector<image> chain;
+		chain.reserve(std::max(levels, 1));
+		if(in.get_width() == w && in.get_height() == h)
+		{
+			chain.push_back(in);
+		}
+		else
+		{
+			image scaled(w, h);
+			for(int y=0; y<h; y++)
+				for(int x=0; x<w; x++)
+					scaled.at(x, y) = color(in.scaled(x, y, w, h));
+			chain.push_back(std::move(scaled));
+		}
+		for(int i=1; i<levels; i++)
+			chain.push_back(chain.back().downsampled(srgb));
+
+		// strips are in output order: levels from largest to smallest, rows from top to bottom
+		std::vector<strip> strips;
+		for(const image& level : chain)
+		{
+			int width = (level.get_width() + block - 1) / block * block;
+			int height = (level.get_height() + block - 1) / block * block;
+			for(int y=0; y<height; y+=strip_height)
+				strips.push_back({&level, y, width, std::min(strip_height, height - y), {}});
+		}
+
+		if(threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 1u);
+		threads = std::min<size_t>(threads, strips.size());
+
+		std::atomic<size_t> next = 0;
+		std::vector<std::exception_ptr> errors(threads);
+		auto work = [&](unsigned int thread) {
+			try
+			{
+				for(size_t i = next++; i < strips.size(); i = next++)
+					compress(format, extract(strips[i]), strips[i].out, strips[i].width, strips[i].height);
+			}
+			catch(...)
+			{
+				errors[thread] = std::current_exception();
+				next = strips.size();
+			}
+		};
+		{
+			std::vector<std::jthread> workers;
+			for(unsigned int t=1; t<threads; t++)
+				workers.emplace_back(work, t);
+			work(0);
+		}
+		for(auto& e : errors)
+		{
+			if(e)
+				std::rethrow_exception(e);
+		}
+
+		out.clear();
+		offsets.clear();
+		const image* level = nullptr;
+		for(auto& s : strips)
+		{
+			if(s.level != level)
+			{
+				offsets.push_back(out.size());
+				level = s.level;
+			}
+			out.insert(out.end(), s.out.begin(), s.out.end());
+		}
+	}
+}
+
+#endif
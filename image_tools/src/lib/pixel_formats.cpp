@@ -0,0 +1,471 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "pixel_formats.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_TOOLS_X86_SIMD
+#include <immintrin.h>
+#define SIMD_TARGET __attribute__((target("avx2,f16c")))
+#endif
+
+namespace image_tools
+{
+#ifdef WITH_VULKAN
+	namespace
+	{
+		static_assert(sizeof(image::color) == sizeof(uint32_t));
+
+		// converts `count` texels, the SIMD kernels hand the texels that do not fill a whole vector to the scalar ones
+		using kernel = void(*)(const uint8_t* in, uint32_t* out, size_t count, tonemap t);
+
+		template<typename T>
+		T load(const uint8_t* in, size_t index)
+		{
+			T value;
+			std::memcpy(&value, in + index * sizeof(T), sizeof(T));
+			return value;
+		}
+
+		float as_float(uint32_t bits)
+		{
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+		/*
+		 * The scalar kernels use the same operations in the same order as the SIMD ones, so both
+		 * produce identical results: NaN and negative values become 0 (like maxps does), then the
+		 * tonemapping is applied and the result is clamped to 1 and rounded.
+		 */
+		uint32_t unorm8(float x, tonemap t = tonemap::Clamp)
+		{
+			x = x > 0.0f ? x : 0.0f;
+			if(t == tonemap::Reinhard)
+				x = 1.0f - 1.0f / (1.0f + x);
+			x = x < 1.0f ? x : 1.0f;
+			return static_cast<uint32_t>(x * 255.0f + 0.5f);
+		}
+
+		// 5 bit exponent with a bias of 15, like halfs and the unsigned 11 and 10 bit floats of B10G11R11
+		float small_float(uint32_t bits, int mantissa)
+		{
+			int shift = 23 - mantissa;
+			if((bits >> mantissa) == 31)
+				return as_float(0x7f800000 | (bits & ((1u << mantissa) - 1)) << shift);
+			// moving exponent and mantissa into place and scaling by 2^(127-15) also handles denormals
+			return as_float(bits << shift) * 0x1p112f;
+		}
+
+		float half_to_float(uint16_t h)
+		{
+			float f = small_float(h & 0x7fff, 10);
+			return (h & 0x8000) ? -f : f;
+		}
+
+		uint32_t rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+		{
+			return r | g << 8 | b << 16 | a << 24;
+		}
+
+		uint32_t gray(uint32_t v)
+		{
+			return rgba(v, v, v, 0xff);
+		}
+
+		void rgba8_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			std::memcpy(out, in, count * sizeof(uint32_t));
+		}
+
+		void bgra8_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t c = load<uint32_t>(in, i);
+				out[i] = (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+			}
+		}
+
+		void r8_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = rgba(in[i], 0, 0, 0xff);
+		}
+
+		void rg8_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = rgba(in[2*i], in[2*i+1], 0, 0xff);
+		}
+
+		uint32_t unorm10_to_8(uint32_t v)
+		{
+			return (v * 255 + 511) / 1023;
+		}
+
+		void a2b10g10r10_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t c = load<uint32_t>(in, i);
+				out[i] = rgba(unorm10_to_8(c & 0x3ff), unorm10_to_8((c >> 10) & 0x3ff), unorm10_to_8((c >> 20) & 0x3ff), (c >> 30) * 85);
+			}
+		}
+
+		void a2r10g10b10_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t c = load<uint32_t>(in, i);
+				out[i] = rgba(unorm10_to_8((c >> 20) & 0x3ff), unorm10_to_8((c >> 10) & 0x3ff), unorm10_to_8(c & 0x3ff), (c >> 30) * 85);
+			}
+		}
+
+		uint32_t unorm16_to_8(uint32_t v)
+		{
+			return (v * 255 + 32767) / 65535;
+		}
+
+		void rgba16_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint64_t c = load<uint64_t>(in, i);
+				out[i] = rgba(unorm16_to_8(c & 0xffff), unorm16_to_8((c >> 16) & 0xffff), unorm16_to_8((c >> 32) & 0xffff), unorm16_to_8(c >> 48));
+			}
+		}
+
+		void r16f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = rgba(unorm8(half_to_float(load<uint16_t>(in, i)), t), 0, 0, 0xff);
+		}
+
+		void rg16f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t r = unorm8(half_to_float(load<uint16_t>(in, 2*i)), t);
+				uint32_t g = unorm8(half_to_float(load<uint16_t>(in, 2*i+1)), t);
+				out[i] = rgba(r, g, 0, 0xff);
+			}
+		}
+
+		void rgba16f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t r = unorm8(half_to_float(load<uint16_t>(in, 4*i)), t);
+				uint32_t g = unorm8(half_to_float(load<uint16_t>(in, 4*i+1)), t);
+				uint32_t b = unorm8(half_to_float(load<uint16_t>(in, 4*i+2)), t);
+				uint32_t a = unorm8(half_to_float(load<uint16_t>(in, 4*i+3)));
+				out[i] = rgba(r, g, b, a);
+			}
+		}
+
+		void r32f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = rgba(unorm8(load<float>(in, i), t), 0, 0, 0xff);
+		}
+
+		void rgba32f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t r = unorm8(load<float>(in, 4*i), t);
+				uint32_t g = unorm8(load<float>(in, 4*i+1), t);
+				uint32_t b = unorm8(load<float>(in, 4*i+2), t);
+				uint32_t a = unorm8(load<float>(in, 4*i+3));
+				out[i] = rgba(r, g, b, a);
+			}
+		}
+
+		void b10g11r11_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			for(size_t i=0; i<count; i++)
+			{
+				uint32_t c = load<uint32_t>(in, i);
+				uint32_t r = unorm8(small_float(c & 0x7ff, 6), t);
+				uint32_t g = unorm8(small_float((c >> 11) & 0x7ff, 6), t);
+				uint32_t b = unorm8(small_float(c >> 22, 5), t);
+				out[i] = rgba(r, g, b, 0xff);
+			}
+		}
+
+		void d16_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = gray(unorm8(static_cast<float>(load<uint16_t>(in, i)) * (1.0f / 65535.0f)));
+		}
+
+		void d24_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = gray(unorm8(static_cast<float>(load<uint32_t>(in, i) & 0xffffff) * (1.0f / 16777215.0f)));
+		}
+
+		void d32f_scalar(const uint8_t* in, uint32_t* out, size_t count, tonemap)
+		{
+			for(size_t i=0; i<count; i++)
+				out[i] = gray(unorm8(load<float>(in, i)));
+		}
+
+#ifdef IMAGE_TOOLS_X86_SIMD
+		SIMD_TARGET __m256 clamp_low(__m256 x)
+		{
+			return _mm256_max_ps(x, _mm256_setzero_ps());
+		}
+
+		SIMD_TARGET __m256 reinhard(__m256 x)
+		{
+			__m256 one = _mm256_set1_ps(1.0f);
+			return _mm256_sub_ps(one, _mm256_div_ps(one, _mm256_add_ps(one, x)));
+		}
+
+		// x must not be NaN or negative anymore
+		SIMD_TARGET __m256i to_unorm8(__m256 x)
+		{
+			x = _mm256_min_ps(x, _mm256_set1_ps(1.0f));
+			return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+		}
+
+		SIMD_TARGET __m256i channel(__m256 x, tonemap t)
+		{
+			x = clamp_low(x);
+			if(t == tonemap::Reinhard)
+				x = reinhard(x);
+			return to_unorm8(x);
+		}
+
+		// two RGBA pixels, alpha is never tonemapped
+		SIMD_TARGET __m256i rgba_channels(__m256 x, tonemap t)
+		{
+			x = clamp_low(x);
+			if(t == tonemap::Reinhard)
+				x = _mm256_blend_ps(reinhard(x), x, 0b10001000);
+			return to_unorm8(x);
+		}
+
+		// each argument holds two pixels as 32 bit integers per channel
+		SIMD_TARGET void store_rgba8(__m256i a, __m256i b, __m256i c, __m256i d, uint32_t* out)
+		{
+			// packing works within 128 bit lanes, which leaves the pixels in the order 0 2 4 6 1 3 5 7
+			__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+			packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+		}
+
+		SIMD_TARGET __m256i combine(__m256i r, __m256i g, __m256i b)
+		{
+			__m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 8));
+			__m256i ba = _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32(0xff000000));
+			return _mm256_or_si256(rg, ba);
+		}
+
+		SIMD_TARGET __m256 small_float(__m256i bits, int mantissa)
+		{
+			int shift = 23 - mantissa;
+			__m256 value = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_sll_epi32(bits, _mm_cvtsi32_si128(shift))), _mm256_set1_ps(0x1p112f));
+			__m256i mask = _mm256_set1_epi32((1 << mantissa) - 1);
+			__m256i special = _mm256_cmpeq_epi32(_mm256_srl_epi32(bits, _mm_cvtsi32_si128(mantissa)), _mm256_set1_epi32(31));
+			__m256i infinite = _mm256_or_si256(_mm256_set1_epi32(0x7f800000), _mm256_sll_epi32(_mm256_and_si256(bits, mask), _mm_cvtsi32_si128(shift)));
+			return _mm256_blendv_ps(value, _mm256_castsi256_ps(infinite), _mm256_castsi256_ps(special));
+		}
+
+		SIMD_TARGET void rgba16f_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				const __m128i* p = reinterpret_cast<const __m128i*>(in + i * 8);
+				store_rgba8(
+					rgba_channels(_mm256_cvtph_ps(_mm_loadu_si128(p + 0)), t),
+					rgba_channels(_mm256_cvtph_ps(_mm_loadu_si128(p + 1)), t),
+					rgba_channels(_mm256_cvtph_ps(_mm_loadu_si128(p + 2)), t),
+					rgba_channels(_mm256_cvtph_ps(_mm_loadu_si128(p + 3)), t),
+					out + i);
+			}
+			rgba16f_scalar(in + i * 8, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void rgba32f_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				const float* p = reinterpret_cast<const float*>(in + i * 16);
+				store_rgba8(
+					rgba_channels(_mm256_loadu_ps(p + 0), t),
+					rgba_channels(_mm256_loadu_ps(p + 8), t),
+					rgba_channels(_mm256_loadu_ps(p + 16), t),
+					rgba_channels(_mm256_loadu_ps(p + 24), t),
+					out + i);
+			}
+			rgba32f_scalar(in + i * 16, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void rg16f_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				const __m128i* p = reinterpret_cast<const __m128i*>(in + i * 4);
+				__m256i a = channel(_mm256_cvtph_ps(_mm_loadu_si128(p + 0)), t);
+				__m256i b = channel(_mm256_cvtph_ps(_mm_loadu_si128(p + 1)), t);
+				// R and G as 16 bit pairs, in the order 0 1 4 5 2 3 6 7
+				__m256i rg = _mm256_packus_epi32(a, b);
+				__m256i c = _mm256_or_si256(
+					_mm256_or_si256(_mm256_and_si256(rg, _mm256_set1_epi32(0xff)), _mm256_and_si256(_mm256_srli_epi32(rg, 8), _mm256_set1_epi32(0xff00))),
+					_mm256_set1_epi32(0xff000000));
+				c = _mm256_permutevar8x32_epi32(c, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), c);
+			}
+			rg16f_scalar(in + i * 4, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void b10g11r11_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 4));
+				__m256i mask = _mm256_set1_epi32(0x7ff);
+				__m256i r = channel(small_float(_mm256_and_si256(c, mask), 6), t);
+				__m256i g = channel(small_float(_mm256_and_si256(_mm256_srli_epi32(c, 11), mask), 6), t);
+				__m256i b = channel(small_float(_mm256_srli_epi32(c, 22), 5), t);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), combine(r, g, b));
+			}
+			b10g11r11_scalar(in + i * 4, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void store_gray(__m256 depth, uint32_t* out)
+		{
+			__m256i v = to_unorm8(clamp_low(depth));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), combine(v, v, v));
+		}
+
+		SIMD_TARGET void d16_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				__m256i d = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2)));
+				store_gray(_mm256_mul_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(1.0f / 65535.0f)), out + i);
+			}
+			d16_scalar(in + i * 2, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void d24_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+			{
+				__m256i d = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 4)), _mm256_set1_epi32(0xffffff));
+				store_gray(_mm256_mul_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(1.0f / 16777215.0f)), out + i);
+			}
+			d24_scalar(in + i * 4, out + i, count - i, t);
+		}
+
+		SIMD_TARGET void d32f_simd(const uint8_t* in, uint32_t* out, size_t count, tonemap t)
+		{
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+				store_gray(_mm256_loadu_ps(reinterpret_cast<const float*>(in + i * 4)), out + i);
+			d32f_scalar(in + i * 4, out + i, count - i, t);
+		}
+#endif
+
+#ifdef IMAGE_TOOLS_X86_SIMD
+#define KERNELS(name) {name##_scalar, name##_simd}
+#else
+#define KERNELS(name) {name##_scalar, nullptr}
+#endif
+
+		struct kernels
+		{
+			kernel scalar;
+			kernel simd;
+		};
+
+		kernels find_kernels(VkFormat format)
+		{
+			switch(format)
+			{
+				case VK_FORMAT_R8G8B8A8_UNORM:
+				case VK_FORMAT_R8G8B8A8_SRGB:
+					return {rgba8_scalar, nullptr};
+				case VK_FORMAT_B8G8R8A8_UNORM:
+				case VK_FORMAT_B8G8R8A8_SRGB:
+					return {bgra8_scalar, nullptr};
+				case VK_FORMAT_R8_UNORM:
+					return {r8_scalar, nullptr};
+				case VK_FORMAT_R8G8_UNORM:
+					return {rg8_scalar, nullptr};
+				case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+					return {a2b10g10r10_scalar, nullptr};
+				case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+					return {a2r10g10b10_scalar, nullptr};
+				case VK_FORMAT_R16G16B16A16_UNORM:
+				case VK_FORMAT_R16G16B16A16_UINT:
+					return {rgba16_scalar, nullptr};
+				case VK_FORMAT_R16_SFLOAT:
+					return {r16f_scalar, nullptr};
+				case VK_FORMAT_R16G16_SFLOAT:
+					return KERNELS(rg16f);
+				case VK_FORMAT_R16G16B16A16_SFLOAT:
+					return KERNELS(rgba16f);
+				case VK_FORMAT_R32_SFLOAT:
+					return {r32f_scalar, nullptr};
+				case VK_FORMAT_R32G32B32A32_SFLOAT:
+					return KERNELS(rgba32f);
+				case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+					return KERNELS(b10g11r11);
+				case VK_FORMAT_D16_UNORM:
+				case VK_FORMAT_D16_UNORM_S8_UINT:
+					return KERNELS(d16);
+				case VK_FORMAT_X8_D24_UNORM_PACK32:
+				case VK_FORMAT_D24_UNORM_S8_UINT:
+					return KERNELS(d24);
+				case VK_FORMAT_D32_SFLOAT:
+				case VK_FORMAT_D32_SFLOAT_S8_UINT:
+					return KERNELS(d32f);
+				default:
+					return {nullptr, nullptr};
+			}
+		}
+	}
+#endif
+
+	bool has_simd_conversion()
+	{
+#ifdef IMAGE_TOOLS_X86_SIMD
+		static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+#ifdef WITH_VULKAN
+	bool is_conversion_supported(VkFormat format)
+	{
+		return find_kernels(format).scalar != nullptr;
+	}
+
+	void convert(VkFormat format, const uint8_t* in, image& out, int w, int h, tonemap t, bool simd)
+	{
+		kernels k = find_kernels(format);
+		if(!k.scalar)
+			throw std::runtime_error("conversion from format "+std::to_string(format)+" is not supported");
+		if(out.get_width() != w || out.get_height() != h)
+			throw std::runtime_error("output image has the wrong size for the conversion");
+
+		kernel f = simd && k.simd && has_simd_conversion() ? k.simd : k.scalar;
+		f(in, reinterpret_cast<uint32_t*>(&*out.begin()), static_cast<size_t>(w) * h, t);
+	}
+#endif
+}
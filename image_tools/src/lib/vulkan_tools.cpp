@@ -90,6 +90,7 @@ namespace image_tools
 			case VK_FORMAT_BC4_UNORM_BLOCK:
 			case VK_FORMAT_BC4_SNORM_BLOCK:
 				compressBC4(in, out, w, h);
+				break;
 			case VK_FORMAT_BC5_UNORM_BLOCK:
 			case VK_FORMAT_BC5_SNORM_BLOCK:
 				compressBC5(in, out, w, h);
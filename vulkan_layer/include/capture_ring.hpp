@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <sys/types.h>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+/**
+ * A ring of raw frames in a shared memory file (usually under /dev/shm), for external tools that
+ * want to look at every captured frame. There is a single writer at a time, readers never lock.
+ *
+ * Layout (all integers little endian, as written by the host):
+ * - ring_header at offset 0
+ * - `slotCount` slots starting at `dataOffset`, each `slotStride` bytes long: a frame_header
+ *   at the start and the raw frame data 64 bytes into the slot, tightly packed in the Vulkan
+ *   format of the frame
+ *
+ * Every slot is protected by a sequence lock. Frame n (counting from 0) goes into slot
+ * n % slotCount; while it is written the sequence of the slot is 2n+1, afterwards 2n+2.
+ * `published` is the number of frames written so far. A reader that wants frame n:
+ * 1. loads `published` (acquire), frame n is available if n < published
+ * 2. loads the sequence of slot n % slotCount (acquire), and skips the frame if it is not 2n+2
+ * 3. uses the frame header and data in place
+ * 4. issues an acquire fence and loads the sequence again, if it changed the frame was overwritten
+ *    while it was used and everything read in 3. must be discarded
+ * Readers that fall more than slotCount frames behind lose frames, the writer never waits.
+ * A ring is replaced by a new file with larger slots when the captured attachment grows.
+ */
+class capture_ring {
+    public:
+        static constexpr char magic[8] = {'C', 'K', 'Y', 'C', 'A', 'P', 'T', 'R'};
+        static constexpr uint32_t version = 1;
+
+        struct ring_header {
+            char magic[8];
+            uint32_t version;
+            uint32_t slotCount;
+            uint64_t slotStride;
+            /** The largest frame that fits into a slot, larger ones are dropped. */
+            uint64_t slotCapacity;
+            uint64_t dataOffset;
+            uint64_t published;
+            /** Set once the ring was replaced or the device destroyed, readers should open the file again. */
+            uint64_t closed;
+        };
+
+        struct frame_header {
+            uint64_t sequence;
+            /** Number of frames presented by the application when the frame was captured. */
+            uint64_t frame;
+            /** Nanoseconds since the Unix epoch when the frame was captured. */
+            int64_t timestamp;
+            uint32_t format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t attachment;
+            uint64_t size;
+        };
+
+        struct frame_info {
+            VkFormat format;
+            VkExtent3D extent;
+            uint32_t attachment;
+            uint64_t frame;
+            int64_t timestamp;
+        };
+
+        struct statistics {
+            uint64_t published;
+            uint64_t oversized;
+        };
+
+        /** Creates (or replaces) the file, throws std::runtime_error if that fails. */
+        capture_ring(const std::filesystem::path& path, uint32_t slotCount, uint64_t slotCapacity);
+        ~capture_ring();
+
+        capture_ring(const capture_ring&) = delete;
+        capture_ring& operator=(const capture_ring&) = delete;
+
+        uint64_t capacity() const { return m_header->slotCapacity; }
+        /** Returns false if the frame is too large for the slots. */
+        bool publish(const frame_info& info, const uint8_t* data, uint64_t size);
+        statistics stats();
+        const std::filesystem::path& path() const { return m_path; }
+    private:
+        frame_header& slot(uint64_t index);
+
+        std::filesystem::path m_path;
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        ino_t m_inode = 0;
+        ring_header* m_header = nullptr;
+
+        // serializes writers, the sequence locks only protect readers
+        std::mutex m_mutex;
+        uint64_t m_next = 0;
+        uint64_t m_oversized = 0;
+};
+
+}
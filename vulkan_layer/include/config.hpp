@@ -3,6 +3,8 @@
 #include <filesystem>
 #include <functional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace CheekyLayer
 {
@@ -34,6 +36,30 @@ namespace CheekyLayer
 			bool dump_png;
 			bool dump_png_flipped;
 			std::filesystem::path dump_directory;
+			bool pipeline_cache;
+
+			std::unordered_set<std::string> async_actions;
+			size_t async_workers;
+			size_t async_queue_size;
+
+			size_t device_workers;
+			size_t device_queue_size;
+			size_t staging_ring_size;
+			uint64_t upload_batch_window;
+			bool dedicated_transfer_queue;
+			size_t image_cache_size;
+			bool image_cache_spill;
+			std::filesystem::path image_prefetch_manifest;
+			size_t readback_max_in_flight;
+			uint32_t readback_downscale;
+			bool readback_tonemap;
+			std::filesystem::path capture_directory;
+			uint32_t capture_slots;
+
+			bool profile_rules;
+			uint64_t profile_interval;
+
+			bool reload_rules;
 
 			bool override;
 			bool override_png_flipped;
@@ -28,6 +28,13 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 #define DeviceHook(func) \
 	(void)((VkuDeviceDispatchTable*)0)->func; \
 	if(!strcmp(pName, "vk" #func)) return (PFN_vkVoidFunction)&CheekyLayer_##func;
+// for functions of extensions or newer Vulkan versions, which the application must not see if the driver lacks them
+#define DeviceHookIfSupported(func) \
+	(void)((VkuDeviceDispatchTable*)0)->func; \
+	if(!strcmp(pName, "vk" #func)) { \
+		scoped_lock l(global_lock); \
+		return CheekyLayer::get_device(device).dispatch.func ? (PFN_vkVoidFunction)&CheekyLayer_##func : nullptr; \
+	}
 
 #define InstanceHooks() \
 	InstanceHook(GetInstanceProcAddr) \
@@ -63,6 +70,10 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	DeviceHook(CreateShaderModule) \
 	DeviceHook(CreateGraphicsPipelines) \
 	DeviceHook(CreatePipelineLayout) \
+	DeviceHook(CreateRenderPass) \
+	DeviceHookIfSupported(CreateRenderPass2) \
+	DeviceHookIfSupported(CreateRenderPass2KHR) \
+	DeviceHook(DestroyRenderPass) \
 	\
 	DeviceHook(CreateFramebuffer) \
 	DeviceHook(CreateSwapchainKHR) \
@@ -88,8 +99,14 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	\
 	DeviceHook(AllocateCommandBuffers) \
 	DeviceHook(FreeCommandBuffers) \
+	DeviceHook(DestroyCommandPool) \
+	DeviceHook(ResetCommandPool) \
+	DeviceHook(BeginCommandBuffer) \
+	DeviceHook(ResetCommandBuffer) \
 	DeviceHook(EndCommandBuffer) \
 	DeviceHook(QueueSubmit) \
+	DeviceHookIfSupported(QueueSubmit2) \
+	DeviceHookIfSupported(QueueSubmit2KHR) \
 
 #define InstanceDispatch(name) \
 	dispatchTable.name = (PFN_vk##name)gpa(instance, "vk"#name);
@@ -119,7 +136,10 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	DeviceDispatch(GetDeviceQueue) \
 	DeviceDispatch(CreateCommandPool) \
 	DeviceDispatch(DestroyCommandPool) \
+	DeviceDispatch(ResetCommandPool) \
 	DeviceDispatch(QueueSubmit) \
+	DeviceDispatch(QueueSubmit2) \
+	DeviceDispatch(QueueSubmit2KHR) \
 	DeviceDispatch(QueueWaitIdle) \
 	\
 	DeviceDispatch(CreateShaderModule) \
@@ -139,11 +159,19 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	DeviceDispatch(MapMemory) \
 	DeviceDispatch(UnmapMemory) \
 	DeviceDispatch(FlushMappedMemoryRanges) \
+	DeviceDispatch(InvalidateMappedMemoryRanges) \
 	\
 	DeviceDispatch(CreateShaderModule) \
 	DeviceDispatch(CreateGraphicsPipelines) \
+	DeviceDispatch(CreatePipelineCache) \
+	DeviceDispatch(DestroyPipelineCache) \
+	DeviceDispatch(GetPipelineCacheData) \
+	DeviceDispatch(MergePipelineCaches) \
 	DeviceDispatch(CreatePipelineLayout) \
 	DeviceDispatch(CreateRenderPass) \
+	DeviceDispatch(CreateRenderPass2) \
+	DeviceDispatch(CreateRenderPass2KHR) \
+	DeviceDispatch(DestroyRenderPass) \
 	\
 	DeviceDispatch(CreateDescriptorSetLayout) \
 	DeviceDispatch(CreateDescriptorPool) \
@@ -181,6 +209,7 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	DeviceDispatch(QueuePresentKHR) \
 	DeviceDispatch(GetSwapchainImagesKHR) \
 	DeviceDispatch(CreateSemaphore) \
+	DeviceDispatch(DestroySemaphore) \
 	\
 	DeviceDispatch(CreateFramebuffer) \
 	DeviceDispatch(CreateEvent) \
@@ -190,5 +219,7 @@ void InitDeviceDispatchTable(VkDevice device, PFN_vkGetDeviceProcAddr gdpa, VkuD
 	DeviceDispatch(CmdCopyImageToBuffer) \
 	\
 	DeviceDispatch(CreateFence) \
+	DeviceDispatch(DestroyFence) \
 	DeviceDispatch(ResetFences) \
+	DeviceDispatch(GetFenceStatus) \
 	DeviceDispatch(WaitForFences)
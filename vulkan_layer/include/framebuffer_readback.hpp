@@ -0,0 +1,123 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+struct device;
+struct command_buffer_state;
+struct submit_fence;
+class capture_ring;
+
+/**
+ * Reads framebuffer attachments back into a fixed number of pooled host buffers. The copies are
+ * recorded into the application's command buffer, and its submit gets one of our fences through
+ * the device's submit_extension. A single thread waits for these fences and passes finished
+ * readbacks to the dump workers of the device, which convert, downscale and write them, or
+ * publish them to a capture ring unchanged.
+ * If all buffers are in use, further dumps are dropped instead of ever waiting for the GPU.
+ * Only the first submit of a command buffer is read back. A buffer is not reused before that command
+ * buffer was reset or freed, because a resubmit writes into it again.
+ */
+class framebuffer_readback {
+    public:
+        struct request {
+            VkImage image;
+            VkImageCreateInfo info;
+            /** The layout the image is in when the copy executes, it is transitioned back to it afterwards. */
+            VkImageLayout layout;
+            uint32_t attachment;
+            /** Captures are published to this ring instead of being written to a file. */
+            std::shared_ptr<capture_ring> capture;
+            uint64_t frame;
+            int64_t timestamp;
+        };
+
+        struct statistics {
+            uint64_t recorded;
+            uint64_t dropped;
+            uint64_t completed;
+            uint64_t cancelled;
+            size_t maxInFlight;
+        };
+
+        framebuffer_readback() = default;
+        ~framebuffer_readback();
+
+        framebuffer_readback(const framebuffer_readback&) = delete;
+        framebuffer_readback& operator=(const framebuffer_readback&) = delete;
+
+        /**
+         * `downscale` is the number of times dumps are halved in size before they are written as PNG,
+         * `tonemap` compresses the range of floating point formats instead of clamping them.
+         */
+        void configure(device* device, size_t maxInFlight, uint32_t downscale, bool tonemap);
+        /** Returns false if the readback was dropped, because all buffers are in use. */
+        bool record(VkCommandBuffer commandBuffer, command_buffer_state& state, const request& r);
+        statistics stats();
+        /** Size of a readback of the first mip level and layer (and only the depth aspect) of an image, tightly packed. */
+        static VkDeviceSize size(const VkImageCreateInfo& info);
+        /** Waits for the readbacks on the GPU and destroys all buffers, pending ones are cancelled. */
+        void shutdown();
+    private:
+        struct slot {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            uint8_t* data = nullptr;
+            VkDeviceSize capacity = 0;
+            bool coherent = true;
+            bool busy = false;
+            // the command buffer with the copy was not reset yet, so it might write into the buffer again when it is resubmitted
+            bool recorded = false;
+            request req;
+        };
+        struct fenced {
+            std::shared_ptr<submit_fence> fence;
+            size_t slot;
+        };
+
+        std::optional<size_t> acquire(VkDeviceSize size);
+        bool allocate(slot& s, VkDeviceSize size);
+        void release(size_t index, bool completed);
+        /** Called once the command buffer the readback was recorded into is reset or freed. */
+        void forget(size_t index, bool submitted);
+        /** Called once the application's submit went to the driver, `fence` is nullptr if it finished already. */
+        void submitted(size_t index, VkResult result, std::shared_ptr<submit_fence> fence);
+        /** Passes a finished readback to the dump workers. */
+        void dump(size_t index);
+        void run(std::stop_token stop);
+        void complete(size_t index);
+        void write(const request& r, const uint8_t* data, VkDeviceSize size);
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_cv;
+        device* m_device = nullptr;
+        uint32_t m_downscale = 0;
+        bool m_tonemap = false;
+        bool m_shutdown = false;
+
+        std::vector<slot> m_slots;
+        std::deque<fenced> m_fenced;
+        // pending QueueSubmit callbacks of command buffers that were never submitted cancel their readback, unless we are gone
+        std::shared_ptr<framebuffer_readback*> m_alive;
+
+        uint64_t m_recorded = 0;
+        uint64_t m_dropped = 0;
+        uint64_t m_completed = 0;
+        uint64_t m_cancelled = 0;
+        size_t m_maxInFlight = 0;
+
+        std::jthread m_thread;
+};
+
+}
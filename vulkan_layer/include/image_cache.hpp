@@ -0,0 +1,114 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+/**
+ * Transcoded image files (e.g. PNGs compressed to the format of the image they replace), shared by
+ * all devices of an instance. The least recently used entries are evicted once the cache is over its
+ * byte budget, and optionally written to a spill directory they are read back from on the next miss.
+ * Concurrent requests for an entry that is being loaded wait for that load instead of repeating it.
+ */
+class image_file_cache {
+    public:
+        // must be kinda specific, because format, extent and mipLevels must match
+        struct key {
+            std::string filename;
+            VkFormat format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t mipLevels;
+
+            auto operator<=>(const key&) const = default;
+        };
+
+        struct entry {
+            std::vector<uint8_t> data;
+            std::vector<VkDeviceSize> offsets;
+        };
+        using value = std::shared_ptr<const entry>;
+
+        struct statistics {
+            size_t bytes;
+            size_t entries;
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t deduplicated;
+            uint64_t evictions;
+            uint64_t spilled;
+            uint64_t spillHits;
+        };
+
+        /** Without a spill directory evicted entries are just dropped. */
+        void configure(size_t budget, std::optional<std::filesystem::path> spillDirectory);
+        /**
+         * Exceptions thrown by `load` are passed on to everybody waiting for it.
+         * Prefetches do not count as a use of the key for the manifest.
+         */
+        value get(const key& k, const std::function<entry()>& load, bool prefetch = false);
+        statistics stats();
+
+        /**
+         * A manifest lists the keys loaded in previous sessions, one per line, so they can be loaded
+         * before they are needed. Missing or malformed files and lines are ignored.
+         */
+        static std::vector<key> read_manifest(const std::filesystem::path& path);
+        /**
+         * Writes the keys loaded by this cache in the order they were first needed, followed by those
+         * of `previous` that were not needed this time, skipping files that no longer exist.
+         */
+        void write_manifest(const std::filesystem::path& path, const std::vector<key>& previous);
+    private:
+        struct cached {
+            value v;
+            size_t size;
+            std::list<key>::iterator lru;
+        };
+
+        void insert(const key& k, value v, std::vector<std::pair<key, value>>& evicted);
+        std::filesystem::path spill_path(const key& k) const;
+        void spill(const key& k, const entry& e);
+        value unspill(const key& k);
+
+        std::mutex m_mutex;
+        size_t m_budget = 0;
+        std::optional<std::filesystem::path> m_spillDirectory;
+
+        std::map<key, cached> m_entries;
+        std::map<key, std::shared_future<value>> m_loading;
+        // most recently used first
+        std::list<key> m_lru;
+        size_t m_bytes = 0;
+
+        // every key ever loaded, for the manifest
+        std::vector<key> m_loaded;
+        std::set<key> m_loadedSet;
+
+        uint64_t m_hits = 0;
+        uint64_t m_misses = 0;
+        uint64_t m_deduplicated = 0;
+        uint64_t m_evictions = 0;
+        uint64_t m_spilled = 0;
+        uint64_t m_spillHits = 0;
+};
+
+#ifdef USE_IMAGE_TOOLS
+/** Decodes a PNG and compresses it (and its mip levels) to the format of the key, using up to `threads` threads. */
+image_file_cache::entry transcode_png(const image_file_cache::key& k, unsigned int threads);
+#endif
+
+}
@@ -59,8 +59,16 @@ VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_UpdateDescriptorSetWithTemplate(VkDe
 // draw.cpp
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_AllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo*, VkCommandBuffer*);
 VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_FreeCommandBuffers(VkDevice, VkCommandPool, uint32_t, const VkCommandBuffer*);
+VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyCommandPool(VkDevice, VkCommandPool, const VkAllocationCallbacks*);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_ResetCommandPool(VkDevice, VkCommandPool, VkCommandPoolResetFlags);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_BeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_ResetCommandBuffer(VkCommandBuffer, VkCommandBufferResetFlags);
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateFramebuffer(VkDevice, const VkFramebufferCreateInfo*, const VkAllocationCallbacks*, VkFramebuffer*);
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreatePipelineLayout(VkDevice, const VkPipelineLayoutCreateInfo*, const VkAllocationCallbacks*, VkPipelineLayout*);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass(VkDevice, const VkRenderPassCreateInfo*, const VkAllocationCallbacks*, VkRenderPass*);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass2(VkDevice, const VkRenderPassCreateInfo2*, const VkAllocationCallbacks*, VkRenderPass*);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass2KHR(VkDevice, const VkRenderPassCreateInfo2*, const VkAllocationCallbacks*, VkRenderPass*);
+VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyRenderPass(VkDevice, VkRenderPass, const VkAllocationCallbacks*);
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateGraphicsPipelines(VkDevice, VkPipelineCache, uint32_t, const VkGraphicsPipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline*);
 VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_CmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t, uint32_t, const VkDescriptorSet*, uint32_t, const uint32_t*);
 VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_CmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline);
@@ -80,3 +88,5 @@ VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateSwapchainKHR(VkDevice, con
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_GetSwapchainImagesKHR(VkDevice, VkSwapchainKHR, uint32_t*, VkImage*);
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueuePresentKHR(VkQueue, const VkPresentInfoKHR*);
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit(VkQueue, uint32_t, const VkSubmitInfo*, VkFence);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit2(VkQueue, uint32_t, const VkSubmitInfo2*, VkFence);
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit2KHR(VkQueue, uint32_t, const VkSubmitInfo2*, VkFence);
@@ -1,10 +1,23 @@
 #pragma once
 
+#include "capture_ring.hpp"
 #include "config.hpp"
 #include "dispatch.hpp"
+#include "framebuffer_readback.hpp"
+#include "image_cache.hpp"
 #include "rules/rules.hpp"
+#include "rules/ruleset.hpp"
+#include "staging_ring.hpp"
+#include "upload_batcher.hpp"
+#include "worker_pool.hpp"
+#include <array>
+#include <atomic>
+#include <filesystem>
 #include <memory>
+#include <optional>
+#include <set>
 #include <spdlog/logger.h>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vulkan/vulkan_core.h>
@@ -61,9 +74,17 @@ struct buffer_binding
 	VkDeviceSize size;
 };
 
+enum class command_buffer_event
+{
+	EndCommandBuffer,
+	QueueSubmit,
+	EndRenderPass
+};
+
 struct command_buffer_state
 {
 	VkDevice device;
+	VkCommandPool pool;
 	VkPipeline pipeline;
 	std::vector<VkDescriptorSet> descriptorSets;
 	std::vector<uint32_t> descriptorDynamicOffsets;
@@ -79,9 +100,21 @@ struct command_buffer_state
 
 	VkRenderPass renderpass;
 	VkFramebuffer framebuffer;
+	// cleared as soon as the render pass ended, before the EndRenderPass callbacks run
+	bool renderPassActive;
 
 	bool transformFeedback;
 	std::vector<buffer_binding> transformFeedbackBuffers;
+
+	// scheduled by on(...), command buffers are externally synchronized, so no locking is needed
+	std::array<std::vector<std::function<void(rules::local_context&)>>, 3> callbacks;
+	// kept alive until the command buffer is reset or freed, like the readback buffers its commands write into
+	std::vector<std::shared_ptr<void>> resources;
+
+	void on(command_buffer_event event, std::function<void(rules::local_context&)> callback)
+	{
+		callbacks[static_cast<size_t>(event)].push_back(std::move(callback));
+	}
 };
 
 struct pipeline_layout_info
@@ -90,6 +123,11 @@ struct pipeline_layout_info
 	std::vector<VkPushConstantRange> pushConstantRanges;
 };
 
+struct render_pass_info
+{
+	std::vector<VkImageLayout> finalLayouts;
+};
+
 struct framebuffer
 {
 	std::vector<VkImageView> attachments;
@@ -106,6 +144,39 @@ struct framebuffer
 	}
 };
 
+struct device;
+
+// one of our fences, it goes back to the device once nobody waits for it anymore
+struct submit_fence
+{
+	device& dev;
+	VkFence handle;
+
+	~submit_fence();
+};
+
+// what the layer adds to an application submit, so its work goes to the driver in the same vkQueueSubmit
+struct submit_extension
+{
+	// waited for by a batch of ours in front of the application's, its command buffers are in there as well
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkPipelineStageFlags> waitStages;
+	std::vector<VkCommandBuffer> commandBuffers;
+	// signaled by a batch of ours after the application's, so they cover all of its work
+	std::vector<VkSemaphore> signalSemaphores;
+	// added by QueueSubmit callbacks, submitted right after the command buffer that scheduled them
+	std::vector<VkCommandBuffer> following;
+	// shared by everyone who wants to know when the submit finished, see device::fence_for()
+	std::shared_ptr<submit_fence> fence;
+	// called once the submit went to the driver, without a fence if everything in it finished already
+	std::vector<std::function<void(VkResult, std::shared_ptr<submit_fence>)>> submitted;
+
+	bool empty() const
+	{
+		return waitSemaphores.empty() && commandBuffers.empty() && signalSemaphores.empty() && !fence && submitted.empty();
+	}
+};
+
 struct device {
     device() = default;
     device(instance* inst, PFN_vkGetDeviceProcAddr gdpa, VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo, VkDevice *pDevice);
@@ -123,15 +194,31 @@ struct device {
     VkuDeviceDispatchTable dispatch;
 
     bool has_debug = false;
+    bool has_creation_feedback = false;
 
     VkPhysicalDevice physicalDevice;
     VkPhysicalDeviceProperties props;
     VkPhysicalDeviceMemoryProperties memProperties;
     std::vector<VkQueueFamilyProperties> queueFamilies;
 
+    struct pipeline_cache_stats {
+        std::atomic<uint64_t> hits = 0;
+        std::atomic<uint64_t> misses = 0;
+        std::atomic<uint64_t> unknown = 0;
+    };
+    VkPipelineCache layerPipelineCache = VK_NULL_HANDLE;
+    std::filesystem::path pipelineCachePath;
+    pipeline_cache_stats pipelineCacheStats;
+
     VkQueue transferQueue = VK_NULL_HANDLE;
-    VkCommandPool transferPool;
-    VkCommandBuffer transferBuffer;
+    uint32_t transferQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    // only used by the upload thread
+    VkCommandPool transferPool = VK_NULL_HANDLE;
+    // the first graphics queue of the application, which is also the transfer queue if there is no dedicated one
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    uint32_t graphicsQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    // for taking over images uploaded on a dedicated transfer queue, only used by the upload thread
+    VkCommandPool graphicsPool = VK_NULL_HANDLE;
 
     struct buffer {
         VkBuffer buffer;
@@ -167,12 +254,36 @@ struct device {
     std::map<rules::VkHandle, spv_reflect::ShaderModule> shaderReflections;
 
     std::map<VkCommandBuffer, command_buffer_state> commandBufferStates;
+    // number of QueueSubmit callbacks in all command buffers, lets submits skip the lookup when there are none
+    std::atomic<size_t> pendingSubmitCallbacks = 0;
+    // fences of submit_extension that signaled and were reset
+    std::mutex submitFenceLock;
+    std::vector<VkFence> freeSubmitFences;
     std::map<VkPipelineLayout, pipeline_layout_info> pipelineLayouts;
+    std::map<VkRenderPass, render_pass_info> renderPasses;
     std::map<VkPipeline, pipeline_state> pipelineStates;
 
     std::map<VkDescriptorUpdateTemplate, std::vector<VkDescriptorUpdateTemplateEntry>> updateTemplates;
     std::map<VkDescriptorSet, descriptor_state> descriptorStates;
 
+    staging_ring staging;
+    upload_batcher uploads;
+    framebuffer_readback readbacks;
+    // capturefb rings by name
+    std::mutex captureLock;
+    std::map<std::string, std::shared_ptr<capture_ring>> captureRings;
+    // rings that are being (re)created by a worker
+    std::set<std::string> captureRingsCreating;
+    struct capture_failure {
+        unsigned int count;
+        // present count from which the creation is tried again
+        uint64_t retryFrame;
+    };
+    // rings whose creation failed, retried with a growing backoff
+    std::map<std::string, capture_failure> captureRingsFailed;
+    // declared last, so running tasks are stopped before the state they use is destroyed
+    worker_pool workers;
+
     void execute_rules(rules::selector_type type, rules::VkHandle handle, rules::calling_context& ctx);
     void memory_access(VkDeviceMemory memory, std::function<void(void*, VkDeviceSize)> function, VkDeviceSize offset = 0);
     void memory_access(VkBuffer buffer, std::function<void(void*, VkDeviceSize)> function, VkDeviceSize offset = 0);
@@ -180,6 +291,13 @@ struct device {
     bool has_override(const std::string& hash);
 
     void GetDeviceQueue(uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue *pQueue);
+    VkCommandPool create_command_pool(uint32_t queueFamilyIndex);
+    bool init_transfer_queue(uint32_t queueFamilyIndex, uint32_t queueIndex);
+
+    // pipeline_cache.cpp
+    void load_pipeline_cache();
+    void save_pipeline_cache();
+    bool pipeline_cache_compatible(const std::vector<uint8_t>& data);
 
     // images.cpp
     VkResult CreateImage(const VkImageCreateInfo*, const VkAllocationCallbacks*, VkImage*);
@@ -204,8 +322,17 @@ struct device {
     // draw.cpp
     VkResult AllocateCommandBuffers(const VkCommandBufferAllocateInfo*, VkCommandBuffer*);
     void FreeCommandBuffers(VkCommandPool, uint32_t, const VkCommandBuffer*);
+    void DestroyCommandPool(VkCommandPool, const VkAllocationCallbacks*);
+    VkResult ResetCommandPool(VkCommandPool, VkCommandPoolResetFlags);
+    VkResult BeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*);
+    VkResult ResetCommandBuffer(VkCommandBuffer, VkCommandBufferResetFlags);
+    void drop_callbacks(command_buffer_state& state);
+    void reset_state(command_buffer_state& state);
     VkResult CreateFramebuffer(const VkFramebufferCreateInfo*, const VkAllocationCallbacks*, VkFramebuffer*);
     VkResult CreatePipelineLayout(const VkPipelineLayoutCreateInfo*, const VkAllocationCallbacks*, VkPipelineLayout*);
+    VkResult CreateRenderPass(const VkRenderPassCreateInfo*, const VkAllocationCallbacks*, VkRenderPass*);
+    VkResult CreateRenderPass2(const VkRenderPassCreateInfo2*, const VkAllocationCallbacks*, VkRenderPass*, PFN_vkCreateRenderPass2 next);
+    void DestroyRenderPass(VkRenderPass, const VkAllocationCallbacks*);
     VkResult CreateGraphicsPipelines(VkPipelineCache, uint32_t, const VkGraphicsPipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline*);
     VkResult CreateSwapchainKHR(const VkSwapchainCreateInfoKHR*, const VkAllocationCallbacks*, VkSwapchainKHR*);
     VkResult GetSwapchainImagesKHR(VkSwapchainKHR, uint32_t*, VkImage*);
@@ -223,7 +350,14 @@ struct device {
     void CmdBindTransformFeedbackBuffersEXT(VkCommandBuffer, uint32_t, uint32_t, const VkBuffer*, const VkDeviceSize*, const VkDeviceSize*);
     void CmdEndTransformFeedbackEXT(VkCommandBuffer, uint32_t, uint32_t, const VkBuffer*, const VkDeviceSize*);
     VkResult EndCommandBuffer(VkCommandBuffer);
+    void run_callbacks(VkCommandBuffer, command_buffer_state&, command_buffer_event, submit_extension* submit = nullptr);
+    void run_submit_callbacks(VkCommandBuffer, submit_extension& submit);
+    /** Adds a fence to the submit, or returns the one it has already. Returns nullptr if none could be created. */
+    std::shared_ptr<submit_fence> fence_for(submit_extension& submit);
+    /** Hands the result of a submit to whoever added something to it. */
+    void submitted(submit_extension& submit, VkResult result, VkResult fenceResult);
     VkResult QueueSubmit(VkQueue, uint32_t, const VkSubmitInfo*, VkFence);
+    VkResult QueueSubmit2(VkQueue, uint32_t, const VkSubmitInfo2*, VkFence, PFN_vkQueueSubmit2 next);
     VkResult QueuePresentKHR(VkQueue, const VkPresentInfoKHR*);
 };
 
@@ -242,27 +376,42 @@ struct instance {
 
     unsigned int id;
     VkInstance handle;
+    uint32_t apiVersion = VK_API_VERSION_1_0;
     VkuInstanceDispatchTable dispatch;
 
     CheekyLayer::config config;
     bool enabled = false;
     bool hook_draw_calls = false;
 
-    std::vector<std::unique_ptr<rules::rule>> rules;
+    rules::ruleset_holder rules;
     std::map<CheekyLayer::rules::selector_type, bool> has_rules;
+    std::atomic<bool> reloadRequested = false;
     rules::global_context global_context;
+    std::atomic<uint64_t> presentCount = 0;
 
     std::unordered_set<std::string> overrideCache;
     std::unordered_set<std::string> dumpCache;
+    image_file_cache imageCache;
 
     std::mutex lock;
     std::shared_ptr<spdlog::logger> logger;
 
     std::unordered_map<VkDevice, device*> devices;
 
+    std::vector<image_file_cache::key> prefetchManifest;
+
+    // declared last, so they are stopped before anything they use is destroyed
+    std::jthread rulesReloader;
+    std::jthread imagePrefetcher;
+
     void execute_rules(rules::selector_type type, rules::VkHandle handle, rules::calling_context& ctx);
     void put_hash(rules::VkHandle handle, std::string hash);
 
+    void reload_rules();
+    void watch_rules(std::stop_token stop);
+    void prefetch_images(std::stop_token stop);
+
+    std::optional<uint32_t> find_transfer_queue_family(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo);
     VkResult CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDevice *pDevice);
 };
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace CheekyLayer::reflection {
 	std::any parse_get(std::string path, const void* p, std::string type);
@@ -13,4 +15,67 @@ namespace CheekyLayer::reflection {
 	std::string parse_get_string(std::string path, const void* p, std::string type);
 
 	std::any parse_rvalue(std::string expression, const void* p, std::string dtype);
+
+	enum class primitive_kind
+	{
+		None,
+		UInt32,
+		Int32,
+		Bool32,
+		Float,
+		Enum,
+		Flags
+	};
+
+	/**
+	 * One step of a compiled access path. The step adds `offset` to the current pointer and,
+	 * if `deref` is set, follows the pointer stored there. Indexed steps check the index against
+	 * the uint32_t length found at `lengthOffset` (relative to the same base as `offset`) first.
+	 */
+	struct path_step
+	{
+		int offset = 0;
+		bool deref = false;
+		int index = -1;
+		int stride = 0;
+		int lengthOffset = -1;
+
+		std::string name;
+		std::string lengthName;
+	};
+
+	/**
+	 * A member access path like "pViewportState->pScissors[0].extent.width" resolved once against
+	 * struct_reflection_map. Resolving it later is plain pointer arithmetic.
+	 */
+	struct compiled_path
+	{
+		std::string path;
+		std::string type;
+		primitive_kind kind = primitive_kind::None;
+		std::vector<path_step> steps;
+
+		const void* resolve(const void* p) const;
+		void* resolve(void* p) const;
+
+		uint32_t get_raw(const void* p) const;
+		void set_raw(void* p, uint32_t bits) const;
+
+		std::any get(const void* p) const;
+		void set(void* p, std::any value) const;
+		double get_number(const void* p) const;
+		std::string get_string(const void* p) const;
+	};
+
+	struct compiled_assignment
+	{
+		std::string expression;
+		compiled_path target;
+		uint32_t bits;
+
+		void apply(void* p) const;
+	};
+
+	compiled_path compile_path(std::string path, std::string type);
+	compiled_assignment compile_assign(std::string expression, std::string type);
 }
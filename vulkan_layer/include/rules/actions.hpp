@@ -1,10 +1,13 @@
 #pragma once
 
+#include "reflection/reflectionparser.hpp"
 #include "rules.hpp"
 #include "rules/execution_env.hpp"
+#include <atomic>
 #include <cstdint>
 #include <istream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
@@ -164,12 +167,51 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
+			virtual std::string async_key();
+			virtual bool async_safe();
 		private:
 			std::vector<std::unique_ptr<action>> m_actions;
 
 			static action_register<sequence_action> reg;
 	};
 
+	/** Executes an action on the instance's async worker pool instead of inside the Vulkan call that triggered it.
+	 * Local variables are snapshotted and data received over IPC is copied. Other hook specific
+	 * information (e.g. the create info of a pipeline) is not available to the wrapped action.
+	 * Actions writing to the same file descriptor are executed in order.
+	 * If the queue is full, the action is dropped.
+	 *
+	 * Only actions that do not need the Vulkan call can be wrapped: \c log, \c logx, \c socket, \c server_socket,
+	 * \c write, \c set_global, \c global_cas, \c set_local, \c reload_rules and \c seq of those.
+	 *
+	 * \par Usage
+	 * \code{.unparsed}
+	 * async(<action>)
+	 * \endcode
+	 *
+	 * \par Example
+	 * \code{.unparsed}
+	 * receive{} -> async(write(socket, received()))
+	 * \endcode
+	 */
+	class async_action : public action
+	{
+		public:
+			async_action(selector_type type) : action(type) {}
+			async_action(selector_type type, std::unique_ptr<action> inner) : action(type), m_action(std::move(inner)) {}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
+		private:
+			std::unique_ptr<action> m_action;
+
+			static action_register<async_action> reg;
+	};
+
 	class each_action : public action
 	{
 		public:
@@ -180,6 +222,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
 		private:
 			std::unique_ptr<selector> m_selector;
 			std::unique_ptr<action> m_action;
@@ -201,6 +245,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
 		protected:
 			on_action_event on_action_event_from_string(std::string s)
 			{
@@ -261,6 +307,44 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			static action_register<cancel_action> reg;
 	};
 
+	class reload_rules_action : public action
+	{
+		public:
+			reload_rules_action(selector_type type) : action(type) {}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+		private:
+
+			static action_register<reload_rules_action> reg;
+	};
+
+	class profile_reset_action : public action
+	{
+		public:
+			profile_reset_action(selector_type type) : action(type) {}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+		private:
+
+			static action_register<profile_reset_action> reg;
+	};
+
+	class fire_action : public action
+	{
+		public:
+			fire_action(selector_type type) : action(type) {}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			std::unique_ptr<data> m_tag;
+
+			static action_register<fire_action> reg;
+	};
+
 	class log_action : public action
 	{
 		public:
@@ -268,6 +352,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+			virtual std::string async_key() { return "log"; }
 		private:
 			std::string m_text;
 
@@ -281,6 +367,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+			virtual std::string async_key() { return "log"; }
 		private:
 			std::unique_ptr<data> m_data;
 
@@ -290,12 +378,16 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 	class override_action : public action
 	{
 		public:
-			override_action(selector_type type) : action(type) {}
+			override_action(selector_type type) : action(type) {
+				if(type != selector_type::Pipeline)
+					throw std::runtime_error("the \"override\" action is only supported for pipeline selectors, but not for "+to_string(type)+" selectors");
+			}
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
 		private:
 			std::string m_expression;
+			reflection::compiled_assignment m_assignment;
 
 			static action_register<override_action> reg;
 	};
@@ -307,6 +399,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+			virtual std::string async_key() { return m_name; }
 		private:
 			std::string m_name;
 			ipc::socket_type m_socketType;
@@ -324,6 +418,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+			virtual std::string async_key() { return m_name; }
 		private:
 			std::string m_name;
 			ipc::socket_type m_socketType;
@@ -341,6 +437,8 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+			virtual std::string async_key() { return m_fd; }
 		private:
 			std::string m_fd;
 			std::unique_ptr<data> m_data;
@@ -403,6 +501,47 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			int m_attachment;
 
 			static action_register<dump_framebuffer_action> reg;
+			static action_register<dump_framebuffer_action> reg2;
+	};
+
+	/** Publishes a framebuffer attachment to a shared memory ring for external tools.
+	 *
+	 * \par Usage
+	 * \code{.unparsed}
+	 * capturefb(<attachment>, <name>)
+	 * capturefb(<attachment>, <name>, <frames>)
+	 * \endcode
+	 * 1. Captures the attachment after every matching draw call.
+	 * 2. Captures the attachment after the first matching draw call, at most once every \c <frames> presented frames.
+	 * \param <attachment> The index of the attachment in the framebuffer.
+	 * \param <name> The name of the ring file in the capture directory. Must not contain '/', ',' or ')'.
+	 * \param <frames> The number of presented frames between two captures.
+	 *
+	 * \par Example
+	 * This rule captures the first color attachment once every second frame, unlike \ref every_action "every",
+	 * which counts the matching draw calls.
+	 * \code{.unparsed}
+	 * draw{} -> capturefb(0, color, 2)
+	 * \endcode
+	 */
+	class capture_framebuffer_action : public action
+	{
+		public:
+			capture_framebuffer_action(selector_type type) : action(type) {
+				if(type != selector_type::Draw)
+					throw std::runtime_error("the \"capturefb\" action is only supported for draw selectors, but not for "+to_string(type)+" selectors");
+			}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			int m_attachment;
+			std::string m_name;
+			uint64_t m_frames = 0;
+			// the first frame that may be captured again
+			std::atomic<uint64_t> m_nextFrame = 0;
+
+			static action_register<capture_framebuffer_action> reg;
 	};
 
 	class every_action : public action
@@ -412,8 +551,11 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
 		private:
-			int m_i = 0;
+			// counts executions from any thread, so it is atomic instead of wrapping at m_n
+			std::atomic<uint64_t> m_i = 0;
 			int m_n;
 			std::unique_ptr<action> m_action;
 
@@ -446,6 +588,7 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
 		private:
 			data_type m_dtype;
 			std::string m_name;
@@ -455,6 +598,35 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			static action_register<set_global_action> reg2;
 	};
 
+	/** Sets a global variable, but only if its version (see \c global_version) is still the expected one.
+	 * It is a single attempt, conflicts are not retried. If a local variable is given, it is set to 1
+	 * if the value was stored and to 0 otherwise.
+	 *
+	 * \par Usage
+	 * \code{.unparsed}
+	 * global_cas(<type>, <name>, <version>, <value>)
+	 * global_cas(<type>, <name>, <version>, <value>, <result>)
+	 * \endcode
+	 */
+	class compare_and_set_global_action : public action
+	{
+		public:
+			compare_and_set_global_action(selector_type type) : action(type) {}
+			virtual void read(std::istream&);
+			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
+			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
+		private:
+			data_type m_dtype;
+			std::string m_name;
+			std::unique_ptr<data> m_expected;
+			std::unique_ptr<data> m_data;
+			std::string m_result;
+			int m_resultSlot = -1;
+
+			static action_register<compare_and_set_global_action> reg;
+	};
+
 	class set_local_action : public action
 	{
 		public:
@@ -462,9 +634,11 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual bool async_safe() { return true; }
 		private:
 			data_type m_dtype;
 			std::string m_name;
+			int m_slot = -1;
 			std::unique_ptr<data> m_data;
 
 			static action_register<set_local_action> reg;
@@ -478,12 +652,19 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			virtual void read(std::istream&);
 			virtual void execute(selector_type, VkHandle, global_context&, local_context&, rule&);
 			virtual std::ostream& print(std::ostream&);
+			virtual void migrate(action& previous);
+			virtual void retire();
 		private:
 			std::unique_ptr<action> m_action;
 			unsigned long m_delay;
+			bool m_frames = false;
 
+			// guards the state below against executions on other threads and migrate() of a reload
+			std::mutex m_mutex;
 			bool m_done = false;
-			std::jthread m_thread;
+			timer_scheduler* m_scheduler = nullptr;
+			timer_scheduler::timer_id m_timer = 0;
+			void start();
 
 			instance* m_instance;
 			device* m_device;
@@ -505,7 +686,7 @@ CmdDraw: on device 0xabcdef from command buffer 0xabcdef with pipeline 0xabcdef
 			std::unique_ptr<data> m_function;
 			std::vector<std::unique_ptr<data>> m_default_arguments{};
 
-			void register_function(global_context& global);
+			void register_function(global_context& global, std::shared_ptr<ruleset> owner);
 
 			static action_register<define_function_action> reg;
 	};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "worker_pool.hpp"
+
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace CheekyLayer::rules
+{
+	/**
+	 * Bounded queue for actions wrapped in async(), executed on the interactive lane of a worker_pool.
+	 * Tasks with the same key (e.g. the name of the file descriptor they write to) form a strand:
+	 * only one of them is in the pool at a time, so they run in submission order.
+	 * Tasks are submitted for an owner (the device they use, nullptr for the instance),
+	 * whose tasks can be cancelled before the owner is destroyed.
+	 */
+	class async_executor
+	{
+		public:
+			using task = std::function<void()>;
+
+			struct statistics
+			{
+				size_t depth;
+				size_t maxDepth;
+				uint64_t submitted;
+				uint64_t executed;
+				uint64_t dropped;
+			};
+
+			~async_executor();
+
+			void configure(size_t workers, size_t capacity);
+			bool submit(const std::string& key, task t, const void* owner = nullptr);
+			/** Drops the queued tasks of the owner and waits for its running ones, further submits for it fail meanwhile. */
+			void cancel(const void* owner);
+			statistics stats();
+			void shutdown();
+		private:
+			struct entry
+			{
+				task t;
+				const void* owner;
+			};
+
+			/** Runs the queued tasks of a strand until it is empty, they are dropped once the pool is stopped. */
+			void drain(const std::string& key, std::stop_token stop);
+			/** Runs any one of the unkeyed tasks, there might be none left if they were cancelled. */
+			void run_unkeyed(std::stop_token stop);
+			void execute(const entry& e);
+
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
+			// strands with a task in the pool, the currently running task is already removed from the queue
+			std::unordered_map<std::string, std::deque<entry>> m_strands;
+			// every one of them has a task in the pool that takes one
+			std::deque<entry> m_unkeyed;
+			std::unordered_map<const void*, size_t> m_running;
+			std::unordered_set<const void*> m_cancelling;
+			size_t m_capacity = 1024;
+			bool m_shutdown = false;
+
+			size_t m_depth = 0;
+			size_t m_maxDepth = 0;
+			uint64_t m_submitted = 0;
+			uint64_t m_executed = 0;
+			uint64_t m_dropped = 0;
+
+			// declared last, so its workers are joined before the strands they drain are destroyed
+			worker_pool m_pool;
+	};
+}
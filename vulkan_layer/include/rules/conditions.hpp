@@ -117,6 +117,7 @@ namespace CheekyLayer::rules::conditions
 			virtual void read(std::istream&);
 			virtual bool test(selector_type, VkHandle, global_context&, local_context&);
 			virtual std::ostream& print(std::ostream&);
+			virtual const std::string* custom_tag() const { return &m_tag; }
 		private:
 			std::string m_tag;
 
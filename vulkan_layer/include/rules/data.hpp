@@ -1,7 +1,9 @@
 #pragma once
 
+#include <optional>
 #include <vector>
 
+#include "reflection/reflectionparser.hpp"
 #include "rules.hpp"
 #include "rules/execution_env.hpp"
 
@@ -49,6 +51,8 @@ namespace CheekyLayer::rules::datas
 			virtual std::ostream& print(std::ostream&);
 		private:
 			std::string m_path;
+			reflection::compiled_path m_compiled;
+			std::optional<reflection::compiled_path> m_compiledDraw;
 
 			static data_register<vkstruct_data> reg;
 	};
@@ -103,6 +107,46 @@ namespace CheekyLayer::rules::datas
 			static data_register<convert_data> reg;
 	};
 
+	class async_stats_data : public data
+	{
+		public:
+			async_stats_data(selector_type type) : data(type) {}
+			virtual void read(std::istream&);
+			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
+			virtual bool supports(selector_type, data_type);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			std::string m_stat;
+
+			static data_register<async_stats_data> reg;
+	};
+
+	class worker_stats_data : public data
+	{
+		public:
+			worker_stats_data(selector_type type) : data(type) {}
+			virtual void read(std::istream&);
+			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
+			virtual bool supports(selector_type, data_type);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			std::string m_stat;
+
+			static data_register<worker_stats_data> reg;
+	};
+
+	class profile_report_data : public data
+	{
+		public:
+			profile_report_data(selector_type type) : data(type) {}
+			virtual void read(std::istream&);
+			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
+			virtual bool supports(selector_type, data_type);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			static data_register<profile_report_data> reg;
+	};
+
 	class string_clean_data : public data
 	{
 		public:
@@ -151,7 +195,7 @@ namespace CheekyLayer::rules::datas
 		SInt8, SInt16, SInt32, SInt64,
 		UInt8, UInt16, UInt32, UInt64,
 
-		Float, Double,
+		Half, Float, Double,
 
 		Array
 	};
@@ -166,8 +210,13 @@ namespace CheekyLayer::rules::datas
 			virtual void read(std::istream&);
 			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
 			virtual bool supports(selector_type, data_type);
+			virtual void stream(selector_type, VkHandle, global_context&, local_context&, rule&, const element_callback&);
+			virtual std::optional<size_t> count_hint();
 			virtual std::ostream& print(std::ostream&);
 		private:
+			/** Start of the elements in the raw data, throws if it is too small to contain all of them. */
+			const uint8_t* elements(std::span<const uint8_t> v);
+
 			raw_type m_rawType;
 			size_t m_offset;
 			int m_count = -1;
@@ -186,6 +235,7 @@ namespace CheekyLayer::rules::datas
 			virtual std::ostream& print(std::ostream&);
 		private:
 			raw_type m_rawType;
+			bool m_array = false;
 			std::unique_ptr<data> m_src;
 
 			static data_register<pack_data> reg;
@@ -222,6 +272,8 @@ namespace CheekyLayer::rules::datas
 			virtual void read(std::istream&);
 			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
 			virtual bool supports(selector_type, data_type);
+			virtual void stream(selector_type, VkHandle, global_context&, local_context&, rule&, const element_callback&);
+			virtual std::optional<size_t> count_hint();
 			virtual std::ostream& print(std::ostream&);
 		private:
 			std::unique_ptr<data> m_src;
@@ -270,10 +322,26 @@ namespace CheekyLayer::rules::datas
 			virtual std::ostream& print(std::ostream&);
 		private:
 			std::string m_name;
+			/** Looked up once the variable exists, so later reads skip the name lookup. */
+			std::atomic<const variable_store::variable*> m_variable = nullptr;
 
 			static data_register<global_data> reg;
 	};
 
+	class global_version_data : public data
+	{
+		public:
+			global_version_data(selector_type type) : data(type) {}
+			virtual void read(std::istream&);
+			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&);
+			virtual bool supports(selector_type, data_type);
+			virtual std::ostream& print(std::ostream&);
+		private:
+			std::string m_name;
+
+			static data_register<global_version_data> reg;
+	};
+
 	class local_data : public data
 	{
 		public:
@@ -284,6 +352,7 @@ namespace CheekyLayer::rules::datas
 			virtual std::ostream& print(std::ostream&);
 		private:
 			std::string m_name;
+			int m_slot = -1;
 
 			static data_register<local_data> reg;
 	};
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <set>
+#include <shared_mutex>
+#include <span>
 #include <spdlog/logger.h>
 #include <sys/socket.h>
 #include <vulkan/vulkan.h>
@@ -14,13 +17,20 @@
 #include <thread>
 #include <variant>
 #include <vulkan/vulkan_core.h>
+#include "rules/async.hpp"
 #include "rules/ipc.hpp"
+#include "rules/scheduler.hpp"
 #include "reflection/custom_structs.hpp"
 
+namespace CheekyLayer::reflection {
+	struct compiled_assignment;
+}
+
 namespace CheekyLayer {
 	struct instance;
 	struct device;
 	struct command_buffer_state;
+	struct submit_extension;
 }
 
 struct CommandBufferState;
@@ -34,9 +44,29 @@ namespace CheekyLayer::rules
 
 	enum selector_type : int;
 	struct local_context;
+	struct ruleset;
 
 	struct data_list;
-	using data_value = std::variant<std::string, std::vector<uint8_t>, VkHandle, double, data_list>;
+
+	/**
+	 * Raw bytes that are not owned by the value, e.g. a receive buffer.
+	 * If `owner` is set it keeps the memory alive, otherwise the view is only valid
+	 * during the hook that created it and has to be materialized before it escapes.
+	 */
+	struct raw_view
+	{
+		std::span<const uint8_t> bytes;
+		std::shared_ptr<const void> owner;
+	};
+
+	using data_value = std::variant<std::string, std::vector<uint8_t>, VkHandle, double, data_list, raw_view>;
+
+	/** True for both owned raw data and raw views. */
+	bool is_raw(const data_value& value);
+	/** The bytes of owned raw data or a raw view, throws std::bad_variant_access for other values. */
+	std::span<const uint8_t> raw_bytes(const data_value& value);
+	/** Copies raw views (also inside of lists) into owned vectors. With `keepOwned` views that have an owner are kept. */
+	data_value materialize(data_value value, bool keepOwned = false);
 
 	enum data_type : int;
 	struct user_function
@@ -44,6 +74,50 @@ namespace CheekyLayer::rules
 		class data* data;
 		std::vector<data_type> arguments;
 		std::vector<class data*> default_arguments;
+		std::shared_ptr<ruleset> owner;
+	};
+
+	struct global_value;
+
+	/**
+	 * The global variables, shared by all threads executing rules.
+	 * Values are immutable and replaced atomically, so readers keep a consistent value even if it
+	 * is replaced while they use it. Reads are not lock-free: the variable is looked up under a
+	 * shared lock that only the creation of a variable takes exclusively, and std::atomic<std::shared_ptr>
+	 * guards every load and store with a lock bit in libstdc++, so accesses to the same variable
+	 * briefly wait for each other while the pointer is copied. Every write increments the
+	 * version of the variable and compare_and_set() only writes if the version did not change.
+	 * Variables are never removed, so pointers returned by find() stay valid.
+	 */
+	class variable_store
+	{
+		public:
+			using snapshot = std::shared_ptr<const global_value>;
+
+			class variable
+			{
+				public:
+					[[nodiscard]] snapshot load() const { return m_value.load(); }
+				private:
+					std::atomic<snapshot> m_value;
+
+					friend class variable_store;
+			};
+
+			/** Null if the variable was never set. */
+			const variable* find(const std::string& name) const;
+			/** Null if the variable was never set. */
+			snapshot get(const std::string& name) const;
+			/** Returns the new version of the variable. */
+			uint64_t set(const std::string& name, data_value value);
+			/** Only sets the variable if its version is still `expected`, 0 is the version of unset variables. */
+			bool compare_and_set(const std::string& name, uint64_t expected, data_value value);
+			std::vector<std::string> names() const;
+		private:
+			variable& get_or_create(const std::string& name);
+
+			mutable std::shared_mutex m_mutex;
+			std::unordered_map<std::string, std::unique_ptr<variable>> m_variables;
 	};
 
 	class global_context
@@ -52,28 +126,15 @@ namespace CheekyLayer::rules
 			std::map<VkHandle, std::set<std::string>> marks;
 			std::map<VkHandle, std::string> hashes;
 
-			std::multimap<VkCommandBuffer, std::function<void(local_context&)>> on_EndCommandBuffer;
-			std::multimap<VkCommandBuffer, std::function<void(local_context&)>> on_QueueSubmit;
-			std::multimap<VkCommandBuffer, std::function<void(local_context&)>> on_EndRenderPass;
-
-			void onEndCommandBuffer(VkCommandBuffer commandBuffer, std::function<void(local_context&)> function)
-			{
-				on_EndCommandBuffer.emplace(commandBuffer, function);
-			}
-			void onQueueSubmit(VkCommandBuffer commandBuffer, std::function<void(local_context&)> function)
-			{
-				on_QueueSubmit.emplace(commandBuffer, function);
-			}
-			void onEndRenderPass(VkCommandBuffer commandBuffer, std::function<void(local_context&)> function)
-			{
-				on_EndRenderPass.emplace(commandBuffer, function);
-			}
-
 			std::unordered_map<std::string, std::unique_ptr<ipc::file_descriptor>> fds;
-			std::vector<std::thread> threads;
 
-			std::unordered_map<std::string, data_value> global_variables;
+			variable_store global_variables;
 			std::unordered_map<std::string, user_function> user_functions;
+
+			async_executor async;
+			timer_scheduler timers;
+
+			bool profile_rules = false;
 	};
 
 	struct draw_info
@@ -98,6 +159,7 @@ namespace CheekyLayer::rules
 		uint8_t* buffer;
 		size_t size;
 		int extra = 0;
+		std::shared_ptr<const void> owner;
 	};
 
 	struct present_info
@@ -118,6 +180,22 @@ namespace CheekyLayer::rules
 		swapchain_info
 	>;
 
+	using variable_map = std::unordered_map<std::string, data_value>;
+
+	/**
+	 * A scope pushed by a function call. Arguments are stored by slot ("_1" is slot 0),
+	 * variables set inside the function shadow the caller's ones until the frame is popped.
+	 */
+	struct variable_frame
+	{
+		variable_frame* parent;
+		std::vector<data_value> arguments;
+		variable_map variables;
+	};
+
+	/** Returns the argument slot of names like "_1" or -1 for all other names. */
+	int variable_slot(const std::string& name);
+
 	struct calling_context
 	{
 		std::function<void(spdlog::logger&)> printVerbose;
@@ -127,7 +205,7 @@ namespace CheekyLayer::rules
 		command_buffer_state* commandBufferState;
 
 		bool canceled;
-		std::vector<std::string> overrides;
+		std::vector<const reflection::compiled_assignment*> overrides;
 		std::string customTag;
 		std::vector<std::function<void(VkHandle)>> creationCallbacks;
 
@@ -150,7 +228,7 @@ namespace CheekyLayer::rules
 		command_buffer_state* commandBufferState;
 
 		bool& canceled;
-		std::vector<std::string>& overrides;
+		std::vector<const reflection::compiled_assignment*>& overrides;
 		const std::string& customTag;
 		std::vector<std::function<void(VkHandle)>>& creationCallbacks;
 
@@ -161,5 +239,17 @@ namespace CheekyLayer::rules
 		std::unordered_map<std::string, data_value>& local_variables;
 
 		void*& customPointer;
+
+		variable_frame* frame = nullptr;
+		ruleset* currentRuleset = nullptr;
+		/** Only set in QueueSubmit callbacks, lets them add their work to the submit of the current command buffer. */
+		submit_extension* submit = nullptr;
+
+		/** Keeps the rules being executed alive for work that runs after the hook returned. */
+		std::shared_ptr<ruleset> keep_rules_alive() const;
+
+		const data_value* find_variable(const std::string& name, int slot) const;
+		void set_variable(const std::string& name, int slot, data_value value);
+		variable_map snapshot_variables() const;
 	};
 }
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <functional>
 #include <netinet/in.h>
+#include <span>
 #include <thread>
 #include <vector>
 #include <string>
@@ -24,7 +25,7 @@ namespace CheekyLayer::rules::ipc
 			virtual ~file_descriptor() = default;
 
 			virtual void close() = 0;
-			virtual size_t write(std::vector<uint8_t>&, int arg) = 0;
+			virtual size_t write(std::span<const uint8_t>, int arg) = 0;
 			std::string m_name;
 	};
 
@@ -33,7 +34,7 @@ namespace CheekyLayer::rules::ipc
 		public:
 			local_file(std::string filename);
 			virtual void close();
-			virtual size_t write(std::vector<uint8_t>&, int arg = 0);
+			virtual size_t write(std::span<const uint8_t>, int arg = 0);
 		protected:
 			std::unique_ptr<std::ofstream> m_stream;
 	};
@@ -51,7 +52,11 @@ namespace CheekyLayer::rules::ipc
 		Lines
 	};
 
-	void listen_helper(std::stop_token& stop, protocol_type protocol, int fd, std::function<void(uint8_t*, size_t)> handler);
+	/**
+	 * Receives messages from fd until it is closed or stop is requested.
+	 * The handler gets the owner of each message buffer, so rules can keep views of it instead of copying.
+	 */
+	void listen_helper(std::stop_token& stop, protocol_type protocol, int fd, std::function<void(std::shared_ptr<const void>, uint8_t*, size_t)> handler);
 
 	class socket : public file_descriptor
 	{
@@ -72,7 +77,7 @@ namespace CheekyLayer::rules::ipc
 				m_device = device;
 			}
 			virtual void close();
-			virtual size_t write(std::vector<uint8_t>&, int arg = 0);
+			virtual size_t write(std::span<const uint8_t>, int arg = 0);
 
 			static socket_type socket_type_from_string(std::string s);
 			static std::string socket_type_to_string(socket_type e);
@@ -89,7 +94,7 @@ namespace CheekyLayer::rules::ipc
 			protocol_type m_protocol;
 			std::jthread m_receiveThread;
 
-			size_t writeRaw(void* p, size_t size);
+			size_t writeRaw(const void* p, size_t size);
 			void receiveThread(std::stop_token stop);
 	};
 
@@ -112,7 +117,7 @@ namespace CheekyLayer::rules::ipc
 				m_device = device;
 			}
 			virtual void close();
-			virtual size_t write(std::vector<uint8_t>&, int client);
+			virtual size_t write(std::span<const uint8_t>, int client);
 		protected:
 			server_socket(socket_type type, std::string hostname, int port, protocol_type protocol);
 
@@ -125,7 +130,7 @@ namespace CheekyLayer::rules::ipc
 			std::jthread m_listenThread;
 			std::vector<std::jthread> m_clientThreads{};
 
-			size_t writeRaw(int client, void* p, size_t size);
+			size_t writeRaw(int client, const void* p, size_t size);
 			void receiveThread(std::stop_token stop, int fd, sockaddr_in addr);
 	};
 }
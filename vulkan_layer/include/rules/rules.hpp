@@ -2,12 +2,17 @@
 
 #include "execution_env.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <stdexcept>
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_set>
+#include <variant>
 
 #define BACKWARD_HAS_DW 1
 #include <backward.hpp>
@@ -62,6 +67,11 @@ namespace CheekyLayer::rules
 				out << "unkownCondition()";
 				return out;
 			};
+			/** The tag custom rules with this condition are indexed by, if any. */
+			virtual const std::string* custom_tag() const
+			{
+				return nullptr;
+			}
 		protected:
 			selector_type m_type;
 	};
@@ -110,6 +120,7 @@ namespace CheekyLayer::rules
 			bool test(selector_type, VkHandle, global_context&, local_context&);
 			std::ostream& print(std::ostream& out);
 			[[nodiscard]] selector_type get_type() const { return m_type; };
+			[[nodiscard]] const std::string* custom_tag() const;
 		private:
 			selector_type m_type;
 			std::vector<std::unique_ptr<selector_condition>> m_conditions;
@@ -131,6 +142,23 @@ namespace CheekyLayer::rules
 				out << "unkownAction()";
 				return out;
 			};
+			/** Async actions with the same key are executed in order, e.g. writes to the same file descriptor. */
+			virtual std::string async_key()
+			{
+				return "";
+			}
+			/**
+			 * True if the action can run on a worker thread after the Vulkan call that triggered it returned,
+			 * i.e. it neither records into the command buffer nor needs the hook specific information.
+			 */
+			virtual bool async_safe()
+			{
+				return false;
+			}
+			/** Called on reload with the identical action of the replaced ruleset to take over its state. */
+			virtual void migrate(action& previous) {}
+			/** Called when the ruleset is replaced, stops everything that keeps running on its own. */
+			virtual void retire() {}
 		protected:
 			selector_type m_type;
 	};
@@ -140,6 +168,19 @@ namespace CheekyLayer::rules
 		return std::make_unique<T>(stype);
 	}
 	std::unique_ptr<action> read_action(std::istream& in, selector_type type);
+	std::unique_ptr<action> make_async_action(std::unique_ptr<action> action, selector_type type);
+	/** True if `name` is a registered action that async() can execute. */
+	bool is_async_action(const std::string& name);
+
+	/** Makes read_action() on this thread wrap the given actions in async(), while the rules of an instance are parsed. */
+	class default_async_scope
+	{
+		public:
+			explicit default_async_scope(const std::unordered_set<std::string>& actions);
+			~default_async_scope();
+		private:
+			const std::unordered_set<std::string>* m_previous;
+	};
 
 	struct action_factory
 	{
@@ -182,14 +223,64 @@ namespace CheekyLayer::rules
 	std::string to_string(data_type);
 	data_type data_type_from_string(const std::string&);
 
+	/**
+	 * Homogeneous numbers, e.g. unpacked from raw data, kept in their original type
+	 * instead of one boxed data_value per element.
+	 */
+	using number_array = std::variant<
+		std::vector<int8_t>, std::vector<int16_t>, std::vector<int32_t>, std::vector<int64_t>,
+		std::vector<uint8_t>, std::vector<uint16_t>, std::vector<uint32_t>, std::vector<uint64_t>,
+		std::vector<float>, std::vector<double>
+	>;
+
 	struct data_list
 	{
 		data_list() = default;
 		data_list(const std::initializer_list<data_value>&& v) : values(v) {}
+		data_list(number_array numbers) : numbers(std::move(numbers)) {}
 
+		/** Boxed elements, empty while the list is stored in `numbers`. */
 		std::vector<data_value> values;
+		std::optional<number_array> numbers;
+
+		[[nodiscard]] size_t size() const;
+		[[nodiscard]] data_value at(size_t index) const;
+		[[nodiscard]] double number_at(size_t index) const;
+		/** Converts typed numbers into boxed values, for code that needs to work on `values`. */
+		std::vector<data_value>& boxed();
+
+		/** Calls f(element, index) for all elements, typed numbers are passed in one reused data_value. */
+		template<typename F>
+		void for_each(F&& f)
+		{
+			if(numbers)
+			{
+				std::visit([&f](const auto& v){
+					data_value element = 0.0;
+					for(size_t i=0; i<v.size(); i++)
+					{
+						element = static_cast<double>(v[i]);
+						f(element, i);
+					}
+				}, *numbers);
+			}
+			else
+			{
+				for(size_t i=0; i<values.size(); i++)
+					f(values[i], i);
+			}
+		}
 	};
 
+	struct global_value
+	{
+		data_value value;
+		uint64_t version;
+	};
+
+	/** Receives the elements of a streamed list together with their index. */
+	using element_callback = std::function<void(data_value&, size_t)>;
+
 	class data
 	{
 		public:
@@ -199,6 +290,17 @@ namespace CheekyLayer::rules
 			virtual void read(std::istream&) = 0;
 			virtual data_value get(selector_type, data_type, VkHandle, global_context&, local_context&, rule&) = 0;
 			virtual bool supports(selector_type, data_type) = 0;
+			/**
+			 * Passes the elements of the List this data returns to f one after another.
+			 * Data that can produce elements one by one overrides this, so chains like
+			 * reduce(map(unpack(...))) run in a single pass without intermediate lists.
+			 */
+			virtual void stream(selector_type, VkHandle, global_context&, local_context&, rule&, const element_callback& f);
+			/** Number of elements stream() passes, if it is known without evaluating the data. */
+			virtual std::optional<size_t> count_hint()
+			{
+				return std::nullopt;
+			}
 			virtual std::ostream& print(std::ostream& out)
 			{
 				out << "unkownData()";
@@ -244,15 +346,34 @@ namespace CheekyLayer::rules
     	}
 	};
 
+	struct rule_profile
+	{
+		std::atomic<uint64_t> invocations = 0;
+		std::atomic<uint64_t> passed = 0;
+		std::atomic<uint64_t> executed = 0;
+		std::atomic<uint64_t> totalNanoseconds = 0;
+		std::atomic<uint64_t> maxNanoseconds = 0;
+	};
+
 	class rule
 	{
 		public:
 			void execute(selector_type type, VkHandle handle, global_context& global, local_context& local);
+			void execute_profiled(selector_type type, VkHandle handle, global_context& global, local_context& local);
 			std::ostream& print(std::ostream& out);
+			[[nodiscard]] const rule_profile& profile() const {
+				return m_profile;
+			}
+			void reset_profile();
+			void migrate(rule& previous);
+			void retire();
 			void disable();
 			[[nodiscard]] selector_type get_type() const {
 				return m_selector->get_type();
 			}
+			[[nodiscard]] const std::string* custom_tag() const {
+				return m_selector->custom_tag();
+			}
 			[[nodiscard]] bool is_enabled() const {
 				return !m_disabled;
 			}
@@ -260,13 +381,16 @@ namespace CheekyLayer::rules
 			std::unique_ptr<selector> m_selector;
 			std::unique_ptr<action> m_action;
 			bool m_disabled = false;
+			rule_profile m_profile;
 			friend std::istream& operator>>(std::istream&, rule&);
 	};
 
 	std::istream& operator>>(std::istream&, rule&);
 	std::istream& operator>>(std::istream&, selector&);
 
-	void execute_rules(std::vector<std::unique_ptr<rule>>& rules, selector_type type, VkHandle handle, global_context& global, local_context& local);
+	void execute_rules(ruleset& rules, selector_type type, VkHandle handle, global_context& global, local_context& local);
+	std::string profile_report(ruleset& rules);
+	void profile_reset(ruleset& rules);
 
 	inline void (*rule_disable_callback)(rule* rule);
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "rules/rules.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <spdlog/logger.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace CheekyLayer::rules
+{
+	/**
+	 * All rules parsed from one rule file.
+	 * Deferred work (async(), on(), image loading threads, user functions) keeps a reference,
+	 * so a replaced ruleset stays alive until the last of it finished.
+	 */
+	struct ruleset : std::enable_shared_from_this<ruleset>
+	{
+		std::vector<std::unique_ptr<rule>> rules;
+		uint64_t generation = 0;
+
+		/** Indexes the custom rules by their custom(tag) condition, must be called after all rules were added. */
+		void build_index();
+		/** The custom rules that can match the tag (rules without a tag match all of them) in file order. */
+		const std::vector<rule*>& custom_rules(const std::string& tag) const;
+
+		/** Takes over the state (every() counters, running thread()s, disabled rules) of identical rules. */
+		void migrate_from(ruleset& previous);
+		/** Stops everything that would otherwise keep running after the ruleset was replaced. */
+		void retire();
+		private:
+			std::unordered_map<std::string, std::vector<rule*>> m_customByTag;
+			std::vector<rule*> m_customUntagged;
+	};
+
+	/**
+	 * Parses the rule file. On errors the rules up to the error are returned
+	 * and `complete` is false. The actions in `asyncActions` are wrapped in async().
+	 */
+	struct parsed_ruleset
+	{
+		std::shared_ptr<ruleset> rules;
+		bool complete;
+	};
+	parsed_ruleset parse_ruleset(const std::filesystem::path& file, spdlog::logger& logger, const std::unordered_set<std::string>& asyncActions = {});
+
+	/**
+	 * Holds the active ruleset. Hooks read it without locks by entering a reader, which only
+	 * increments the counter of the current epoch. publish() swaps the pointer atomically and
+	 * then waits until no reader of an older epoch is left before it drops the old ruleset.
+	 */
+	class ruleset_holder
+	{
+		public:
+			class reader
+			{
+				public:
+					reader(ruleset_holder& holder);
+					~reader();
+					reader(const reader&) = delete;
+					reader& operator=(const reader&) = delete;
+
+					ruleset* get() const { return m_ruleset; }
+					ruleset* operator->() const { return m_ruleset; }
+					ruleset& operator*() const { return *m_ruleset; }
+				private:
+					ruleset_holder& m_holder;
+					size_t m_parity;
+					ruleset* m_ruleset;
+			};
+
+			ruleset_holder();
+			/** Only valid while no other thread uses either holder. */
+			ruleset_holder& operator=(ruleset_holder&& other);
+
+			reader read() { return reader(*this); }
+			/** Replaces the active ruleset. Blocks until all readers of the old one left, never call it from a hook. */
+			std::shared_ptr<ruleset> publish(std::shared_ptr<ruleset> next);
+			std::shared_ptr<ruleset> current();
+		private:
+			void synchronize();
+
+			std::atomic<ruleset*> m_current = nullptr;
+			std::atomic<uint64_t> m_epoch = 0;
+			std::array<std::atomic<uint64_t>, 2> m_readers{};
+
+			std::mutex m_writeLock;
+			std::shared_ptr<ruleset> m_owner;
+	};
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace CheekyLayer::rules
+{
+	/**
+	 * Runs all periodic tasks (e.g. thread()) of an instance on a single thread.
+	 * Time based timers live in a hashed timer wheel with millisecond ticks, so all timers due
+	 * in the same tick share one wakeup and the thread sleeps until the next occupied tick.
+	 * Deadlines advance by the period instead of from the time the task finished, so a slow
+	 * task does not make the timer drift. Frame based timers are counted by frame(), which is
+	 * called for every present.
+	 */
+	class timer_scheduler
+	{
+		public:
+			using task = std::function<void()>;
+			using timer_id = uint64_t;
+
+			~timer_scheduler();
+
+			/** The first run happens right away, then every `period`. */
+			timer_id every(std::chrono::milliseconds period, task t);
+			/** Runs the task after every `frames` presented frames. */
+			timer_id every_frames(uint64_t frames, task t);
+			/** When this returns the task is not running anymore, unless it is called from the task itself. */
+			void cancel(timer_id id);
+
+			void frame();
+			void shutdown();
+		private:
+			using clock = std::chrono::steady_clock;
+			static constexpr std::chrono::milliseconds tick{1};
+			static constexpr size_t wheel_size = 512;
+
+			struct timer
+			{
+				timer_id id;
+				uint64_t due;
+				uint64_t period;
+				bool frames;
+				task t;
+			};
+
+			void start();
+			void run(std::stop_token stop);
+			uint64_t now_tick() const;
+
+			void insert(timer t);
+			void collect_due(std::vector<timer>& due);
+			void reschedule(timer t);
+			std::optional<uint64_t> next_due() const;
+			void update_next_frame();
+
+			std::mutex m_mutex;
+			std::condition_variable_any m_wakeup;
+			std::condition_variable m_finished;
+			bool m_changed = false;
+			bool m_shutdown = false;
+			timer_id m_next = 1;
+
+			const clock::time_point m_epoch = clock::now();
+			std::array<std::vector<timer>, wheel_size> m_wheel;
+			size_t m_timerCount = 0;
+			uint64_t m_tick = 0;
+
+			std::vector<timer> m_frameTimers;
+			std::atomic<uint64_t> m_frame = 0;
+			std::atomic<uint64_t> m_nextFrame = std::numeric_limits<uint64_t>::max();
+
+			std::unordered_set<timer_id> m_running;
+			std::unordered_set<timer_id> m_cancelled;
+
+			std::jthread m_thread;
+	};
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+struct device;
+
+/**
+ * Persistently mapped host visible buffer of a device that staging memory for uploads and
+ * readbacks is suballocated from, so they do not need their own buffer and memory allocation.
+ * Memory is handed out in allocation order and reused once all older allocations were released
+ * (and their fences signaled). Requests that do not fit right now get a dedicated buffer instead.
+ */
+class staging_ring {
+    public:
+        struct allocation {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            uint8_t* data;
+            uint64_t id;
+            /** Only set for dedicated allocations. */
+            VkDeviceMemory memory;
+        };
+
+        struct statistics {
+            VkDeviceSize capacity;
+            VkDeviceSize used;
+            uint64_t allocations;
+            uint64_t dedicated;
+        };
+
+        staging_ring() = default;
+        ~staging_ring();
+
+        staging_ring(const staging_ring&) = delete;
+        staging_ring& operator=(const staging_ring&) = delete;
+
+        /** The ring buffer itself is only created by the first allocation. */
+        void configure(device* device, VkDeviceSize capacity);
+        allocation allocate(VkDeviceSize size);
+        /**
+         * The memory is reused once the fence signaled, the ring takes ownership of the fence and destroys it.
+         * Without a fence the memory must not be in use by the GPU anymore.
+         */
+        void release(const allocation& a, VkFence fence = VK_NULL_HANDLE);
+        statistics stats();
+        /** Frees all memory, must only be called when nothing is in use by the GPU anymore. */
+        void destroy();
+    private:
+        struct block {
+            uint64_t id;
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            bool released;
+            VkFence fence;
+        };
+        struct dedicated_block {
+            VkBuffer buffer;
+            VkDeviceMemory memory;
+            VkFence fence;
+        };
+
+        bool create();
+        bool suballocate(VkDeviceSize size, VkDeviceSize& offset);
+        allocation allocate_dedicated(VkDeviceSize size);
+        bool signaled(VkFence fence);
+        void reclaim();
+
+        std::mutex m_mutex;
+        device* m_device = nullptr;
+        VkDeviceSize m_capacity = 0;
+        VkDeviceSize m_alignment = 16;
+        bool m_failed = false;
+
+        VkBuffer m_buffer = VK_NULL_HANDLE;
+        VkDeviceMemory m_memory = VK_NULL_HANDLE;
+        uint8_t* m_data = nullptr;
+
+        std::deque<block> m_blocks;
+        VkDeviceSize m_head = 0;
+        std::vector<dedicated_block> m_pendingDedicated;
+
+        uint64_t m_next = 1;
+        uint64_t m_allocations = 0;
+        uint64_t m_dedicated = 0;
+};
+
+}
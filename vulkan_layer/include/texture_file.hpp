@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+/**
+ * A DDS or KTX2 file with precompressed mip levels, mapped into memory so the levels can be copied
+ * straight into staging memory. Only the first array layer (or cube face) is used, and KTX2 files
+ * must not use supercompression. Throws std::runtime_error if the file cannot be read or is invalid.
+ */
+class texture_file {
+    public:
+        explicit texture_file(const std::filesystem::path& path);
+        ~texture_file();
+
+        texture_file(const texture_file&) = delete;
+        texture_file& operator=(const texture_file&) = delete;
+
+        static bool is_texture_file(const std::filesystem::path& path);
+
+        /** Throws if format or extent differ from the image, or if the file has no mip levels it could use. */
+        void validate(const VkImageCreateInfo& info) const;
+        /** Mip levels that are uploaded into an image with `mipLevels` levels. */
+        uint32_t levels_for(uint32_t mipLevels) const { return std::min(mipLevels, static_cast<uint32_t>(m_levels.size())); }
+
+        VkFormat format() const { return m_format; }
+        VkExtent3D extent() const { return m_extent; }
+        VkExtent3D extent(uint32_t level) const;
+        const std::vector<std::span<const uint8_t>>& levels() const { return m_levels; }
+    private:
+        void parse_dds();
+        void parse_ktx2();
+        VkDeviceSize level_size(uint32_t level) const;
+        std::span<const uint8_t> range(uint64_t offset, uint64_t size) const;
+
+        std::filesystem::path m_path;
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+
+        VkFormat m_format = VK_FORMAT_UNDEFINED;
+        VkExtent3D m_extent{};
+        std::vector<std::span<const uint8_t>> m_levels;
+};
+
+}
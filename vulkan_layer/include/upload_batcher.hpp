@@ -0,0 +1,130 @@
+#pragma once
+
+#include "staging_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace CheekyLayer {
+
+struct device;
+struct submit_extension;
+struct submit_fence;
+
+/**
+ * Records the image uploads of a device that arrive within a short window into one command buffer
+ * and submits it to the transfer queue with a fence, instead of waiting for the queue to be idle
+ * around every single upload. Command buffers and fences are recycled once their fence signaled,
+ * which is also when the staging memory of the uploads is released.
+ * If the transfer queue is a dedicated one of another family, the images are released to the
+ * application's graphics queue, which acquires them in a second command buffer. The application's
+ * graphics queue may only be used on the application's own thread, so such batches are started and
+ * acquired through the application's submits: the copies wait for a semaphore signaled after its
+ * work, and the acquire goes in front of the first submit after they finished.
+ */
+class upload_batcher {
+    public:
+        struct upload {
+            VkImage image;
+            VkImageSubresourceRange range;
+            /** Offsets are relative to the start of the staging buffer, not the allocation. */
+            std::vector<VkBufferImageCopy> copies;
+            staging_ring::allocation staging;
+            /** Called with true once the copy finished on the GPU, with false if it was never submitted. */
+            std::function<void(bool)> done;
+        };
+
+        struct statistics {
+            uint64_t uploads;
+            uint64_t batches;
+            uint64_t superseded;
+            size_t maxBatch;
+            size_t inFlight;
+        };
+
+        upload_batcher() = default;
+        ~upload_batcher();
+
+        upload_batcher(const upload_batcher&) = delete;
+        upload_batcher& operator=(const upload_batcher&) = delete;
+
+        void configure(device* device, std::chrono::microseconds window);
+        void submit(upload u);
+        /** Must be called for every application submit, adds the starts and acquires of the batches handed over to its queue. */
+        void submitting(VkQueue queue, submit_extension& submit);
+        statistics stats();
+        /** Fails all pending uploads and waits for the submitted ones. */
+        void shutdown();
+    private:
+        struct batch {
+            VkCommandBuffer commandBuffer;
+            VkFence fence;
+            std::vector<upload> uploads;
+            // only for dedicated transfer queues
+            VkCommandBuffer acquireBuffer = VK_NULL_HANDLE;
+            // signaled by the copies for the acquire
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            // signaled by the graphics queue for the copies, so they do not overwrite images it still uses
+            VkSemaphore graphicsSemaphore = VK_NULL_HANDLE;
+            // the application's submit the images were acquired in, nullptr if it finished already
+            std::shared_ptr<submit_fence> acquireFence;
+            // never (completely) submitted, its semaphores may be signaled without anyone waiting for them
+            bool failed = false;
+        };
+
+        void run(std::stop_token stop);
+        void flush(std::vector<upload> uploads);
+        VkResult submit(batch& b);
+        void start(submit_extension& submit);
+        void acquire_finished(submit_extension& submit);
+        void submitted(VkResult result, std::shared_ptr<submit_fence> fence);
+        /** Must be called with m_submitMutex held after moving batches between its queues. */
+        void update_counts();
+        void record(VkCommandBuffer commandBuffer, const std::vector<upload>& uploads, bool handover);
+        void record_acquire(VkCommandBuffer commandBuffer, const std::vector<upload>& uploads);
+        bool acquire(batch& b, bool handover);
+        /** Finishes the batches whose fence signaled, or all of them if `wait` is set. */
+        void retire(bool wait);
+        void finish(upload& u, bool success);
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_cv;
+        std::vector<upload> m_pending;
+        bool m_shutdown = false;
+        std::jthread m_thread;
+
+        device* m_device = nullptr;
+        std::chrono::microseconds m_window{2000};
+
+        // batches waiting for submitting() to start them, or to acquire them once their copies finished
+        std::deque<batch> m_recorded;
+        std::deque<batch> m_copying;
+        // batches that are part of the application's submit that is going on right now
+        std::deque<batch> m_starting;
+        std::deque<batch> m_acquiring;
+        // batches that were submitted completely or failed
+        std::deque<batch> m_inFlight;
+        std::mutex m_submitMutex;
+        std::atomic<size_t> m_handoverCount = 0;
+
+        // only used by the batching thread (and shutdown() after it was joined)
+        std::vector<batch> m_free;
+
+        uint64_t m_uploads = 0;
+        uint64_t m_batches = 0;
+        uint64_t m_superseded = 0;
+        size_t m_maxBatch = 0;
+        std::atomic<size_t> m_inFlightCount = 0;
+};
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace CheekyLayer {
+
+/**
+ * Shared worker threads of a device for long running actions (image loading, framebuffer dumps),
+ * the instance's async_executor runs async() actions on one of its own.
+ * Workers always take the task from the most important non-empty lane. Only background tasks
+ * (preloads) are dropped when their lane is full: interactive loads are needed for correct
+ * output, and dumps already recorded commands writing into their staging buffer.
+ */
+class worker_pool {
+    public:
+        enum class lane : size_t {
+            Interactive,
+            Background,
+            Dump,
+        };
+        static constexpr size_t lane_count = 3;
+
+        /**
+         * Tasks should check the token in loops, it is requested when the device is destroyed.
+         * Tasks still queued at that point are called with an already stopped token and should
+         * only release what they own.
+         */
+        using task = std::function<void(std::stop_token)>;
+
+        struct statistics {
+            std::array<size_t, lane_count> depth;
+            size_t maxDepth;
+            uint64_t submitted;
+            uint64_t executed;
+            uint64_t dropped;
+            uint64_t cancelled;
+        };
+
+        worker_pool() = default;
+        ~worker_pool();
+
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        void configure(size_t workers, size_t capacity);
+        bool submit(lane l, task t);
+        /** Share of the hardware threads of each worker, for tasks that split their work into threads of their own. */
+        unsigned int threads_per_worker();
+        statistics stats();
+        /** Asks running tasks to stop, waits for them and then cancels the queued ones. */
+        void shutdown();
+    private:
+        void start();
+        void work(std::stop_token stop);
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_cv;
+        std::array<std::deque<task>, lane_count> m_lanes;
+        std::vector<std::jthread> m_workers;
+        size_t m_workerCount = 4;
+        size_t m_capacity = 256;
+        bool m_shutdown = false;
+
+        size_t m_maxDepth = 0;
+        uint64_t m_submitted = 0;
+        uint64_t m_executed = 0;
+        uint64_t m_dropped = 0;
+        uint64_t m_cancelled = 0;
+};
+
+}
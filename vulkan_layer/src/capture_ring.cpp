@@ -0,0 +1,117 @@
+#include "capture_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CheekyLayer {
+
+namespace {
+    constexpr uint64_t page_size = 4096;
+
+    constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // the header fields shared with readers are plain integers, so tools in other languages can map the same layout
+    static_assert(std::atomic_ref<uint64_t>::is_always_lock_free);
+    static_assert(sizeof(capture_ring::frame_header) % 8 == 0);
+}
+
+capture_ring::capture_ring(const std::filesystem::path& path, uint32_t slotCount, uint64_t slotCapacity) : m_path(path) {
+    slotCount = std::max(slotCount, 1u);
+    // frame data starts 64 byte aligned, and every slot on its own pages
+    uint64_t slotStride = align_up(align_up(sizeof(frame_header), 64) + slotCapacity, page_size);
+    m_size = page_size + slotStride * slotCount;
+
+    // readers still attached to a previous ring keep their mapping of the old file
+    ::unlink(path.c_str());
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if(fd < 0)
+        throw std::runtime_error("cannot create capture ring "+path.string()+": "+std::strerror(errno));
+    if(::ftruncate(fd, m_size) != 0) {
+        int error = errno;
+        ::close(fd);
+        ::unlink(path.c_str());
+        throw std::runtime_error("cannot resize capture ring "+path.string()+": "+std::strerror(error));
+    }
+    struct stat st;
+    if(::fstat(fd, &st) == 0)
+        m_inode = st.st_ino;
+    void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        ::unlink(path.c_str());
+        throw std::runtime_error("cannot map capture ring "+path.string()+": "+std::strerror(errno));
+    }
+    m_data = static_cast<uint8_t*>(data);
+
+    // the file is zero filled, so all sequences are 0 and no frame is valid until it was written
+    m_header = reinterpret_cast<ring_header*>(m_data);
+    m_header->version = version;
+    m_header->slotCount = slotCount;
+    m_header->slotStride = slotStride;
+    m_header->slotCapacity = slotStride - align_up(sizeof(frame_header), 64);
+    m_header->dataOffset = page_size;
+    std::atomic_ref<uint64_t>(m_header->published).store(0, std::memory_order_relaxed);
+    // readers check the magic last, so it is only visible once the rest of the header is
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_header->magic, magic, sizeof(magic));
+}
+
+capture_ring::~capture_ring() {
+    if(!m_data)
+        return;
+    std::atomic_ref<uint64_t>(m_header->closed).store(1, std::memory_order_release);
+    ::munmap(m_data, m_size);
+
+    // the path might belong to the ring that replaced this one already
+    struct stat st;
+    if(::stat(m_path.c_str(), &st) == 0 && st.st_ino == m_inode)
+        ::unlink(m_path.c_str());
+}
+
+capture_ring::frame_header& capture_ring::slot(uint64_t index) {
+    return *reinterpret_cast<frame_header*>(m_data + m_header->dataOffset + (index % m_header->slotCount) * m_header->slotStride);
+}
+
+bool capture_ring::publish(const frame_info& info, const uint8_t* data, uint64_t size) {
+    std::unique_lock lock(m_mutex);
+    if(size > m_header->slotCapacity) {
+        m_oversized++;
+        return false;
+    }
+
+    uint64_t n = m_next++;
+    frame_header& header = slot(n);
+    std::atomic_ref<uint64_t> sequence(header.sequence);
+
+    sequence.store(2*n+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header.frame = info.frame;
+    header.timestamp = info.timestamp;
+    header.format = info.format;
+    header.width = info.extent.width;
+    header.height = info.extent.height;
+    header.attachment = info.attachment;
+    header.size = size;
+    std::memcpy(reinterpret_cast<uint8_t*>(&header) + align_up(sizeof(frame_header), 64), data, size);
+
+    sequence.store(2*n+2, std::memory_order_release);
+    std::atomic_ref<uint64_t>(m_header->published).store(n+1, std::memory_order_release);
+    return true;
+}
+
+capture_ring::statistics capture_ring::stats() {
+    std::unique_lock lock(m_mutex);
+    return {m_next, m_oversized};
+}
+
+}
@@ -19,6 +19,40 @@ namespace CheekyLayer
 		dump_png = map<bool>("dumpPng", to_bool);
 		dump_png_flipped = map<bool>("dumpPngFlipped", to_bool);
 		dump_directory = map<std::filesystem::path>("dumpDirectory", [](std::string s) {return std::filesystem::path(s);});
+		pipeline_cache = map<bool>("pipelineCache", to_bool);
+
+		async_actions = map<std::unordered_set<std::string>>("asyncActions", [](std::string s) {
+			std::unordered_set<std::string> set;
+			std::istringstream iss(s);
+			std::string name;
+			while(std::getline(iss, name, ','))
+			{
+				if(!name.empty())
+					set.insert(name);
+			}
+			return set;
+		});
+		async_workers = map<size_t>("asyncWorkers", [](std::string s) {return std::stoul(s);});
+		async_queue_size = map<size_t>("asyncQueueSize", [](std::string s) {return std::stoul(s);});
+
+		device_workers = map<size_t>("deviceWorkers", [](std::string s) {return std::stoul(s);});
+		device_queue_size = map<size_t>("deviceQueueSize", [](std::string s) {return std::stoul(s);});
+		staging_ring_size = map<size_t>("stagingRingSize", [](std::string s) {return std::stoul(s);});
+		upload_batch_window = map<uint64_t>("uploadBatchWindow", [](std::string s) {return std::stoull(s);});
+		dedicated_transfer_queue = map<bool>("dedicatedTransferQueue", to_bool);
+		image_cache_size = map<size_t>("imageCacheSize", [](std::string s) {return std::stoul(s);});
+		image_cache_spill = map<bool>("imageCacheSpill", to_bool);
+		image_prefetch_manifest = map<std::filesystem::path>("imagePrefetchManifest", [](std::string s) {return std::filesystem::path(s);});
+		readback_max_in_flight = map<size_t>("readbackMaxInFlight", [](std::string s) {return std::stoul(s);});
+		readback_downscale = map<uint32_t>("readbackDownscale", [](std::string s) {return static_cast<uint32_t>(std::stoul(s));});
+		readback_tonemap = map<bool>("readbackTonemap", to_bool);
+		capture_directory = map<std::filesystem::path>("captureDirectory", [](std::string s) {return std::filesystem::path(s);});
+		capture_slots = map<uint32_t>("captureSlots", [](std::string s) {return static_cast<uint32_t>(std::stoul(s));});
+
+		profile_rules = map<bool>("profileRules", to_bool);
+		profile_interval = map<uint64_t>("profileInterval", [](std::string s) {return std::stoull(s);});
+
+		reload_rules = map<bool>("reloadRules", to_bool);
 
 		override = map<bool>("override", to_bool);
 		override_png_flipped = map<bool>("overridePngFlipped", to_bool);
@@ -66,6 +100,26 @@ namespace CheekyLayer
 		{"dumpPng", "false"},
 		{"dumpPngFlipped", "false"},
 		{"dumpDirectory", "/tmp/vulkan_dump"},
+		{"pipelineCache", "false"},
+		{"asyncActions", ""},
+		{"asyncWorkers", "2"},
+		{"asyncQueueSize", "1024"},
+		{"deviceWorkers", "4"},
+		{"deviceQueueSize", "256"},
+		{"stagingRingSize", "64"},
+		{"uploadBatchWindow", "2000"},
+		{"dedicatedTransferQueue", "true"},
+		{"imageCacheSize", "1024"},
+		{"imageCacheSpill", "false"},
+		{"imagePrefetchManifest", ""},
+		{"readbackMaxInFlight", "4"},
+		{"readbackDownscale", "0"},
+		{"readbackTonemap", "false"},
+		{"captureDirectory", "/dev/shm"},
+		{"captureSlots", "8"},
+		{"profileRules", "false"},
+		{"profileInterval", "0"},
+		{"reloadRules", "false"},
 		{"override", "true"},
 		{"overridePngFlipped", "false"},
 		{"overrideDirectory", "./override"},
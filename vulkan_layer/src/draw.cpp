@@ -229,7 +229,10 @@ VkResult device::AllocateCommandBuffers(const VkCommandBufferAllocateInfo* pAllo
 
 	for(int i=0; i<pAllocateInfo->commandBufferCount; i++)
 	{
-		commandBufferStates[pCommandBuffers[i]] = {handle};
+		// the handle might be reused from a command buffer that was freed implicitly
+		auto& state = commandBufferStates[pCommandBuffers[i]];
+		state.pool = pAllocateInfo->commandPool;
+		reset_state(state);
 	}
 
 	return result;
@@ -240,15 +243,71 @@ void device::FreeCommandBuffers(VkCommandPool commandPool, uint32_t commandBuffe
 
 	for(int i=0; i<commandBufferCount; i++)
 	{
-		commandBufferStates.erase(pCommandBuffers[i]);
-
-		inst->global_context.on_EndCommandBuffer.erase(pCommandBuffers[i]);
-		inst->global_context.on_QueueSubmit.erase(pCommandBuffers[i]);
+		auto it = commandBufferStates.find(pCommandBuffers[i]);
+		if(it == commandBufferStates.end())
+			continue;
+		drop_callbacks(it->second);
+		commandBufferStates.erase(it);
 	}
 
 	dispatch.FreeCommandBuffers(handle, commandPool, commandBufferCount, pCommandBuffers);
 }
 
+void device::DestroyCommandPool(VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+	// frees all command buffers allocated from the pool
+	for(auto it = commandBufferStates.begin(); it != commandBufferStates.end();)
+	{
+		if(it->second.pool != commandPool)
+		{
+			++it;
+			continue;
+		}
+		drop_callbacks(it->second);
+		it = commandBufferStates.erase(it);
+	}
+
+	dispatch.DestroyCommandPool(handle, commandPool, pAllocator);
+}
+
+VkResult device::ResetCommandPool(VkCommandPool commandPool, VkCommandPoolResetFlags flags) {
+	for(auto& [commandBuffer, state] : commandBufferStates)
+	{
+		if(state.pool == commandPool)
+			reset_state(state);
+	}
+
+	return dispatch.ResetCommandPool(handle, commandPool, flags);
+}
+
+VkResult device::BeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+	// implicitly resets the command buffer, even if it was only recorded and never submitted
+	if(auto it = commandBufferStates.find(commandBuffer); it != commandBufferStates.end())
+		reset_state(it->second);
+
+	return dispatch.BeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+
+VkResult device::ResetCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferResetFlags flags) {
+	if(auto it = commandBufferStates.find(commandBuffer); it != commandBufferStates.end())
+		reset_state(it->second);
+
+	return dispatch.ResetCommandBuffer(commandBuffer, flags);
+}
+
+// the callbacks of command buffers that will never be submitted are destroyed without running them
+void device::drop_callbacks(command_buffer_state& state) {
+	pendingSubmitCallbacks -= state.callbacks[static_cast<size_t>(command_buffer_event::QueueSubmit)].size();
+	for(auto& callbacks : state.callbacks)
+		callbacks.clear();
+	state.resources.clear();
+}
+
+// a command buffer that is recorded again starts without any of the previous state
+void device::reset_state(command_buffer_state& state) {
+	drop_callbacks(state);
+	state = {handle, state.pool};
+}
+
 VkResult device::CreateFramebuffer(const VkFramebufferCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkFramebuffer* pFramebuffer)
 {
 	VkResult result = dispatch.CreateFramebuffer(handle, pCreateInfo, pAllocator, pFramebuffer);
@@ -269,9 +328,44 @@ VkResult device::CreatePipelineLayout(const VkPipelineLayoutCreateInfo* pCreateI
 	return result;
 }
 
+VkResult device::CreateRenderPass(const VkRenderPassCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkRenderPass* pRenderPass)
+{
+	VkResult result = dispatch.CreateRenderPass(handle, pCreateInfo, pAllocator, pRenderPass);
+	if(result != VK_SUCCESS)
+		return result;
+
+	// the handle might be reused from a render pass that was destroyed
+	render_pass_info& info = renderPasses[*pRenderPass] = {};
+	for(uint32_t i=0; i<pCreateInfo->attachmentCount; i++)
+		info.finalLayouts.push_back(pCreateInfo->pAttachments[i].finalLayout);
+
+	return result;
+}
+
+VkResult device::CreateRenderPass2(const VkRenderPassCreateInfo2* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkRenderPass* pRenderPass, PFN_vkCreateRenderPass2 next)
+{
+	VkResult result = next(handle, pCreateInfo, pAllocator, pRenderPass);
+	if(result != VK_SUCCESS)
+		return result;
+
+	// the handle might be reused from a render pass that was destroyed
+	render_pass_info& info = renderPasses[*pRenderPass] = {};
+	for(uint32_t i=0; i<pCreateInfo->attachmentCount; i++)
+		info.finalLayouts.push_back(pCreateInfo->pAttachments[i].finalLayout);
+
+	return result;
+}
+
+void device::DestroyRenderPass(VkRenderPass renderPass, const VkAllocationCallbacks* pAllocator)
+{
+	renderPasses.erase(renderPass);
+	dispatch.DestroyRenderPass(handle, renderPass, pAllocator);
+}
+
 VkResult device::CreateGraphicsPipelines(VkPipelineCache pipelineCache, uint32_t createInfoCount, const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines)
 {
 	std::vector<std::remove_cvref_t<decltype(std::declval<rules::local_context>().creationCallbacks)>> callbacks;
+	std::vector<bool> overridden(createInfoCount, false);
 	for(unsigned int i=0; i<createInfoCount; i++) {
 		VkGraphicsPipelineCreateInfo* info = const_cast<VkGraphicsPipelineCreateInfo*>(&pCreateInfos[i]);
 
@@ -286,16 +380,100 @@ VkResult device::CreateGraphicsPipelines(VkPipelineCache pipelineCache, uint32_t
 		};
 		execute_rules(rules::selector_type::Pipeline, VK_NULL_HANDLE, ctx);
 
-		for(const auto& o : ctx.overrides) {
+		for(const auto* o : ctx.overrides) {
 			try {
-				reflection::parse_assign(o, info, "VkGraphicsPipelineCreateInfo");
+				o->apply(info);
+				overridden[i] = true;
 			} catch(const std::exception& e) {
-				logger->error("Failed to process override \"{}\": {}", o, e.what());
+				logger->error("Failed to process override \"{}\": {}", o->expression, e.what());
 			}
 		}
 		callbacks.push_back(ctx.creationCallbacks);
 	}
-	VkResult result = dispatch.CreateGraphicsPipelines(handle, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines);
+
+	// Modified pipelines will never be found in the application's own cache, so they go into ours instead.
+	std::vector<bool> useLayerCache(createInfoCount, false);
+	if(layerPipelineCache != VK_NULL_HANDLE) {
+		bool derivatives = false;
+		for(unsigned int i=0; i<createInfoCount; i++) {
+			useLayerCache[i] = pipelineCache == VK_NULL_HANDLE || overridden[i];
+			derivatives |= (pCreateInfos[i].flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT) && pCreateInfos[i].basePipelineIndex >= 0;
+		}
+		// derivatives refer to their base by its index in the batch, so such a batch cannot be split
+		if(derivatives && std::find(useLayerCache.begin(), useLayerCache.end(), true) != useLayerCache.end())
+			useLayerCache.assign(createInfoCount, true);
+	}
+
+	std::vector<VkGraphicsPipelineCreateInfo> infos(pCreateInfos, pCreateInfos+createInfoCount);
+	std::vector<VkPipelineCreationFeedbackCreateInfo> feedbackChain(createInfoCount);
+	std::vector<VkPipelineCreationFeedback> feedbacks(createInfoCount);
+	std::vector<std::vector<VkPipelineCreationFeedback>> stageFeedbacks(createInfoCount);
+	if(has_creation_feedback) {
+		for(unsigned int i=0; i<createInfoCount; i++) {
+			if(!useLayerCache[i])
+				continue;
+
+			// the application might already ask for feedback itself, chaining a second one would be invalid
+			auto* s = reinterpret_cast<const VkBaseInStructure*>(infos[i].pNext);
+			while(s && s->sType != VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO)
+				s = s->pNext;
+			if(s) {
+				feedbackChain[i].pPipelineCreationFeedback = reinterpret_cast<const VkPipelineCreationFeedbackCreateInfo*>(s)->pPipelineCreationFeedback;
+				continue;
+			}
+
+			stageFeedbacks[i].resize(infos[i].stageCount);
+			feedbackChain[i] = {
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+				.pNext = infos[i].pNext,
+				.pPipelineCreationFeedback = &feedbacks[i],
+				.pipelineStageCreationFeedbackCount = infos[i].stageCount,
+				.pPipelineStageCreationFeedbacks = stageFeedbacks[i].data(),
+			};
+			infos[i].pNext = &feedbackChain[i];
+		}
+	}
+
+	VkResult result = VK_SUCCESS;
+	size_t layerCount = std::count(useLayerCache.begin(), useLayerCache.end(), true);
+	if(layerCount == 0 || layerCount == createInfoCount) {
+		result = dispatch.CreateGraphicsPipelines(handle, layerCount == 0 ? pipelineCache : layerPipelineCache,
+			createInfoCount, infos.data(), pAllocator, pPipelines);
+	} else {
+		// only the modified pipelines go into our cache, the application's cache still gets all of its own ones
+		for(bool layer : {false, true}) {
+			std::vector<uint32_t> indices;
+			std::vector<VkGraphicsPipelineCreateInfo> group;
+			for(unsigned int i=0; i<createInfoCount; i++) {
+				if(useLayerCache[i] != layer)
+					continue;
+				indices.push_back(i);
+				group.push_back(infos[i]);
+			}
+
+			std::vector<VkPipeline> pipelines(group.size(), VK_NULL_HANDLE);
+			VkResult r = dispatch.CreateGraphicsPipelines(handle, layer ? layerPipelineCache : pipelineCache,
+				group.size(), group.data(), pAllocator, pipelines.data());
+			for(size_t j=0; j<indices.size(); j++)
+				pPipelines[indices[j]] = pipelines[j];
+
+			// errors take precedence over success codes like VK_PIPELINE_COMPILE_REQUIRED
+			if(result >= 0 && r != VK_SUCCESS)
+				result = r;
+		}
+	}
+
+	for(unsigned int i=0; i<createInfoCount; i++) {
+		if(!useLayerCache[i])
+			continue;
+		const VkPipelineCreationFeedback* feedback = feedbackChain[i].pPipelineCreationFeedback;
+		if(!feedback || !(feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT))
+			pipelineCacheStats.unknown++;
+		else if(feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+			pipelineCacheStats.hits++;
+		else
+			pipelineCacheStats.misses++;
+	}
 
 	if(result != VK_SUCCESS)
 		return result;
@@ -413,6 +591,7 @@ void device::CmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPas
 	auto& state = commandBufferStates[commandBuffer];
 	state.renderpass = pRenderPassBegin->renderPass;
 	state.framebuffer = pRenderPassBegin->framebuffer;
+	state.renderPassActive = true;
 
 	dispatch.CmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
 }
@@ -422,41 +601,12 @@ void device::CmdEndRenderPass(VkCommandBuffer commandBuffer)
 	dispatch.CmdEndRenderPass(commandBuffer);
 
 	auto& state = commandBufferStates[commandBuffer];
+	state.renderPassActive = false;
 
 	logger->trace("CmdEndRenderPass in commandBuffer {} with former renderPass {} and former framebuffer {}",
 		fmt::ptr(commandBuffer), fmt::ptr(state.renderpass), fmt::ptr(state.framebuffer));
 
-	auto& map = inst->global_context.on_EndRenderPass;
-	if(map.contains(commandBuffer)) {
-		bool _1;
-		std::vector<std::string> _2;
-		std::string _3;
-		std::vector<std::function<void(rules::VkHandle)>> _4;
-		std::unordered_map<std::string, rules::data_value> _5;
-		void* _6;
-
-		rules::local_context ctx = {
-			.logger = *logger,
-			.instance = inst,
-			.device = this,
-			.commandBuffer = commandBuffer,
-			.commandBufferState = &state,
-			.canceled = _1,
-			.overrides = _2,
-			.customTag = _3,
-			.creationCallbacks = _4,
-			.local_variables = _5,
-			.customPointer = _6
-		};
-
-		while(auto p = map.extract(commandBuffer)) {
-			try {
-				p.mapped()(ctx);
-			} catch(const std::exception& e) {
-				logger->error("Failed to execute callback: {}", e.what());
-			}
-		}
-	}
+	run_callbacks(commandBuffer, state, command_buffer_event::EndRenderPass);
 	state.renderpass = VK_NULL_HANDLE;
 	state.framebuffer = VK_NULL_HANDLE;
 }
@@ -657,39 +807,50 @@ VkResult device::EndCommandBuffer(VkCommandBuffer commandBuffer)
 	auto& state = commandBufferStates[commandBuffer];
 	state.transformFeedback = false;
 
-	auto& map = inst->global_context.on_EndCommandBuffer;
-	if(map.contains(commandBuffer)) {
-		bool _1;
-		std::vector<std::string> _2;
-		std::string _3;
-		std::vector<std::function<void(rules::VkHandle)>> _4;
-		std::unordered_map<std::string, rules::data_value> _5;
-		void* _6;
-
-		rules::local_context ctx = {
-			.logger = *logger,
-			.instance = inst,
-			.device = this,
-			.commandBuffer = commandBuffer,
-			.commandBufferState = &state,
-			.canceled = _1,
-			.overrides = _2,
-			.customTag = _3,
-			.creationCallbacks = _4,
-			.local_variables = _5,
-			.customPointer = _6
-		};
+	run_callbacks(commandBuffer, state, command_buffer_event::EndCommandBuffer);
+
+	return dispatch.EndCommandBuffer(commandBuffer);
+}
+
+void device::run_callbacks(VkCommandBuffer commandBuffer, command_buffer_state& state, command_buffer_event event, submit_extension* submit)
+{
+	auto& callbacks = state.callbacks[static_cast<size_t>(event)];
+	if(callbacks.empty())
+		return;
 
-		while(auto p = map.extract(commandBuffer)) {
+	rules::calling_context calling{
+		.commandBuffer = commandBuffer,
+		.commandBufferState = &state,
+	};
+	rules::local_context ctx = {
+		.logger = *logger,
+		.instance = inst,
+		.device = this,
+		.commandBuffer = commandBuffer,
+		.commandBufferState = &state,
+		.canceled = calling.canceled,
+		.overrides = calling.overrides,
+		.customTag = calling.customTag,
+		.creationCallbacks = calling.creationCallbacks,
+		.local_variables = calling.local_variables,
+		.customPointer = calling.customPointer,
+		.submit = submit,
+	};
+
+	// callbacks might schedule further callbacks for the same event, those run right away as well
+	while(!callbacks.empty()) {
+		auto pending = std::move(callbacks);
+		callbacks.clear();
+		if(event == command_buffer_event::QueueSubmit)
+			pendingSubmitCallbacks -= pending.size();
+		for(auto& callback : pending) {
 			try {
-				p.mapped()(ctx);
+				callback(ctx);
 			} catch(const std::exception& e) {
 				logger->error("Failed to execute callback: {}", e.what());
 			}
 		}
 	}
-
-	return dispatch.EndCommandBuffer(commandBuffer);
 }
 
 VkResult device::QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo)
@@ -700,54 +861,246 @@ VkResult device::QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresent
 	};
 	execute_rules(rules::selector_type::Present, VK_NULL_HANDLE, ctx);
 
+	uint64_t frame = ++inst->presentCount;
+	inst->global_context.timers.frame();
+	if(inst->config.profile_rules && inst->config.profile_interval > 0 && frame % inst->config.profile_interval == 0)
+		logger->info("{}", rules::profile_report(*inst->rules.read()));
+
 	if(ctx.canceled)
 		return VK_SUCCESS;
 	return dispatch.QueuePresentKHR(queue, pPresentInfo);
 }
 
+void device::run_submit_callbacks(VkCommandBuffer commandBuffer, submit_extension& submit)
+{
+	auto it = commandBufferStates.find(commandBuffer);
+	if(it != commandBufferStates.end())
+		run_callbacks(commandBuffer, it->second, command_buffer_event::QueueSubmit, &submit);
+}
+
+submit_fence::~submit_fence()
+{
+	dev.dispatch.ResetFences(*dev, 1, &handle);
+	std::scoped_lock lock(dev.submitFenceLock);
+	dev.freeSubmitFences.push_back(handle);
+}
+
+std::shared_ptr<submit_fence> device::fence_for(submit_extension& submit)
+{
+	if(submit.fence)
+		return submit.fence;
+
+	VkFence fence = VK_NULL_HANDLE;
+	{
+		std::scoped_lock lock(submitFenceLock);
+		if(!freeSubmitFences.empty()) {
+			fence = freeSubmitFences.back();
+			freeSubmitFences.pop_back();
+		}
+	}
+	if(fence == VK_NULL_HANDLE) {
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if(VkResult result = dispatch.CreateFence(handle, &fenceInfo, nullptr, &fence); result != VK_SUCCESS) {
+			logger->warn("Cannot create a fence for a submit: {}", vk::to_string((vk::Result)result));
+			return nullptr;
+		}
+	}
+	submit.fence = std::shared_ptr<submit_fence>(new submit_fence{*this, fence});
+	return submit.fence;
+}
+
+void device::submitted(submit_extension& submit, VkResult result, VkResult fenceResult)
+{
+	// the queue was waited for instead, so everything is done already
+	if(fenceResult != VK_SUCCESS) {
+		logger->warn("Cannot fence the work added to a submit: {}", vk::to_string((vk::Result)fenceResult));
+		submit.fence.reset();
+	}
+	for(auto& callback : submit.submitted)
+		callback(result, submit.fence);
+}
+
+// our own submits go to the application's queue if there is no dedicated transfer queue
+static std::unique_lock<std::mutex> lock_queue(const device& dev, VkQueue queue)
+{
+	std::unique_lock lock(transfer_lock, std::defer_lock);
+	if(queue == dev.transferQueue)
+		lock.lock();
+	return lock;
+}
+
 VkResult device::QueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence)
 {
+	submit_extension extension;
+	uploads.submitting(queue, extension);
+
+	// only look at the command buffers if any of them can have callbacks
+	std::vector<std::vector<VkCommandBuffer>> commandBuffers(submitCount);
+	std::vector<std::vector<VkCommandBuffer>> following(submitCount);
+	bool extended = false;
+	if(pendingSubmitCallbacks != 0) {
+		for(unsigned int i=0; i<submitCount; i++) {
+			const VkSubmitInfo& submit = pSubmits[i];
+			// a device group submit has one device mask per command buffer, so we cannot just extend it
+			bool deviceGroup = false;
+			for(auto* p = static_cast<const VkBaseInStructure*>(submit.pNext); p; p = p->pNext)
+				deviceGroup |= p->sType == VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+			for(unsigned int j=0; j<submit.commandBufferCount; j++) {
+				commandBuffers[i].push_back(submit.pCommandBuffers[j]);
+				run_submit_callbacks(submit.pCommandBuffers[j], extension);
+				auto& added = deviceGroup ? following[i] : commandBuffers[i];
+				added.insert(added.end(), extension.following.begin(), extension.following.end());
+				extended |= !extension.following.empty();
+				extension.following.clear();
+			}
+		}
+	}
+	if(!extended && extension.empty()) {
+		auto lock = lock_queue(*this, queue);
+		return dispatch.QueueSubmit(queue, submitCount, pSubmits, fence);
+	}
+
+	// waits and command buffers of ours go in front of the application's batches, signals after them
+	std::vector<VkSubmitInfo> submits;
+	if(!extension.waitSemaphores.empty() || !extension.commandBuffers.empty()) {
+		submits.push_back({
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.waitSemaphoreCount = static_cast<uint32_t>(extension.waitSemaphores.size()),
+			.pWaitSemaphores = extension.waitSemaphores.data(),
+			.pWaitDstStageMask = extension.waitStages.data(),
+			.commandBufferCount = static_cast<uint32_t>(extension.commandBuffers.size()),
+			.pCommandBuffers = extension.commandBuffers.data(),
+		});
+	}
 	for(unsigned int i=0; i<submitCount; i++) {
-		const VkSubmitInfo& submit = pSubmits[i];
-		for(unsigned int j=0; j<submit.commandBufferCount; j++) {
-			VkCommandBuffer commandBuffer = submit.pCommandBuffers[j];
-			auto& state = commandBufferStates[commandBuffer];
-
-			auto& map = inst->global_context.on_QueueSubmit;
-			if(map.contains(commandBuffer)) {
-				bool _1;
-				std::vector<std::string> _2;
-				std::string _3;
-				std::vector<std::function<void(rules::VkHandle)>> _4;
-				std::unordered_map<std::string, rules::data_value> _5;
-				void* _6;
-
-				rules::local_context ctx = {
-					.logger = *logger,
-					.instance = inst,
-					.device = this,
-					.commandBuffer = commandBuffer,
-					.commandBufferState = &state,
-					.canceled = _1,
-					.overrides = _2,
-					.customTag = _3,
-					.creationCallbacks = _4,
-					.local_variables = _5,
-					.customPointer = _6
-				};
-
-				while(auto p = map.extract(commandBuffer)) {
-					try {
-						p.mapped()(ctx);
-					} catch(const std::exception& e) {
-						logger->error("Failed to execute callback: {}", e.what());
-					}
+		submits.push_back(pSubmits[i]);
+		if(extended) {
+			submits.back().commandBufferCount = commandBuffers[i].size();
+			submits.back().pCommandBuffers = commandBuffers[i].data();
+		}
+		if(!following[i].empty()) {
+			submits.push_back({
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.commandBufferCount = static_cast<uint32_t>(following[i].size()),
+				.pCommandBuffers = following[i].data(),
+			});
+		}
+	}
+	if(!extension.signalSemaphores.empty()) {
+		submits.push_back({
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.signalSemaphoreCount = static_cast<uint32_t>(extension.signalSemaphores.size()),
+			.pSignalSemaphores = extension.signalSemaphores.data(),
+		});
+	}
+
+	// a vkQueueSubmit takes only one fence, if the application brought its own, ours follows in an empty one
+	bool fenceFollows = extension.fence && fence != VK_NULL_HANDLE;
+	VkResult result, fenceResult = VK_SUCCESS;
+	{
+		auto lock = lock_queue(*this, queue);
+		result = dispatch.QueueSubmit(queue, submits.size(), submits.data(),
+			extension.fence && !fenceFollows ? extension.fence->handle : fence);
+		if(result == VK_SUCCESS && fenceFollows && (fenceResult = dispatch.QueueSubmit(queue, 0, nullptr, extension.fence->handle)) != VK_SUCCESS)
+			dispatch.QueueWaitIdle(queue);
+	}
+	submitted(extension, result, fenceResult);
+	return result;
+}
+
+VkResult device::QueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence, PFN_vkQueueSubmit2 next)
+{
+	submit_extension extension;
+	uploads.submitting(queue, extension);
+
+	// every command buffer has its own device mask here, so added ones can always go right after the one that scheduled them
+	std::vector<std::vector<VkCommandBufferSubmitInfo>> commandBufferInfos(submitCount);
+	bool extended = false;
+	if(pendingSubmitCallbacks != 0) {
+		for(unsigned int i=0; i<submitCount; i++) {
+			const VkSubmitInfo2& submit = pSubmits[i];
+			for(unsigned int j=0; j<submit.commandBufferInfoCount; j++) {
+				const VkCommandBufferSubmitInfo& info = submit.pCommandBufferInfos[j];
+				commandBufferInfos[i].push_back(info);
+				run_submit_callbacks(info.commandBuffer, extension);
+				for(VkCommandBuffer commandBuffer : extension.following) {
+					commandBufferInfos[i].push_back({
+						.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+						.commandBuffer = commandBuffer,
+						.deviceMask = info.deviceMask,
+					});
 				}
+				extended |= !extension.following.empty();
+				extension.following.clear();
 			}
 		}
 	}
+	if(!extended && extension.empty()) {
+		auto lock = lock_queue(*this, queue);
+		return next(queue, submitCount, pSubmits, fence);
+	}
 
-	return dispatch.QueueSubmit(queue, submitCount, pSubmits, fence);
+	std::vector<VkSemaphoreSubmitInfo> waits;
+	for(size_t i=0; i<extension.waitSemaphores.size(); i++) {
+		waits.push_back({
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = extension.waitSemaphores[i],
+			.stageMask = extension.waitStages[i],
+		});
+	}
+	std::vector<VkCommandBufferSubmitInfo> commandBuffers;
+	for(VkCommandBuffer commandBuffer : extension.commandBuffers) {
+		commandBuffers.push_back({
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = commandBuffer,
+		});
+	}
+	std::vector<VkSemaphoreSubmitInfo> signals;
+	for(VkSemaphore semaphore : extension.signalSemaphores) {
+		signals.push_back({
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = semaphore,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		});
+	}
+
+	std::vector<VkSubmitInfo2> submits;
+	if(!waits.empty() || !commandBuffers.empty()) {
+		submits.push_back({
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size()),
+			.pWaitSemaphoreInfos = waits.data(),
+			.commandBufferInfoCount = static_cast<uint32_t>(commandBuffers.size()),
+			.pCommandBufferInfos = commandBuffers.data(),
+		});
+	}
+	for(unsigned int i=0; i<submitCount; i++) {
+		submits.push_back(pSubmits[i]);
+		if(extended) {
+			submits.back().commandBufferInfoCount = commandBufferInfos[i].size();
+			submits.back().pCommandBufferInfos = commandBufferInfos[i].data();
+		}
+	}
+	if(!signals.empty()) {
+		submits.push_back({
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size()),
+			.pSignalSemaphoreInfos = signals.data(),
+		});
+	}
+
+	bool fenceFollows = extension.fence && fence != VK_NULL_HANDLE;
+	VkResult result, fenceResult = VK_SUCCESS;
+	{
+		auto lock = lock_queue(*this, queue);
+		result = next(queue, submits.size(), submits.data(),
+			extension.fence && !fenceFollows ? extension.fence->handle : fence);
+		if(result == VK_SUCCESS && fenceFollows && (fenceResult = next(queue, 0, nullptr, extension.fence->handle)) != VK_SUCCESS)
+			dispatch.QueueWaitIdle(queue);
+	}
+	submitted(extension, result, fenceResult);
+	return result;
 }
 
 } // namespace CheekyLayer
@@ -769,6 +1122,36 @@ VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_FreeCommandBuffers(
 	return CheekyLayer::get_device(device).FreeCommandBuffers(commandPool, commandBufferCount, pCommandBuffers);
 }
 
+VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyCommandPool(
+    VkDevice                                    device,
+    VkCommandPool                               commandPool,
+    const VkAllocationCallbacks*                pAllocator)
+{
+	return CheekyLayer::get_device(device).DestroyCommandPool(commandPool, pAllocator);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_ResetCommandPool(
+    VkDevice                                    device,
+    VkCommandPool                               commandPool,
+    VkCommandPoolResetFlags                     flags)
+{
+	return CheekyLayer::get_device(device).ResetCommandPool(commandPool, flags);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_BeginCommandBuffer(
+    VkCommandBuffer                             commandBuffer,
+    const VkCommandBufferBeginInfo*             pBeginInfo)
+{
+	return CheekyLayer::get_device(commandBuffer).BeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_ResetCommandBuffer(
+    VkCommandBuffer                             commandBuffer,
+    VkCommandBufferResetFlags                   flags)
+{
+	return CheekyLayer::get_device(commandBuffer).ResetCommandBuffer(commandBuffer, flags);
+}
+
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateFramebuffer(
     VkDevice                                    device,
     const VkFramebufferCreateInfo*              pCreateInfo,
@@ -787,6 +1170,43 @@ VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreatePipelineLayout(
 	return CheekyLayer::get_device(device).CreatePipelineLayout(pCreateInfo, pAllocator, pPipelineLayout);
 }
 
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass(
+    VkDevice                                    device,
+    const VkRenderPassCreateInfo*               pCreateInfo,
+    const VkAllocationCallbacks*                pAllocator,
+    VkRenderPass*                               pRenderPass)
+{
+	return CheekyLayer::get_device(device).CreateRenderPass(pCreateInfo, pAllocator, pRenderPass);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass2(
+    VkDevice                                    device,
+    const VkRenderPassCreateInfo2*              pCreateInfo,
+    const VkAllocationCallbacks*                pAllocator,
+    VkRenderPass*                               pRenderPass)
+{
+	auto& dev = CheekyLayer::get_device(device);
+	return dev.CreateRenderPass2(pCreateInfo, pAllocator, pRenderPass, dev.dispatch.CreateRenderPass2);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateRenderPass2KHR(
+    VkDevice                                    device,
+    const VkRenderPassCreateInfo2*              pCreateInfo,
+    const VkAllocationCallbacks*                pAllocator,
+    VkRenderPass*                               pRenderPass)
+{
+	auto& dev = CheekyLayer::get_device(device);
+	return dev.CreateRenderPass2(pCreateInfo, pAllocator, pRenderPass, dev.dispatch.CreateRenderPass2KHR);
+}
+
+VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyRenderPass(
+    VkDevice                                    device,
+    VkRenderPass                                renderPass,
+    const VkAllocationCallbacks*                pAllocator)
+{
+	return CheekyLayer::get_device(device).DestroyRenderPass(renderPass, pAllocator);
+}
+
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateGraphicsPipelines(
     VkDevice                                    device,
     VkPipelineCache                             pipelineCache,
@@ -956,6 +1376,26 @@ VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit(
 	return CheekyLayer::get_device(queue).QueueSubmit(queue, submitCount, pSubmits, fence);
 }
 
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit2(
+    VkQueue                                     queue,
+    uint32_t                                    submitCount,
+    const VkSubmitInfo2*                        pSubmits,
+    VkFence                                     fence)
+{
+	auto& device = CheekyLayer::get_device(queue);
+	return device.QueueSubmit2(queue, submitCount, pSubmits, fence, device.dispatch.QueueSubmit2);
+}
+
+VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_QueueSubmit2KHR(
+    VkQueue                                     queue,
+    uint32_t                                    submitCount,
+    const VkSubmitInfo2*                        pSubmits,
+    VkFence                                     fence)
+{
+	auto& device = CheekyLayer::get_device(queue);
+	return device.QueueSubmit2(queue, submitCount, pSubmits, fence, device.dispatch.QueueSubmit2KHR);
+}
+
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_GetSwapchainImagesKHR(
 	VkDevice                                    device,
 	VkSwapchainKHR                              swapchain,
@@ -0,0 +1,413 @@
+#include "framebuffer_readback.hpp"
+
+#include "capture_ring.hpp"
+#include "layer.hpp"
+#include "objects.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <vk_format_utils.h>
+#include <vulkan/vulkan.hpp>
+
+#ifdef USE_IMAGE_TOOLS
+#include <block_compression.hpp>
+#include <image.hpp>
+#include <pixel_formats.hpp>
+
+#include <stb_image_write.h>
+#endif
+
+namespace CheekyLayer {
+
+// tightly packed, like CmdCopyImageToBuffer writes it without a row length
+VkDeviceSize framebuffer_readback::size(const VkImageCreateInfo& info) {
+    // only the depth aspect is copied, D24 is padded to 32 bits and the stencil left out
+    if(FormatHasDepth(info.format)) {
+        bool d16 = info.format == VK_FORMAT_D16_UNORM || info.format == VK_FORMAT_D16_UNORM_S8_UINT;
+        return VkDeviceSize(info.extent.width) * info.extent.height * (d16 ? 2 : 4);
+    }
+    VkExtent3D block = FormatTexelBlockExtent(info.format);
+    VkDeviceSize blocksX = (info.extent.width + block.width - 1) / block.width;
+    VkDeviceSize blocksY = (info.extent.height + block.height - 1) / block.height;
+    return blocksX * blocksY * FormatElementSize(info.format);
+}
+
+framebuffer_readback::~framebuffer_readback() {
+    shutdown();
+}
+
+void framebuffer_readback::configure(device* device, size_t maxInFlight, uint32_t downscale, bool tonemap) {
+    std::unique_lock lock(m_mutex);
+    if(!m_slots.empty())
+        return; // already configured
+    m_device = device;
+    m_slots.resize(std::max<size_t>(maxInFlight, 1));
+    m_downscale = downscale;
+    m_tonemap = tonemap;
+    m_alive = std::make_shared<framebuffer_readback*>(this);
+}
+
+bool framebuffer_readback::allocate(slot& s, VkDeviceSize size) {
+    device& dev = *m_device;
+    if(s.buffer != VK_NULL_HANDLE) {
+        dev.dispatch.DestroyBuffer(*dev, s.buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, s.memory, nullptr);
+        s = {};
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(VkResult result = dev.dispatch.CreateBuffer(*dev, &bufferInfo, nullptr, &s.buffer); result != VK_SUCCESS) {
+        dev.logger->error("Failed to create readback buffer of {} bytes: {}", size, vk::to_string((vk::Result)result));
+        s.buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    dev.dispatch.GetBufferMemoryRequirements(*dev, s.buffer, &requirements);
+
+    // cached memory is a lot faster to read from the CPU, but might need invalidation
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    try {
+        allocateInfo.memoryTypeIndex = findMemoryType(dev.memProperties, requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    } catch(const std::runtime_error&) {
+        allocateInfo.memoryTypeIndex = findMemoryType(dev.memProperties, requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    s.coherent = dev.memProperties.memoryTypes[allocateInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    if(dev.dispatch.AllocateMemory(*dev, &allocateInfo, nullptr, &s.memory) != VK_SUCCESS ||
+        dev.dispatch.BindBufferMemory(*dev, s.buffer, s.memory, 0) != VK_SUCCESS ||
+        dev.dispatch.MapMemory(*dev, s.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&s.data)) != VK_SUCCESS) {
+        dev.logger->error("Failed to allocate and map memory for readback buffer of {} bytes", size);
+        dev.dispatch.DestroyBuffer(*dev, s.buffer, nullptr);
+        if(s.memory != VK_NULL_HANDLE)
+            dev.dispatch.FreeMemory(*dev, s.memory, nullptr);
+        s = {};
+        return false;
+    }
+    s.capacity = size;
+    return true;
+}
+
+std::optional<size_t> framebuffer_readback::acquire(VkDeviceSize size) {
+    std::unique_lock lock(m_mutex);
+    if(m_shutdown || m_slots.empty())
+        return std::nullopt;
+
+    // prefer a buffer that is large enough already, otherwise grow the smallest one
+    std::optional<size_t> best;
+    for(size_t i=0; i<m_slots.size(); i++) {
+        const slot& s = m_slots[i];
+        if(s.busy || s.recorded)
+            continue;
+        if(!best || (s.capacity >= size) > (m_slots[*best].capacity >= size) ||
+            ((s.capacity >= size) == (m_slots[*best].capacity >= size) && s.capacity < m_slots[*best].capacity))
+            best = i;
+    }
+    if(!best) {
+        m_dropped++;
+        return std::nullopt;
+    }
+
+    slot& s = m_slots[*best];
+    if(s.capacity < size && !allocate(s, size))
+        return std::nullopt;
+    s.busy = true;
+    s.recorded = true;
+
+    size_t busy = std::ranges::count_if(m_slots, [](const slot& s){return s.busy;});
+    m_maxInFlight = std::max(m_maxInFlight, busy);
+    return best;
+}
+
+bool framebuffer_readback::record(VkCommandBuffer commandBuffer, command_buffer_state& state, const request& r) {
+    device& dev = *m_device;
+    VkExtent3D extent = r.info.extent;
+    VkDeviceSize size = framebuffer_readback::size(r.info);
+
+    std::optional<size_t> index = acquire(size);
+    if(!index)
+        return false;
+    slot& s = m_slots[*index];
+    s.req = r;
+
+    bool depth = FormatHasDepth(r.info.format);
+    VkImageAspectFlags aspect = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    VkPipelineStageFlags attachmentStages = depth ?
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = r.layout;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = r.image;
+    // layout transitions of depth/stencil images must include both aspects
+    toTransfer.subresourceRange = {aspect | (FormatHasStencil(r.info.format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u), 0, 1, 0, 1};
+    dev.dispatch.CmdPipelineBarrier(commandBuffer, attachmentStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy copy{};
+    copy.imageSubresource = {aspect, 0, 0, 1};
+    copy.imageExtent = {extent.width, extent.height, 1};
+    dev.dispatch.CmdCopyImageToBuffer(commandBuffer, r.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, s.buffer, 1, &copy);
+
+    // give the image back to the application in the layout it expects, and make the copy visible to the host
+    VkImageMemoryBarrier toOriginal = toTransfer;
+    toOriginal.srcAccessMask = 0;
+    toOriginal.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    toOriginal.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toOriginal.newLayout = r.layout;
+    VkBufferMemoryBarrier toHost{};
+    toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer = s.buffer;
+    toHost.size = VK_WHOLE_SIZE;
+    dev.dispatch.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr, 1, &toHost, 1, &toOriginal);
+
+    // gives the buffer back once the command buffer is reset or freed, and cancels the readback if it was never submitted
+    struct pending {
+        std::weak_ptr<framebuffer_readback*> owner;
+        size_t index;
+        bool submitted = false;
+        ~pending() {
+            if(auto o = owner.lock())
+                (*o)->forget(index, submitted);
+        }
+    };
+    auto p = std::make_shared<pending>(m_alive, *index);
+    state.resources.push_back(p);
+    state.on(command_buffer_event::QueueSubmit, [this, p](rules::local_context& ctx){
+        p->submitted = true;
+        // without a fence we would never know when the copy is done
+        if(!ctx.device->fence_for(*ctx.submit)) {
+            release(p->index, false);
+            return;
+        }
+        ctx.submit->submitted.push_back([this, index = p->index](VkResult result, std::shared_ptr<submit_fence> fence){
+            submitted(index, result, std::move(fence));
+        });
+    });
+    dev.pendingSubmitCallbacks++;
+
+    std::unique_lock lock(m_mutex);
+    m_recorded++;
+    return true;
+}
+
+void framebuffer_readback::submitted(size_t index, VkResult result, std::shared_ptr<submit_fence> fence) {
+    {
+        std::unique_lock lock(m_mutex);
+        if(m_shutdown) {
+            m_cancelled++;
+            return;
+        }
+    }
+    if(result != VK_SUCCESS) {
+        m_device->logger->warn("Cannot read back framebuffer, because its submit failed: {}", vk::to_string((vk::Result)result));
+        release(index, false);
+        return;
+    }
+    if(!fence) {
+        dump(index);
+        return;
+    }
+
+    {
+        std::unique_lock lock(m_mutex);
+        m_fenced.push_back({std::move(fence), index});
+        if(!m_thread.joinable()) {
+            m_thread = std::jthread([this](std::stop_token stop){
+                run(stop);
+            });
+        }
+    }
+    m_cv.notify_one();
+}
+
+void framebuffer_readback::run(std::stop_token stop) {
+    device& dev = *m_device;
+    while(true) {
+        fenced f;
+        {
+            std::unique_lock lock(m_mutex);
+            // whatever is still fenced when we are stopped is waited for by shutdown()
+            if(!m_cv.wait(lock, stop, [this]{return !m_fenced.empty();}) || stop.stop_requested())
+                return;
+            f = m_fenced.front();
+        }
+
+        // fences signal in submission order per queue, but not across queues, so only wait a little for each
+        using namespace std::chrono_literals;
+        VkResult result = dev.dispatch.WaitForFences(*dev, 1, &f.fence->handle, VK_TRUE, std::chrono::nanoseconds(10ms).count());
+        if(result == VK_TIMEOUT) {
+            std::unique_lock lock(m_mutex);
+            if(m_fenced.size() > 1)
+                std::rotate(m_fenced.begin(), m_fenced.begin() + 1, m_fenced.end());
+            continue;
+        }
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_fenced.pop_front();
+        }
+        if(result != VK_SUCCESS) {
+            dev.logger->error("Failed to wait for framebuffer readback: {}", vk::to_string((vk::Result)result));
+            release(f.slot, false);
+            continue;
+        }
+        dump(f.slot);
+    }
+}
+
+void framebuffer_readback::dump(size_t index) {
+    bool queued = m_device->workers.submit(worker_pool::lane::Dump, [this, index](std::stop_token stop){
+        if(stop.stop_requested())
+            release(index, false);
+        else
+            complete(index);
+    });
+    if(!queued)
+        release(index, false);
+}
+
+void framebuffer_readback::complete(size_t index) {
+    device& dev = *m_device;
+    const slot& s = m_slots[index];
+    VkDeviceSize size = framebuffer_readback::size(s.req.info);
+    if(!s.coherent) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = s.memory;
+        range.size = VK_WHOLE_SIZE;
+        dev.dispatch.InvalidateMappedMemoryRanges(*dev, 1, &range);
+    }
+
+    try {
+        if(s.req.capture) {
+            capture_ring::frame_info info{s.req.info.format, s.req.info.extent, s.req.attachment, s.req.frame, s.req.timestamp};
+            if(!s.req.capture->publish(info, s.data, size))
+                dev.logger->warn("Frame of {} bytes does not fit into the slots of capture ring {}", size, s.req.capture->path().string());
+        } else {
+            write(s.req, s.data, size);
+        }
+    } catch(const std::exception& ex) {
+        dev.logger->error("Could not write framebuffer: {}", ex.what());
+    }
+    release(index, true);
+}
+
+void framebuffer_readback::release(size_t index, bool completed) {
+    std::unique_lock lock(m_mutex);
+    if(index >= m_slots.size())
+        return;
+    m_slots[index].busy = false;
+    if(completed)
+        m_completed++;
+    else
+        m_cancelled++;
+}
+
+void framebuffer_readback::forget(size_t index, bool submitted) {
+    if(!submitted)
+        release(index, false);
+    std::unique_lock lock(m_mutex);
+    if(index < m_slots.size())
+        m_slots[index].recorded = false;
+}
+
+void framebuffer_readback::write(const request& r, const uint8_t* data, VkDeviceSize size) {
+    device& dev = *m_device;
+    VkFormat format = r.info.format;
+
+    auto t = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<long> seconds = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch());
+    std::string name = std::to_string(seconds.count()) + "_" + std::to_string(r.attachment);
+
+#ifdef USE_IMAGE_TOOLS
+    bool decompression = image_tools::is_decompression_supported(format);
+    if(decompression || image_tools::is_conversion_supported(format))
+    {
+        std::string filename = dev.inst->config.dump_directory / "images/framebuffers" / (name+".png");
+        int w = r.info.extent.width;
+        int h = r.info.extent.height;
+
+        image_tools::image image(w, h);
+        if(decompression)
+            image_tools::decompress(format, data, image, w, h);
+        else
+            image_tools::convert(format, data, image, w, h, m_tonemap ? image_tools::tonemap::Reinhard : image_tools::tonemap::Clamp);
+
+        bool srgb = format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+        for(uint32_t i=0; i<m_downscale && (w > 1 || h > 1); i++) {
+            image = image.downsampled(srgb);
+            w = image.get_width();
+            h = image.get_height();
+        }
+
+        if(!stbi_write_png(filename.c_str(), w, h, 4, image, w*4))
+            throw std::runtime_error("cannot write PNG file \""+filename+"\"");
+        dev.logger->info("Framebuffer #{} of size {}x{} and format {} was encoded and written to PNG file \"{}\" of size {}x{}.",
+            r.attachment, r.info.extent.width, r.info.extent.height, vk::to_string((vk::Format)format), filename, w, h);
+        return;
+    }
+#endif
+
+    std::string filename = dev.inst->config.dump_directory / "images/framebuffers" / (name+".image");
+    std::ofstream of(filename, std::ios::binary);
+    if(!of.good())
+        throw std::runtime_error("cannot open file \""+filename+"\"");
+    of.write(reinterpret_cast<const char*>(data), size);
+    dev.logger->info("Framebuffer #{} of size {}x{} and format {} was written to file \"{}\".",
+        r.attachment, r.info.extent.width, r.info.extent.height, vk::to_string((vk::Format)format), filename);
+}
+
+framebuffer_readback::statistics framebuffer_readback::stats() {
+    std::unique_lock lock(m_mutex);
+    return {m_recorded, m_dropped, m_completed, m_cancelled, m_maxInFlight};
+}
+
+void framebuffer_readback::shutdown() {
+    {
+        std::unique_lock lock(m_mutex);
+        if(m_shutdown || !m_device)
+            return;
+        m_shutdown = true;
+    }
+    m_thread = {};
+    m_alive.reset();
+
+    device& dev = *m_device;
+    for(auto& f : m_fenced) {
+        dev.dispatch.WaitForFences(*dev, 1, &f.fence->handle, VK_TRUE, UINT64_MAX);
+        m_cancelled++;
+    }
+    m_fenced.clear();
+
+    for(auto& s : m_slots) {
+        if(s.buffer == VK_NULL_HANDLE)
+            continue;
+        dev.dispatch.DestroyBuffer(*dev, s.buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, s.memory, nullptr);
+    }
+    m_slots.clear();
+}
+
+}
@@ -0,0 +1,263 @@
+#include "image_cache.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <fmt/core.h>
+#include <fstream>
+#include <sstream>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+#ifdef USE_IMAGE_TOOLS
+#include <block_compression.hpp>
+#include <image.hpp>
+
+#include <stb_image.h>
+#endif
+
+namespace CheekyLayer {
+
+namespace {
+    constexpr char spill_magic[4] = {'C', 'K', 'I', 'C'};
+
+    int64_t modification_time(const std::filesystem::path& file) {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(file, ec);
+        return ec ? 0 : time.time_since_epoch().count();
+    }
+
+    size_t entry_size(const image_file_cache::entry& e) {
+        return e.data.size() + e.offsets.size() * sizeof(VkDeviceSize);
+    }
+}
+
+void image_file_cache::configure(size_t budget, std::optional<std::filesystem::path> spillDirectory) {
+    std::unique_lock lock(m_mutex);
+    m_budget = budget;
+    m_spillDirectory = std::move(spillDirectory);
+    if(m_spillDirectory) {
+        std::error_code ec;
+        std::filesystem::create_directories(*m_spillDirectory, ec);
+    }
+}
+
+image_file_cache::value image_file_cache::get(const key& k, const std::function<entry()>& load, bool prefetch) {
+    std::promise<value> promise;
+    // prefetched keys are only recorded once something needs them, whether they are loaded by then or not
+    bool first = false;
+    {
+        std::unique_lock lock(m_mutex);
+        if(!prefetch && m_loadedSet.insert(k).second) {
+            m_loaded.push_back(k);
+            first = true;
+        }
+        if(auto it = m_entries.find(k); it != m_entries.end()) {
+            m_hits++;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return it->second.v;
+        }
+        if(auto it = m_loading.find(k); it != m_loading.end()) {
+            m_deduplicated++;
+            std::shared_future<value> loading = it->second;
+            lock.unlock();
+            return loading.get();
+        }
+        m_misses++;
+        m_loading.emplace(k, promise.get_future().share());
+    }
+
+    value v;
+    try {
+        v = unspill(k);
+        if(!v)
+            v = std::make_shared<const entry>(load());
+    } catch(...) {
+        promise.set_exception(std::current_exception());
+        std::unique_lock lock(m_mutex);
+        m_loading.erase(k);
+        if(first) {
+            m_loadedSet.erase(k);
+            std::erase(m_loaded, k);
+        }
+        throw;
+    }
+    promise.set_value(v);
+
+    std::vector<std::pair<key, value>> evicted;
+    {
+        std::unique_lock lock(m_mutex);
+        m_loading.erase(k);
+        insert(k, v, evicted);
+    }
+    // writing them can take a while, so it happens outside of the lock
+    if(m_spillDirectory) {
+        for(auto& [ek, ev] : evicted)
+            spill(ek, *ev);
+    }
+    return v;
+}
+
+void image_file_cache::insert(const key& k, value v, std::vector<std::pair<key, value>>& evicted) {
+    size_t size = entry_size(*v);
+    if(size > m_budget)
+        return; // would evict everything and still not fit
+
+    m_lru.push_front(k);
+    m_entries[k] = {v, size, m_lru.begin()};
+    m_bytes += size;
+
+    while(m_bytes > m_budget) {
+        auto it = m_entries.find(m_lru.back());
+        m_bytes -= it->second.size;
+        evicted.emplace_back(it->first, std::move(it->second.v));
+        m_entries.erase(it);
+        m_lru.pop_back();
+        m_evictions++;
+    }
+}
+
+std::filesystem::path image_file_cache::spill_path(const key& k) const {
+    std::string name = fmt::format("{}|{}|{}x{}|{}", k.filename, static_cast<int>(k.format), k.width, k.height, k.mipLevels);
+    return *m_spillDirectory / (sha256_string(reinterpret_cast<const unsigned char*>(name.data()), name.size()) + ".bin");
+}
+
+void image_file_cache::spill(const key& k, const entry& e) {
+    // written to a temporary file first, so a concurrent unspill() never sees half of it
+    std::filesystem::path path = spill_path(k);
+    std::filesystem::path temporary = path;
+    temporary += fmt::format(".{}.tmp", fmt::ptr(&e));
+    std::ofstream out(temporary, std::ios::binary);
+    if(!out.good()) {
+        spdlog::warn("Cannot spill transcoded image {} to {}", k.filename, path.string());
+        return;
+    }
+
+    // the modification time of the source lets us ignore spilled data of files that changed since
+    int64_t mtime = modification_time(k.filename);
+    uint32_t count = e.offsets.size();
+    uint64_t size = e.data.size();
+    out.write(spill_magic, sizeof(spill_magic));
+    out.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(e.offsets.data()), count * sizeof(VkDeviceSize));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(e.data.data()), size);
+    out.close();
+
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if(ec) {
+        spdlog::warn("Cannot spill transcoded image {} to {}: {}", k.filename, path.string(), ec.message());
+        std::filesystem::remove(temporary, ec);
+        return;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_spilled++;
+}
+
+image_file_cache::value image_file_cache::unspill(const key& k) {
+    if(!m_spillDirectory)
+        return nullptr;
+
+    std::ifstream in(spill_path(k), std::ios::binary);
+    if(!in.good())
+        return nullptr;
+
+    char magic[sizeof(spill_magic)];
+    int64_t mtime;
+    uint32_t count;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&mtime), sizeof(mtime));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if(!in.good() || !std::equal(magic, magic + sizeof(magic), spill_magic) || mtime != modification_time(k.filename))
+        return nullptr;
+
+    auto e = std::make_shared<entry>();
+    uint64_t size;
+    e->offsets.resize(count);
+    in.read(reinterpret_cast<char*>(e->offsets.data()), count * sizeof(VkDeviceSize));
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if(!in.good())
+        return nullptr;
+    e->data.resize(size);
+    in.read(reinterpret_cast<char*>(e->data.data()), size);
+    if(!in.good())
+        return nullptr;
+
+    std::unique_lock lock(m_mutex);
+    m_spillHits++;
+    return e;
+}
+
+image_file_cache::statistics image_file_cache::stats() {
+    std::unique_lock lock(m_mutex);
+    return {m_bytes, m_entries.size(), m_hits, m_misses, m_deduplicated, m_evictions, m_spilled, m_spillHits};
+}
+
+// format, width, height and mipLevels come first, so the filename can contain anything but a newline
+std::vector<image_file_cache::key> image_file_cache::read_manifest(const std::filesystem::path& path) {
+    std::vector<key> keys;
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)) {
+        std::istringstream is(line);
+        int format;
+        key k;
+        if(!(is >> format >> k.width >> k.height >> k.mipLevels) || is.get() != ' ' || !std::getline(is, k.filename) || k.filename.empty())
+            continue;
+        k.format = static_cast<VkFormat>(format);
+        keys.push_back(std::move(k));
+    }
+    return keys;
+}
+
+void image_file_cache::write_manifest(const std::filesystem::path& path, const std::vector<key>& previous) {
+    std::vector<key> keys;
+    {
+        std::unique_lock lock(m_mutex);
+        keys = m_loaded;
+        for(const key& k : previous) {
+            if(!m_loadedSet.contains(k))
+                keys.push_back(k);
+        }
+    }
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary);
+        for(const key& k : keys) {
+            std::error_code ec;
+            if(std::filesystem::exists(k.filename, ec))
+                out << static_cast<int>(k.format) << ' ' << k.width << ' ' << k.height << ' ' << k.mipLevels << ' ' << k.filename << '\n';
+        }
+        if(!out.good()) {
+            spdlog::warn("Cannot write image prefetch manifest {}", temporary.string());
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if(ec)
+        spdlog::warn("Cannot write image prefetch manifest {}: {}", path.string(), ec.message());
+}
+
+#ifdef USE_IMAGE_TOOLS
+image_file_cache::entry transcode_png(const image_file_cache::key& k, unsigned int threads) {
+    image_file_cache::entry e;
+
+    int w, h, comp;
+    uint8_t* buf = stbi_load(k.filename.c_str(), &w, &h, &comp, STBI_rgb_alpha);
+    if(!buf)
+        throw std::runtime_error("cannot load "+k.filename+": "+stbi_failure_reason());
+    image_tools::image image(w, h, buf);
+    stbi_image_free(buf);
+
+    image_tools::compress_mip_chain(k.format, image, e.data, e.offsets, k.width, k.height, std::max(k.mipLevels, 1u), threads);
+    return e;
+}
+#endif
+
+}
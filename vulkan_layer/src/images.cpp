@@ -1,9 +1,11 @@
 #include "layer.hpp"
 #include "utils.hpp"
 #include "objects.hpp"
+#include "texture_file.hpp"
 
 #include <cstdint>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vk_format_utils.h>
 #include <algorithm>
@@ -208,11 +210,32 @@ void device::CmdCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer srcBuf
 			if(has_override(hash_string)) {
 				auto rawPath = inst->config.override_directory / "images" / (hash_string+".image");
 				auto pngPath = inst->config.override_directory / "images" / (hash_string+".png");
+				auto ddsPath = inst->config.override_directory / "images" / (hash_string+".dds");
+				auto ktx2Path = inst->config.override_directory / "images" / (hash_string+".ktx2");
 				if(std::filesystem::exists(rawPath)) {
 					logger->info("Found image override at {}!", rawPath.string());
 					std::ifstream in(rawPath, std::ios_base::binary);
 					in.read((char*)data, size);
 				}
+				else if(std::filesystem::exists(ddsPath) || std::filesystem::exists(ktx2Path)) {
+					auto texturePath = std::filesystem::exists(ddsPath) ? ddsPath : ktx2Path;
+					try {
+						texture_file texture(texturePath);
+						texture.validate(image.createInfo);
+
+						uint32_t level = pRegions[0].imageSubresource.mipLevel;
+						if(level >= texture.levels().size())
+							throw std::runtime_error(fmt::format("{} has no mip level {}", texturePath.string(), level));
+						auto levelData = texture.levels()[level];
+						if(levelData.size() != size)
+							throw std::runtime_error(fmt::format("mip level {} of {} has {} bytes, but {} are copied", level, texturePath.string(), levelData.size(), size));
+
+						std::copy(levelData.begin(), levelData.end(), (uint8_t*)data);
+						logger->info("Found image override at {}!", texturePath.string());
+					} catch(std::exception& ex) {
+						logger->error("Cannot use image override: {}", ex.what());
+					}
+				}
 #ifdef USE_IMAGE_TOOLS
 				else if(std::filesystem::exists(pngPath)) {
 					if(image_tools::is_compression_supported(image.createInfo.format)) {
@@ -1,10 +1,14 @@
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <dlfcn.h>
 #include <mutex>
+#include <optional>
 #include <string.h>
 #include <string>
+#include <vector>
 #include <vulkan/vulkan_core.h>
+#include <vulkan/vulkan.hpp>
 #include <memory>
 #include <assert.h>
 
@@ -112,12 +116,43 @@ VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyInstance(VkInstance instance,
 
 	auto& inst = CheekyLayer::get_instance(instance);
 	inst.logger->info("Destroying instance {}", fmt::ptr(instance));
+	if(inst.config.profile_rules)
+		inst.logger->info("{}", CheekyLayer::rules::profile_report(*inst.rules.read()));
+	auto cacheStats = inst.imageCache.stats();
+	inst.logger->info("Image cache statistics: {} hits, {} misses, {} deduplicated, {} evictions, {} spilled, {} read back, {} entries with {} bytes",
+		cacheStats.hits, cacheStats.misses, cacheStats.deduplicated, cacheStats.evictions, cacheStats.spilled, cacheStats.spillHits,
+		cacheStats.entries, cacheStats.bytes);
+	if(!inst.config.image_prefetch_manifest.empty())
+	{
+		inst.imagePrefetcher = {};
+		inst.imageCache.write_manifest(inst.config.image_prefetch_manifest, inst.prefetchManifest);
+	}
 	inst.dispatch.DestroyInstance(instance, pAllocator);
 	CheekyLayer::instances.erase(GetKey(instance));
 }
 
 namespace CheekyLayer {
 
+std::optional<uint32_t> instance::find_transfer_queue_family(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo) {
+    uint32_t count;
+    dispatch.GetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(count);
+    dispatch.GetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, families.data());
+
+    // prefer a family that is only good for transfers, then one for async compute
+    std::optional<uint32_t> best;
+    for(uint32_t i=0; i<count; i++) {
+        bool used = std::any_of(pCreateInfo->pQueueCreateInfos, pCreateInfo->pQueueCreateInfos + pCreateInfo->queueCreateInfoCount,
+            [i](const VkDeviceQueueCreateInfo& info){return info.queueFamilyIndex == i;});
+        VkQueueFlags flags = families[i].queueFlags;
+        if(used || families[i].queueCount == 0 || (flags & VK_QUEUE_GRAPHICS_BIT) || !(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)))
+            continue;
+        if(!best || !(flags & VK_QUEUE_COMPUTE_BIT))
+            best = i;
+    }
+    return best;
+}
+
 VkResult instance::CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDevice *pDevice) {
     VkLayerDeviceCreateInfo *chain_info = get_chain_info(pCreateInfo, VK_LAYER_LINK_INFO);
 
@@ -129,7 +164,34 @@ VkResult instance::CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceC
     }
     chain_info->u.pLayerInfo = chain_info->u.pLayerInfo->pNext;
 
-	VkResult ret = fpCreateDevice(physicalDevice, pCreateInfo, pAllocator, pDevice);
+	// add a queue the application does not know about (we only report the first family), so our uploads do not wait for its work
+	std::optional<uint32_t> transferFamily = config.dedicated_transfer_queue ? find_transfer_queue_family(physicalDevice, pCreateInfo) : std::nullopt;
+	VkDeviceCreateInfo createInfo = *pCreateInfo;
+	std::vector<VkDeviceQueueCreateInfo> queueInfos(pCreateInfo->pQueueCreateInfos, pCreateInfo->pQueueCreateInfos + pCreateInfo->queueCreateInfoCount);
+	float priority = 0.0f;
+	if(transferFamily)
+	{
+		queueInfos.push_back({
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = *transferFamily,
+			.queueCount = 1,
+			.pQueuePriorities = &priority,
+		});
+		createInfo.queueCreateInfoCount = queueInfos.size();
+		createInfo.pQueueCreateInfos = queueInfos.data();
+	}
+
+	// the next layer advances the link info in place, a retry has to start from the same one
+	auto* layerInfo = chain_info->u.pLayerInfo;
+	VkResult ret = fpCreateDevice(physicalDevice, &createInfo, pAllocator, pDevice);
+	if(ret != VK_SUCCESS && transferFamily)
+	{
+		logger->warn("Failed to create device with an additional queue of family {}, falling back to the application's queue: {}",
+			*transferFamily, vk::to_string((vk::Result)ret));
+		transferFamily.reset();
+		chain_info->u.pLayerInfo = layerInfo;
+		ret = fpCreateDevice(physicalDevice, pCreateInfo, pAllocator, pDevice);
+	}
 	if(ret != VK_SUCCESS)
 		return ret;
 
@@ -138,6 +200,9 @@ VkResult instance::CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceC
 	auto& dev = ::CheekyLayer::devices[GetKey(*pDevice)] = std::make_unique<device>(this, fpGetDeviceProcAddr, physicalDevice, pCreateInfo, pDevice);
 	devices[*pDevice] = dev.get();
     InitDeviceDispatchTable(*pDevice, fpGetDeviceProcAddr, dev->dispatch);
+	dev->load_pipeline_cache();
+	if(transferFamily)
+		dev->init_transfer_queue(*transferFamily, 0);
 
 	logger->flush();
 
@@ -151,40 +216,55 @@ void device::GetDeviceQueue(uint32_t queueFamilyIndex, uint32_t queueIndex, VkQu
 	if(!(queueFamilies[queueFamilyIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT))
 		return;
 
-	if(transferQueue == VK_NULL_HANDLE)
+	if(graphicsQueue == VK_NULL_HANDLE)
 	{
-		dispatch.GetDeviceQueue(handle, queueFamilyIndex, queueIndex, &transferQueue);
-		*reinterpret_cast<void**>(transferQueue) = *reinterpret_cast<void**>(handle);
-
-		VkCommandPoolCreateInfo poolInfo;
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.pNext = nullptr;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		poolInfo.queueFamilyIndex = queueFamilyIndex;
-		if(dispatch.CreateCommandPool(handle, &poolInfo, nullptr, &transferPool) != VK_SUCCESS) {
-			logger->error("failed to create command pool");
-			return;
-		}
+		graphicsQueue = *pQueue;
+		graphicsQueueFamily = queueFamilyIndex;
 
-		VkCommandBufferAllocateInfo allocateInfo;
-		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocateInfo.pNext = nullptr;
-		allocateInfo.commandPool = transferPool;
-		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocateInfo.commandBufferCount = 1;
-		if(dispatch.AllocateCommandBuffers(handle, &allocateInfo, &transferBuffer) != VK_SUCCESS) {
-			logger->error("failed to allocate command buffer");
-			return;
+		if(transferQueue == VK_NULL_HANDLE)
+		{
+			// no dedicated queue, our uploads share the application's one
+			if(!init_transfer_queue(queueFamilyIndex, queueIndex))
+				return;
+		}
+		else
+		{
+			// uploads on the dedicated queue hand the images over to this queue
+			if(!(graphicsPool = create_command_pool(queueFamilyIndex)))
+				return;
 		}
-		*reinterpret_cast<void**>(transferBuffer) = *reinterpret_cast<void**>(handle);
-
-		logger->debug("Created transfer command buffer {} in pool {} for queue family {} on device {}", fmt::ptr(transferBuffer), fmt::ptr(transferPool), queueFamilyIndex, fmt::ptr(handle));
 
 		rules::calling_context ctx{};
 		execute_rules(rules::selector_type::DeviceCreate, (rules::VkHandle) handle, ctx);
 	}
 }
 
+VkCommandPool device::create_command_pool(uint32_t queueFamilyIndex) {
+	VkCommandPoolCreateInfo poolInfo;
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	VkCommandPool pool;
+	if(dispatch.CreateCommandPool(handle, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+		logger->error("failed to create command pool");
+		return VK_NULL_HANDLE;
+	}
+	logger->debug("Created command pool {} for queue family {} on device {}", fmt::ptr(pool), queueFamilyIndex, fmt::ptr(handle));
+	return pool;
+}
+
+bool device::init_transfer_queue(uint32_t queueFamilyIndex, uint32_t queueIndex) {
+	dispatch.GetDeviceQueue(handle, queueFamilyIndex, queueIndex, &transferQueue);
+	*reinterpret_cast<void**>(transferQueue) = *reinterpret_cast<void**>(handle);
+	transferQueueFamily = queueFamilyIndex;
+
+	if(!(transferPool = create_command_pool(queueFamilyIndex)))
+		return false;
+	logger->info("Using queue {} of family {} for transfers", queueIndex, queueFamilyIndex);
+	return true;
+}
+
 }
 
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo,
@@ -224,7 +304,40 @@ VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_GetDeviceQueue(
 
 VK_LAYER_EXPORT void VKAPI_CALL CheekyLayer_DestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator)
 {
-	CheekyLayer::get_device(device).inst->devices.erase(device);
+	auto& dev = CheekyLayer::get_device(device);
+	// async actions of the instance's rules might still use this device
+	dev.inst->global_context.async.cancel(&dev);
+	dev.workers.shutdown();
+	auto stats = dev.workers.stats();
+	dev.logger->info("Worker statistics: {} submitted, {} executed, {} dropped, {} cancelled, max depth {}",
+		stats.submitted, stats.executed, stats.dropped, stats.cancelled, stats.maxDepth);
+	dev.readbacks.shutdown();
+	auto readbackStats = dev.readbacks.stats();
+	dev.logger->info("Readback statistics: {} recorded, {} dropped, {} completed, {} cancelled, max {} in flight",
+		readbackStats.recorded, readbackStats.dropped, readbackStats.completed, readbackStats.cancelled, readbackStats.maxInFlight);
+	for(auto& [name, ring] : dev.captureRings) {
+		auto captureStats = ring->stats();
+		dev.logger->info("Capture ring {}: {} frames published, {} too large", name, captureStats.published, captureStats.oversized);
+	}
+	dev.captureRings.clear();
+	dev.uploads.shutdown();
+	auto uploadStats = dev.uploads.stats();
+	dev.logger->info("Upload statistics: {} uploads in {} batches, {} superseded, max batch size {}",
+		uploadStats.uploads, uploadStats.batches, uploadStats.superseded, uploadStats.maxBatch);
+	// all fences of submits went back to the device once the readbacks and uploads let go of them
+	for(VkFence fence : dev.freeSubmitFences)
+		dev.dispatch.DestroyFence(device, fence, nullptr);
+	for(VkCommandPool pool : {dev.transferPool, dev.graphicsPool})
+	{
+		if(pool != VK_NULL_HANDLE)
+			dev.dispatch.DestroyCommandPool(device, pool, nullptr);
+	}
+	auto stagingStats = dev.staging.stats();
+	dev.logger->info("Staging statistics: {} allocations, {} of them dedicated",
+		stagingStats.allocations, stagingStats.dedicated);
+	dev.staging.destroy();
+	dev.save_pipeline_cache();
+	dev.inst->devices.erase(device);
 }
 
 VK_LAYER_EXPORT VkResult VKAPI_CALL CheekyLayer_EnumerateInstanceLayerProperties(uint32_t *pPropertyCount, VkLayerProperties *pProperties)
@@ -1,16 +1,24 @@
 #include "objects.hpp"
 #include "constants.hpp"
-#include "rules/reader.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <fmt/core.h>
+#include <fstream>
+#include <poll.h>
 #include <spdlog/async.h>
 #include <spdlog/common.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/cfg/helpers.h>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #include <vulkan/vulkan_core.h>
 
 namespace CheekyLayer {
@@ -38,6 +46,8 @@ instance::instance(const VkInstanceCreateInfo *pCreateInfo, VkInstance* pInstanc
 		applicationName = pCreateInfo->pApplicationInfo->pApplicationName;
 	if(pCreateInfo->pApplicationInfo && pCreateInfo->pApplicationInfo->pEngineName)
 		engineName = pCreateInfo->pApplicationInfo->pEngineName;
+	if(pCreateInfo->pApplicationInfo && pCreateInfo->pApplicationInfo->apiVersion)
+		apiVersion = pCreateInfo->pApplicationInfo->apiVersion;
 
     enabled = config.application.empty() || config.application == applicationName;
 
@@ -79,37 +89,150 @@ instance::instance(const VkInstanceCreateInfo *pCreateInfo, VkInstance* pInstanc
 		}
 	}
 
-    std::ifstream rulesIn(config.rule_file);
-    CheekyLayer::rules::numbered_streambuf numberer{rulesIn};
-    while(rulesIn.good())
-    {
-        try
-        {
-            std::unique_ptr<CheekyLayer::rules::rule> rule = std::make_unique<CheekyLayer::rules::rule>();
-            rulesIn >> *rule;
+    global_context.async.configure(config.async_workers, config.async_queue_size);
+    imageCache.configure(config.image_cache_size << 20,
+        config.image_cache_spill ? std::optional{config.dump_directory / "image_cache"} : std::nullopt);
+    std::erase_if(config.async_actions, [this](const std::string& name){
+        if(rules::is_async_action(name))
+            return false;
+        logger->error("Ignoring \"{}\" in asyncActions, because it is not an action that can be executed asynchronously", name);
+        return true;
+    });
+    global_context.profile_rules = config.profile_rules;
 
-            rules.push_back(std::move(rule));
-        }
-        catch(const std::exception& ex)
-        {
-            logger->error("Error at {}:{}: {}", numberer.line(), numberer.col(), ex.what());
-            break;
-        }
-    }
+    // nobody can read the rules yet, so publishing never has to wait here
+    auto parsed = rules::parse_ruleset(config.rule_file, *logger, config.async_actions);
+    rules.publish(parsed.rules);
 
-    logger->info("Loaded {} rules:", rules.size());
-	for(auto& r : rules)
+    logger->info("Loaded {} rules:", parsed.rules->rules.size());
+	for(auto& r : parsed.rules->rules)
 	{
 		std::ostringstream oss;
         r->print(oss);
         logger->info("{}", oss.str());
 	}
     logger->flush();
+
+    rulesReloader = std::jthread([this](std::stop_token stop){
+        watch_rules(stop);
+    });
+
+    if(!config.image_prefetch_manifest.empty()) {
+        prefetchManifest = image_file_cache::read_manifest(config.image_prefetch_manifest);
+        logger->info("Found {} images to prefetch in {}", prefetchManifest.size(), config.image_prefetch_manifest.string());
+#ifdef USE_IMAGE_TOOLS
+        if(!prefetchManifest.empty()) {
+            imagePrefetcher = std::jthread([this](std::stop_token stop){
+                prefetch_images(stop);
+            });
+        }
+#endif
+    }
+}
+
+void instance::prefetch_images(std::stop_token stop) {
+#ifdef USE_IMAGE_TOOLS
+    // only a nice value for this thread, it should not take CPU time from the application
+    setpriority(PRIO_PROCESS, gettid(), 19);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    uint64_t evictions = imageCache.stats().evictions;
+    size_t count = 0;
+    for(const auto& k : prefetchManifest) {
+        if(stop.stop_requested())
+            break;
+        // the manifest is ordered by first use, so everything after this would evict what is needed sooner
+        if(imageCache.stats().evictions != evictions) {
+            logger->info("Stopped prefetching images, because the image cache is full");
+            break;
+        }
+
+        std::error_code ec;
+        if(!std::filesystem::exists(k.filename, ec))
+            continue;
+        try {
+            imageCache.get(k, [&k](){
+                return transcode_png(k, 1); // a single thread, like the prefetcher itself
+            }, true);
+            count++;
+        } catch(const std::exception& ex) {
+            logger->warn("Failed to prefetch {}: {}", k.filename, ex.what());
+        }
+    }
+    logger->info("Prefetched {} images in {} ms", count,
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - t0).count());
+#endif
+}
+
+void instance::reload_rules() {
+    auto parsed = rules::parse_ruleset(config.rule_file, *logger, config.async_actions);
+    if(!parsed.complete) {
+        logger->warn("Keeping the current rules, because {} contains errors", config.rule_file.string());
+        return;
+    }
+
+    auto previous = rules.current();
+    parsed.rules->migrate_from(*previous);
+    previous = rules.publish(parsed.rules);
+    previous->retire();
+
+    logger->info("Reloaded {} rules from {} (generation {})", parsed.rules->rules.size(), config.rule_file.string(), parsed.rules->generation);
+    logger->flush();
+}
+
+void instance::watch_rules(std::stop_token stop) {
+    int fd = -1;
+    std::string filename = config.rule_file.filename();
+    if(config.reload_rules) {
+        std::filesystem::path directory = config.rule_file.parent_path();
+        if(directory.empty())
+            directory = ".";
+
+        // watch the directory instead of the file, editors usually replace the file instead of writing to it
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            logger->error("Cannot watch {} for changes: {}", directory.string(), strerror(errno));
+            if(fd >= 0)
+                close(fd);
+            fd = -1;
+        }
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    while(!stop.stop_requested()) {
+        pollfd pfd{.fd = fd, .events = POLLIN};
+        poll(&pfd, fd >= 0 ? 1 : 0, 100);
+
+        bool changed = false;
+        if(fd >= 0 && (pfd.revents & POLLIN)) {
+            ssize_t len;
+            while((len = read(fd, buffer, sizeof(buffer))) > 0) {
+                for(char* p = buffer; p < buffer + len; ) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if(event->len > 0 && filename == event->name)
+                        changed = true;
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        if(changed || reloadRequested.exchange(false)) {
+            try {
+                reload_rules();
+            } catch(const std::exception& ex) {
+                logger->error("Failed to reload rules: {}", ex.what());
+            }
+        }
+    }
+
+    if(fd >= 0)
+        close(fd);
 }
 
 instance& instance::operator=(instance&& other) {
     id = other.id;
     handle = other.handle;
+    apiVersion = other.apiVersion;
     dispatch = std::move(other.dispatch);
     config = std::move(other.config);
     enabled = other.enabled;
@@ -118,8 +241,11 @@ instance& instance::operator=(instance&& other) {
     dumpCache = std::move(other.dumpCache);
     logger = std::move(other.logger);
     rules = std::move(other.rules);
+    reloadRequested = other.reloadRequested.load();
     has_rules = std::move(other.has_rules);
+    presentCount = other.presentCount.load();
     devices = std::move(other.devices);
+    prefetchManifest = std::move(other.prefetchManifest);
     return *this;
 }
 
@@ -139,7 +265,8 @@ void instance::execute_rules(rules::selector_type type, rules::VkHandle handle,
         .local_variables = ctx.local_variables,
         .customPointer = ctx.customPointer,
     };
-    rules::execute_rules(rules, type, handle, global_context, local);
+    auto reader = rules.read();
+    rules::execute_rules(*reader, type, handle, global_context, local);
 }
 
 device::device(instance* inst, PFN_vkGetDeviceProcAddr gdpa, VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo, VkDevice *pDevice)
@@ -157,6 +284,17 @@ device::device(instance* inst, PFN_vkGetDeviceProcAddr gdpa, VkPhysicalDevice ph
 
     has_debug = gdpa(*pDevice, "vkSetDebugUtilsObjectNameEXT");
     logger->info(has_debug ? "Device has debug utils" : "Device does not have debug utils");
+
+    has_creation_feedback = std::min(inst->apiVersion, props.apiVersion) >= VK_API_VERSION_1_3;
+    for(uint32_t i=0; i<pCreateInfo->enabledExtensionCount; i++) {
+        if(std::string_view(pCreateInfo->ppEnabledExtensionNames[i]) == VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)
+            has_creation_feedback = true;
+    }
+
+    workers.configure(inst->config.device_workers, inst->config.device_queue_size);
+    staging.configure(this, inst->config.staging_ring_size << 20);
+    uploads.configure(this, std::chrono::microseconds(inst->config.upload_batch_window));
+    readbacks.configure(this, inst->config.readback_max_in_flight, inst->config.readback_downscale, inst->config.readback_tonemap);
 }
 
 void device::execute_rules(rules::selector_type type, rules::VkHandle handle, rules::calling_context& ctx) {
@@ -175,7 +313,8 @@ void device::execute_rules(rules::selector_type type, rules::VkHandle handle, ru
         .local_variables = ctx.local_variables,
         .customPointer = ctx.customPointer,
     };
-    rules::execute_rules(inst->rules, type, handle, inst->global_context, local);
+    auto reader = inst->rules.read();
+    rules::execute_rules(*reader, type, handle, inst->global_context, local);
 }
 
 void device::put_hash(rules::VkHandle handle, std::string hash) {
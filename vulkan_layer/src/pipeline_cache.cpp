@@ -0,0 +1,122 @@
+#include "objects.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace CheekyLayer {
+
+static std::vector<uint8_t> read_pipeline_cache_file(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if(!in.good())
+        return {};
+
+    std::vector<uint8_t> data(in.tellg());
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(data.data()), data.size());
+    if(!in.good())
+        return {};
+    return data;
+}
+
+bool device::pipeline_cache_compatible(const std::vector<uint8_t>& data) {
+    if(data.size() < sizeof(VkPipelineCacheHeaderVersionOne))
+        return false;
+
+    VkPipelineCacheHeaderVersionOne header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    return header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == props.vendorID
+        && header.deviceID == props.deviceID
+        && std::equal(std::begin(header.pipelineCacheUUID), std::end(header.pipelineCacheUUID), std::begin(props.pipelineCacheUUID));
+}
+
+void device::load_pipeline_cache() {
+    if(!inst->config.pipeline_cache)
+        return;
+
+    // the driver version is part of the key, because drivers are allowed to keep the same cache UUID across updates
+    std::string uuid;
+    for(uint8_t b : props.pipelineCacheUUID)
+        uuid += fmt::format("{:02x}", b);
+    pipelineCachePath = inst->config.dump_directory / "pipeline_cache" /
+        fmt::format("{}-{:04x}-{:04x}-{:08x}.bin", uuid, props.vendorID, props.deviceID, props.driverVersion);
+
+    std::vector<uint8_t> data = read_pipeline_cache_file(pipelineCachePath);
+    if(!data.empty() && !pipeline_cache_compatible(data)) {
+        logger->warn("Ignoring incompatible pipeline cache {}", pipelineCachePath.string());
+        data.clear();
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+    if(dispatch.CreatePipelineCache(handle, &createInfo, nullptr, &layerPipelineCache) != VK_SUCCESS) {
+        logger->error("Failed to create pipeline cache");
+        layerPipelineCache = VK_NULL_HANDLE;
+        return;
+    }
+    logger->info("Created layer pipeline cache {} with {} bytes from {}", fmt::ptr(layerPipelineCache), data.size(), pipelineCachePath.string());
+}
+
+void device::save_pipeline_cache() {
+    if(layerPipelineCache == VK_NULL_HANDLE)
+        return;
+
+    logger->info("Pipeline cache statistics: {} hits, {} misses, {} without feedback",
+        pipelineCacheStats.hits.load(), pipelineCacheStats.misses.load(), pipelineCacheStats.unknown.load());
+
+    // another process might have written the file since we loaded it, so merge its current content into ours first
+    std::vector<uint8_t> onDisk = read_pipeline_cache_file(pipelineCachePath);
+    if(!onDisk.empty() && pipeline_cache_compatible(onDisk)) {
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = onDisk.size();
+        createInfo.pInitialData = onDisk.data();
+
+        VkPipelineCache other;
+        if(dispatch.CreatePipelineCache(handle, &createInfo, nullptr, &other) == VK_SUCCESS) {
+            if(dispatch.MergePipelineCaches(handle, layerPipelineCache, 1, &other) != VK_SUCCESS)
+                logger->warn("Failed to merge pipeline cache from {}", pipelineCachePath.string());
+            dispatch.DestroyPipelineCache(handle, other, nullptr);
+        }
+    }
+
+    size_t size = 0;
+    std::vector<uint8_t> data;
+    if(dispatch.GetPipelineCacheData(handle, layerPipelineCache, &size, nullptr) == VK_SUCCESS) {
+        data.resize(size);
+        if(dispatch.GetPipelineCacheData(handle, layerPipelineCache, &size, data.data()) != VK_SUCCESS)
+            data.clear();
+        data.resize(size);
+    }
+
+    if(!data.empty()) {
+        try {
+            std::filesystem::create_directories(pipelineCachePath.parent_path());
+
+            // write to a temporary file first, so a crash never leaves a truncated cache behind
+            std::filesystem::path tmp = pipelineCachePath;
+            tmp += fmt::format(".{}.tmp", getpid());
+            {
+                std::ofstream out(tmp, std::ios::binary);
+                out.write(reinterpret_cast<const char*>(data.data()), data.size());
+            }
+            std::filesystem::rename(tmp, pipelineCachePath);
+            logger->info("Saved {} bytes of pipeline cache to {}", data.size(), pipelineCachePath.string());
+        } catch(const std::filesystem::filesystem_error& ex) {
+            logger->error("Failed to save pipeline cache: {}", ex.what());
+        }
+    }
+
+    dispatch.DestroyPipelineCache(handle, layerPipelineCache, nullptr);
+    layerPipelineCache = VK_NULL_HANDLE;
+}
+
+}
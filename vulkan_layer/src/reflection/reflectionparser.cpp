@@ -3,6 +3,8 @@
 
 #include <any>
 #include <algorithm>
+#include <bit>
+#include <cstring>
 #include <cstdint>
 #include <sstream>
 #include <stdexcept>
@@ -61,7 +63,24 @@ namespace CheekyLayer { namespace reflection {
 			throw std::runtime_error("cannot set type \""+type+"\"");
 	}
 
-	std::any parse_get(std::string path, const void* p, std::string type)
+	primitive_kind classify(const std::string& type)
+	{
+		if(type=="uint32_t")
+			return primitive_kind::UInt32;
+		if(type=="int32_t")
+			return primitive_kind::Int32;
+		if(type=="VkBool32")
+			return primitive_kind::Bool32;
+		if(type=="float")
+			return primitive_kind::Float;
+		if(enum_reflection_map.contains(type)) // all enums can be returned as an uint32_t
+			return primitive_kind::Enum;
+		if(type.ends_with("Flags"))
+			return primitive_kind::Flags;
+		return primitive_kind::None;
+	}
+
+	void compile_steps(compiled_path& out, std::string path, const std::string& type)
 	{
 		auto a = path.find("->");
 		auto b = path.find(".");
@@ -70,33 +89,34 @@ namespace CheekyLayer { namespace reflection {
 
 		std::string first = path.substr(0, min);
 
-		VkReflectInfo info = struct_reflection_map[type].members[first];
-		if(info.name != first)
+		auto typeInfo = struct_reflection_map.find(type);
+		if(typeInfo == struct_reflection_map.end())
+			throw std::runtime_error("cannot find member \""+first+"\" for type \""+type+"\"");
+		auto member = typeInfo->second.members.find(first);
+		if(member == typeInfo->second.members.end())
 			throw std::runtime_error("cannot find member \""+first+"\" for type \""+type+"\"");
+		const VkReflectInfo& info = member->second;
 
-		const void* op = ((const uint8_t*)p) + info.offset;
+		path_step step{.offset = info.offset, .name = info.name};
+		std::string rest;
 		if(min == std::string::npos)
 		{
-			if(!is_primitive(info.type))
-				throw std::runtime_error("cannot return non-primitive and non-enum type \""+info.type+"\"");
-			return create_type(op, info.type);
+			out.type = info.type;
 		}
 		else if(a < b && a < c)
 		{
 			if(!info.pointer)
 				throw std::runtime_error("path refered to non-pointer member \""+info.name+"\" of type \""+type+"\"with '->'");
 
-			const void* np = *((const void**)op);
-			std::string rest = path.substr(min+2);
-			return parse_get(rest, np, info.type);
+			step.deref = true;
+			rest = path.substr(min+2);
 		}
 		else if(b < a && b < c)
 		{
 			if(info.pointer)
 				throw std::runtime_error("path refered to pointer member \""+info.name+"\" of type \""+type+"\" with '.'");
 
-			std::string rest = path.substr(min+1);
-			return parse_get(rest, op, info.type);
+			rest = path.substr(min+1);
 		}
 		else if(c < a && c < b)
 		{
@@ -104,122 +124,170 @@ namespace CheekyLayer { namespace reflection {
 				throw std::runtime_error("path refered to non-array member with \""+info.name+"\" of type \""+type+"\" with '[i]'");
 			auto e = path.find("]", c);
 
-			int i = std::stoi(path.substr(c+1, e-c-1));
-			int length = std::any_cast<uint32_t>(parse_get(info.arrayLength, p, type));
-
-			if(i >= length)
-				throw std::runtime_error("array index "+std::to_string(i)+" for member \""+info.name+"\" exceeds its length of "
-					+std::to_string(length)+" which can be found in member \""+info.arrayLength+"\"");
-
-			const void* np = *((const void**)op);
-			const void* ap = ((uint8_t*)np) + i * struct_reflection_map[info.type].size;
-			std::string rest = path.substr(e+2);
-			return parse_get(rest, ap, info.type);
+			step.deref = true;
+			step.index = std::stoi(path.substr(c+1, e-c-1));
+			step.lengthName = info.arrayLength;
+			if(is_primitive(info.type))
+				step.stride = sizeof(uint32_t); // all primitives we know are 32-bit wide
+			else if(auto element = struct_reflection_map.find(info.type); element != struct_reflection_map.end())
+				step.stride = element->second.size;
+			else
+				throw std::runtime_error("cannot index member \""+info.name+"\" of type \""+type+"\", because the size of its element type \""+info.type+"\" is unknown");
+
+			// only plain uint32_t siblings can be used as length, everything else fails when the path is resolved
+			auto length = typeInfo->second.members.find(info.arrayLength);
+			if(length != typeInfo->second.members.end() && !length->second.pointer && length->second.type == "uint32_t")
+				step.lengthOffset = length->second.offset;
+
+			if(e+1 < path.size())
+				rest = path.substr(e+2);
+			else
+				out.type = info.type;
 		}
 		else std::abort();
-	}
 
-	std::string parse_get_type(std::string path, std::string type)
-	{
-		auto a = path.find("->");
-		auto b = path.find(".");
-		auto c = path.find("[");
-		auto min = std::min(a, std::min(b, c));
-
-		std::string first = path.substr(0, min);
-
-		VkReflectInfo info = struct_reflection_map[type].members[first];
-		if(info.name != first)
-			throw std::runtime_error("cannot find member \""+first+"\" for type \""+type+"\"");
-
-		if(min == std::string::npos)
+		// consecutive '.' accesses only add up offsets, so we can fold them into the next step
+		if(!out.steps.empty() && !out.steps.back().deref)
 		{
-			return info.type;
+			int base = out.steps.back().offset;
+			step.offset += base;
+			if(step.lengthOffset >= 0)
+				step.lengthOffset += base;
+			out.steps.back() = step;
 		}
-		else if(a < b && a < c)
+		else
 		{
-			if(!info.pointer)
-				throw std::runtime_error("path refered to non-pointer member \""+info.name+"\" of type \""+type+"\"with '->'");
-
-			std::string rest = path.substr(min+2);
-			return parse_get_type(rest, info.type);
+			out.steps.push_back(step);
 		}
-		else if(b < a && b < c)
-		{
-			if(info.pointer)
-				throw std::runtime_error("path refered to pointer member \""+info.name+"\" of type \""+type+"\" with '.'");
 
-			std::string rest = path.substr(min+1);
-			return parse_get_type(rest, info.type);
-		}
-		else if(c < a && c < b)
+		if(!rest.empty())
+			compile_steps(out, rest, info.type);
+	}
+
+	compiled_path compile_path(std::string path, std::string type)
+	{
+		compiled_path out{.path = path};
+		compile_steps(out, path, type);
+		out.kind = classify(out.type);
+		return out;
+	}
+
+	const void* compiled_path::resolve(const void* p) const
+	{
+		const uint8_t* base = static_cast<const uint8_t*>(p);
+		for(const path_step& step : steps)
 		{
-			if(!info.array)
-				throw std::runtime_error("path refered to non-array member with \""+info.name+"\" of type \""+type+"\" with '[i]'");
-			auto e = path.find("]", c);
+			const uint8_t* member = base + step.offset;
+			if(!step.deref)
+			{
+				base = member;
+				continue;
+			}
 
-			std::string rest = path.substr(e+2);
-			return parse_get_type(rest, info.type);
+			if(step.index >= 0)
+			{
+				if(step.lengthOffset < 0)
+					throw std::runtime_error("cannot check the length of member \""+step.name+"\" which is given by \""+step.lengthName+"\"");
+				uint32_t length = *reinterpret_cast<const uint32_t*>(base + step.lengthOffset);
+				if(static_cast<uint32_t>(step.index) >= length)
+					throw std::runtime_error("array index "+std::to_string(step.index)+" for member \""+step.name+"\" exceeds its length of "
+						+std::to_string(length)+" which can be found in member \""+step.lengthName+"\"");
+			}
+
+			base = *reinterpret_cast<const uint8_t* const*>(member);
+			if(base == nullptr)
+				throw std::runtime_error("member \""+step.name+"\" of path \""+path+"\" is a null pointer");
+			if(step.index > 0)
+				base += step.index * step.stride;
 		}
-		else std::abort();
+		return base;
 	}
 
-	void parse_set(std::string path, void* p, std::string type, std::any value)
+	void* compiled_path::resolve(void* p) const
 	{
-		auto a = path.find("->");
-		auto b = path.find(".");
-		auto c = path.find("[");
-		auto min = std::min(a, std::min(b, c));
+		return const_cast<void*>(resolve(static_cast<const void*>(p)));
+	}
 
-		std::string first = path.substr(0, min);
+	uint32_t compiled_path::get_raw(const void* p) const
+	{
+		if(kind == primitive_kind::None)
+			throw std::runtime_error("cannot return non-primitive and non-enum type \""+type+"\"");
+		uint32_t bits;
+		std::memcpy(&bits, resolve(p), sizeof(bits));
+		return bits;
+	}
 
-		VkReflectInfo info = struct_reflection_map[type].members[first];
-		if(info.name != first)
-			throw std::runtime_error("cannot find member \""+first+"\" for type \""+type+"\"");
+	void compiled_path::set_raw(void* p, uint32_t bits) const
+	{
+		if(kind == primitive_kind::None)
+			throw std::runtime_error("cannot assign non-primitive and non-enum type \""+type+"\"");
+		std::memcpy(resolve(p), &bits, sizeof(bits));
+	}
 
-		void* op = ((uint8_t*)p) + info.offset;
-		if(min == std::string::npos)
+	std::any compiled_path::get(const void* p) const
+	{
+		if(kind == primitive_kind::None)
+			throw std::runtime_error("cannot return non-primitive and non-enum type \""+type+"\"");
+		return create_type(resolve(p), type);
+	}
+
+	void compiled_path::set(void* p, std::any value) const
+	{
+		if(kind == primitive_kind::None)
+			throw std::runtime_error("cannot assign non-primitive and non-enum type \""+type+"\"");
+		set_type(resolve(p), type, value);
+	}
+
+	double compiled_path::get_number(const void* p) const
+	{
+		uint32_t bits = get_raw(p);
+		switch(kind)
 		{
-			if(!is_primitive(info.type))
-				throw std::runtime_error("cannot assign non-primitive and non-enum type \""+info.type+"\"");
-			set_type(op, info.type, value);
+			case primitive_kind::Int32:
+				return std::bit_cast<int32_t>(bits);
+			case primitive_kind::Float:
+				return std::bit_cast<float>(bits);
+			default:
+				return bits;
 		}
-		else if(a < b && a < c)
-		{
-			if(!info.pointer)
-				throw std::runtime_error("path refered to non-pointer member \""+info.name+"\" of type \""+type+"\"with '->'");
+	}
 
-			void* np = *((void**)op);
-			std::string rest = path.substr(min+2);
-			parse_set(rest, np, info.type, value);
-		}
-		else if(b < a && b < c)
+	std::string enum_to_string(uint32_t value, std::string type);
+	std::string compiled_path::get_string(const void* p) const
+	{
+		switch(kind)
 		{
-			if(info.pointer)
-				throw std::runtime_error("path refered to pointer member \""+info.name+"\" of type \""+type+"\" with '.'");
-
-			std::string rest = path.substr(min+1);
-			parse_set(rest, op, info.type, value);
+			case primitive_kind::UInt32:
+				return std::to_string(get_raw(p));
+			case primitive_kind::Int32:
+				return std::to_string(std::bit_cast<int32_t>(get_raw(p)));
+			case primitive_kind::Bool32:
+				return get_raw(p) == VK_TRUE ? "VK_TRUE" : "VK_FALSE";
+			case primitive_kind::Enum:
+				return enum_to_string(get_raw(p), type);
+			default:
+				throw std::runtime_error("cannot make a string out of type \""+type+"\"");
 		}
-		else if(c < a && c < b)
-		{
-			if(!info.array)
-				throw std::runtime_error("path refered to non-array member with \""+info.name+"\" of type \""+type+"\" with '[i]'");
-			auto e = path.find("]", c);
+	}
 
-			int i = std::stoi(path.substr(c+1, e-c-1));
-			int length = std::any_cast<uint32_t>(parse_get(info.arrayLength, p, type));
+	void compiled_assignment::apply(void* p) const
+	{
+		target.set_raw(p, bits);
+	}
 
-			if(i >= length)
-				throw std::runtime_error("array index "+std::to_string(i)+" for member \""+info.name+"\" exceeds its length of "
-					+std::to_string(length)+" which can be found in member \""+info.arrayLength+"\"");
+	std::any parse_get(std::string path, const void* p, std::string type)
+	{
+		return compile_path(path, type).get(p);
+	}
 
-			void* np = *((void**)op);
-			void* ap = ((uint8_t*)np) + i * struct_reflection_map[info.type].size;
-			std::string rest = path.substr(e+2);
-			return parse_set(rest, ap, info.type, value);
-		}
-		else std::abort();
+	std::string parse_get_type(std::string path, std::string type)
+	{
+		return compile_path(path, type).type;
+	}
+
+	void parse_set(std::string path, void* p, std::string type, std::any value)
+	{
+		compile_path(path, type).set(p, value);
 	}
 
 	std::any convert(std::any in, std::string type);
@@ -229,7 +297,8 @@ namespace CheekyLayer { namespace reflection {
 		{
 			size_t index;
 			long l = std::stol(expression, &index, 10);
-			return l;
+			if(index == expression.size())
+				return l;
 		}
 		catch (const std::invalid_argument& ex) {}
 		try
@@ -289,6 +358,8 @@ namespace CheekyLayer { namespace reflection {
 		{
 			if(type=="uint32_t" || type=="VkBool32" || type.ends_with("Flags"))
 				return (uint32_t)std::any_cast<long>(in);
+			if(type=="int32_t")
+				return (int32_t)std::any_cast<long>(in);
 			if(type=="float")
 				return (float)std::any_cast<long>(in);
 		}
@@ -308,7 +379,7 @@ namespace CheekyLayer { namespace reflection {
 		throw std::runtime_error("cannot convert from type \""+std::string(in.type().name())+"\" to type \""+type+"\"");
 	}
 
-	void parse_assign(std::string expression, void* p, std::string type)
+	compiled_assignment compile_assign(std::string expression, std::string type)
 	{
 		auto delim = expression.find("=");
 		std::string left = expression.substr(0, delim);
@@ -317,11 +388,23 @@ namespace CheekyLayer { namespace reflection {
 		left.erase(std::remove_if(left.begin(), left.end(), isspace), left.end());
 		right.erase(std::remove_if(right.begin(), right.end(), isspace), right.end());
 
-		std::string ltype = parse_get_type(left, type);
+		compiled_assignment out{.expression = expression, .target = compile_path(left, type)};
+		if(out.target.kind == primitive_kind::None)
+			throw std::runtime_error("cannot assign non-primitive and non-enum type \""+out.target.type+"\"");
+
+		std::any converted = convert(parse_rvalue(right, nullptr, out.target.type), out.target.type);
+		if(converted.type() == typeid(float))
+			out.bits = std::bit_cast<uint32_t>(std::any_cast<float>(converted));
+		else if(converted.type() == typeid(int32_t))
+			out.bits = std::bit_cast<uint32_t>(std::any_cast<int32_t>(converted));
+		else
+			out.bits = std::any_cast<uint32_t>(converted);
+		return out;
+	}
 
-		std::any rvalue = parse_rvalue(right, p, ltype);
-		std::any converted = convert(rvalue, ltype);
-		parse_set(left, p, type, converted);
+	void parse_assign(std::string expression, void* p, std::string type)
+	{
+		compile_assign(expression, type).apply(p);
 	}
 
 	std::string enum_to_string(uint32_t value, std::string type)
@@ -338,18 +421,6 @@ namespace CheekyLayer { namespace reflection {
 
 	std::string parse_get_string(std::string path, const void* p, std::string type)
 	{
-		std::string rtype = parse_get_type(path, type);
-		std::any value = parse_get(path, p, type);
-
-		if(rtype=="uint32_t")
-			return std::to_string(std::any_cast<uint32_t>(value));
-		if(rtype=="int32_t")
-			return std::to_string(std::any_cast<int32_t>(value));
-		if(rtype=="VkBool32")
-			return std::any_cast<VkBool32>(value) == VK_TRUE ? "VK_TRUE" : "VK_FALSE";
-		if(enum_reflection_map.contains(rtype))
-			return enum_to_string(std::any_cast<uint32_t>(value), rtype);
-
-		throw std::runtime_error("cannot make a string out of type \""+rtype+"\"");
+		return compile_path(path, type).get_string(p);
 	}
 }}
@@ -3,20 +3,23 @@
 #include "layer.hpp"
 #include "rules/execution_env.hpp"
 #include "rules/rules.hpp"
+#include "capture_ring.hpp"
 #include "objects.hpp"
+#include "texture_file.hpp"
 #include "utils.hpp"
 
-#include <condition_variable>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <experimental/iterator>
 #include <ranges>
-#include <glm/gtc/packing.hpp>
+#include <vk_format_utils.h>
 
 #ifdef USE_IMAGE_TOOLS
 #include <block_compression.hpp>
 #include <image.hpp>
 
 #include <stb_image.h>
-#include <stb_image_write.h>
 #endif
 
 namespace CheekyLayer::rules::actions
@@ -25,10 +28,14 @@ namespace CheekyLayer::rules::actions
 	action_register<unmark_action> unmark_action::reg("unmark");
 	action_register<verbose_action> verbose_action::reg("verbose");
 	action_register<sequence_action> sequence_action::reg("seq");
+	action_register<async_action> async_action::reg("async");
 	action_register<each_action> each_action::reg("each");
 	action_register<on_action> on_action::reg("on");
 	action_register<disable_action> disable_action::reg("disable");
 	action_register<cancel_action> cancel_action::reg("cancel");
+	action_register<reload_rules_action> reload_rules_action::reg("reload_rules");
+	action_register<profile_reset_action> profile_reset_action::reg("profile_reset");
+	action_register<fire_action> fire_action::reg("fire");
 	action_register<log_action> log_action::reg("log");
 	action_register<log_extended_action> log_extended_action::reg("logx");
 	action_register<override_action> override_action::reg("override");
@@ -37,11 +44,14 @@ namespace CheekyLayer::rules::actions
 	action_register<write_action> write_action::reg("write");
 	action_register<load_image_action> load_image_action::reg("load_image");
 	action_register<preload_image_action> preload_image_action::reg("preload_image");
-	action_register<dump_framebuffer_action> dump_framebuffer_action::reg("dumbfb");
+	action_register<dump_framebuffer_action> dump_framebuffer_action::reg("dumpfb");
+	action_register<dump_framebuffer_action> dump_framebuffer_action::reg2("dumbfb");
+	action_register<capture_framebuffer_action> capture_framebuffer_action::reg("capturefb");
 	action_register<every_action> every_action::reg("every");
 	action_register<buffer_copy_action> buffer_copy_action::reg("buffer_copy");
 	action_register<set_global_action> set_global_action::reg("set_global");
 	action_register<set_global_action> set_global_action::reg2("global=");
+	action_register<compare_and_set_global_action> compare_and_set_global_action::reg("global_cas");
 	action_register<set_local_action> set_local_action::reg("set_local");
 	action_register<set_local_action> set_local_action::reg2("local=");
 	action_register<thread_action> thread_action::reg("thread");
@@ -120,6 +130,134 @@ namespace CheekyLayer::rules::actions
 		}
 	}
 
+	bool sequence_action::async_safe()
+	{
+		return std::all_of(m_actions.begin(), m_actions.end(), [](auto& a){ return a->async_safe(); });
+	}
+
+	std::string sequence_action::async_key()
+	{
+		for(auto& a : m_actions)
+		{
+			std::string key = a->async_key();
+			if(!key.empty())
+				return key;
+		}
+		return "";
+	}
+
+	void async_action::execute(selector_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
+	{
+		// the rule and the logger are kept alive along with everything else the task needs, the device
+		// cancels its tasks before it is destroyed and the instance joins the executor before it is gone
+		struct snapshot
+		{
+			std::optional<additional_info> info;
+			std::vector<uint8_t> received;
+			std::string customTag;
+			variable_map variables;
+			void* customPointer;
+			std::shared_ptr<ruleset> keep;
+			std::shared_ptr<CheekyLayer::rules::rule> rule;
+			std::shared_ptr<spdlog::logger> logger;
+		};
+		std::shared_ptr<ruleset> keep = local.keep_rules_alive();
+		auto s = std::make_shared<snapshot>(snapshot{
+			.customTag = local.customTag,
+			.variables = local.snapshot_variables(),
+			.customPointer = local.customPointer,
+			.keep = keep,
+			.rule = std::shared_ptr<CheekyLayer::rules::rule>(keep, &rule),
+			.logger = local.device ? local.device->logger : local.instance->logger,
+		});
+
+		// receive buffers with an owner stay alive on their own, everything else only lives as long as the Vulkan call
+		if(local.info && std::holds_alternative<receive_info>(*local.info))
+		{
+			receive_info info = std::get<receive_info>(*local.info);
+			if(!info.owner)
+			{
+				s->received.assign(info.buffer, info.buffer + info.size);
+				info.buffer = s->received.data();
+			}
+			s->info = info;
+		}
+
+		CheekyLayer::instance* instance = local.instance;
+		CheekyLayer::device* device = local.device;
+		VkCommandBuffer commandBuffer = local.commandBuffer;
+		bool queued = global.async.submit(m_action->async_key(), [this, type, handle, &global, instance, device, commandBuffer, s](){
+			calling_context ctx{
+				.info = s->info,
+				.commandBuffer = commandBuffer,
+				.customTag = s->customTag,
+				.local_variables = std::move(s->variables),
+				.customPointer = s->customPointer,
+			};
+			local_context deferred{
+				.logger = *s->logger,
+				.info = ctx.info.has_value() ? &ctx.info.value() : nullptr,
+				.instance = instance,
+				.device = device,
+				.commandBuffer = ctx.commandBuffer,
+				.commandBufferState = nullptr,
+				.canceled = ctx.canceled,
+				.overrides = ctx.overrides,
+				.customTag = ctx.customTag,
+				.creationCallbacks = ctx.creationCallbacks,
+				.local_variables = ctx.local_variables,
+				.customPointer = ctx.customPointer,
+				.currentRuleset = s->keep.get(),
+			};
+			try
+			{
+				m_action->execute(type, handle, global, deferred, *s->rule);
+			}
+			catch(const std::exception& ex)
+			{
+				s->logger->error("Failed to execute async action: {}", ex.what());
+			}
+		}, device);
+		if(!queued)
+			local.logger.trace("Dropped async action, the queue is full");
+	}
+
+	void async_action::read(std::istream& in)
+	{
+		m_action = read_action(in, m_type);
+		check_stream(in, ')');
+
+		// might already be wrapped if the action is asynchronous by default
+		if(auto* inner = dynamic_cast<async_action*>(m_action.get()))
+			m_action = std::move(inner->m_action);
+
+		if(!m_action->async_safe())
+		{
+			std::ostringstream oss;
+			m_action->print(oss);
+			throw std::runtime_error("cannot execute "+oss.str()+" asynchronously, because it needs the Vulkan call that triggered it");
+		}
+	}
+
+	std::ostream& async_action::print(std::ostream& out)
+	{
+		out << "async(";
+		m_action->print(out);
+		out << ")";
+		return out;
+	}
+
+	void async_action::migrate(action& previous)
+	{
+		if(auto* p = dynamic_cast<async_action*>(&previous))
+			m_action->migrate(*p->m_action);
+	}
+
+	void async_action::retire()
+	{
+		m_action->retire();
+	}
+
 	void sequence_action::read(std::istream& in)
 	{
 		while(in.peek() != ')')
@@ -150,6 +288,21 @@ namespace CheekyLayer::rules::actions
 		return out;
 	}
 
+	void sequence_action::migrate(action& previous)
+	{
+		auto* p = dynamic_cast<sequence_action*>(&previous);
+		if(!p || p->m_actions.size() != m_actions.size())
+			return;
+		for(size_t i=0; i<m_actions.size(); i++)
+			m_actions[i]->migrate(*p->m_actions[i]);
+	}
+
+	void sequence_action::retire()
+	{
+		for(auto& a : m_actions)
+			a->retire();
+	}
+
 	void each_action::execute(selector_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
 		std::vector<VkHandle> handles;
@@ -206,42 +359,59 @@ namespace CheekyLayer::rules::actions
 		return out;
 	}
 
+	void each_action::migrate(action& previous)
+	{
+		if(auto* p = dynamic_cast<each_action*>(&previous))
+			m_action->migrate(*p->m_action);
+	}
+
+	void each_action::retire()
+	{
+		m_action->retire();
+	}
+
 	void on_action::execute(selector_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		if(!local.commandBuffer)
+		command_buffer_state* state = local.commandBufferState;
+		if(!state && local.commandBuffer && local.device)
+		{
+			auto it = local.device->commandBufferStates.find(local.commandBuffer);
+			if(it != local.device->commandBufferStates.end())
+				state = &it->second;
+		}
+		if(!state)
 		{
 			local.logger.error("Cannot schedule action, because CommandBuffer is not known. We will execute it right now instead.");
 			m_action->execute(type, handle, global, local, rule);
 			return;
 		}
 
-		const auto locals = local.local_variables;
+		const auto locals = local.snapshot_variables();
 		local.logger.trace("on_action: Saving locals: {}", fmt::join(locals | std::ranges::views::keys, ", "));
+		// the callbacks might only run after the rules were reloaded
+		const auto keep = local.keep_rules_alive();
 
+		command_buffer_event event;
 		switch(m_event)
 		{
 			case EndCommandBuffer:
-				global.onEndCommandBuffer(local.commandBuffer, [this, type, handle, &rule, locals, &global](local_context& ctx2){
-					local_context deref = ctx2;
-					deref.local_variables = locals;
-					this->m_action->execute(type, handle, global, deref, rule);
-				});
+				event = command_buffer_event::EndCommandBuffer;
 				break;
 			case QueueSubmit:
-				global.onQueueSubmit(local.commandBuffer, [this, type, handle, &rule, locals, &global](local_context& ctx2){
-					local_context deref = ctx2;
-					deref.local_variables = locals;
-					this->m_action->execute(type, handle, global, deref, rule);
-				});
+				event = command_buffer_event::QueueSubmit;
 				break;
 			case EndRenderPass:
-				global.onEndRenderPass(local.commandBuffer, [this, type, handle, &rule, locals, &global](local_context& ctx2){
-					local_context deref = ctx2;
-					deref.local_variables = locals;
-					this->m_action->execute(type, handle, global, deref, rule);
-				});
+				event = command_buffer_event::EndRenderPass;
 				break;
 		}
+		state->on(event, [this, type, handle, &rule, locals, &global, keep](local_context& ctx2){
+			local_context deref = ctx2;
+			deref.local_variables = locals;
+			deref.currentRuleset = keep.get();
+			this->m_action->execute(type, handle, global, deref, rule);
+		});
+		if(event == command_buffer_event::QueueSubmit && local.device)
+			local.device->pendingSubmitCallbacks++;
 	}
 
 	void on_action::read(std::istream& in)
@@ -264,6 +434,17 @@ namespace CheekyLayer::rules::actions
 		return out;
 	}
 
+	void on_action::migrate(action& previous)
+	{
+		if(auto* p = dynamic_cast<on_action*>(&previous))
+			m_action->migrate(*p->m_action);
+	}
+
+	void on_action::retire()
+	{
+		m_action->retire();
+	}
+
 	void disable_action::execute(selector_type, VkHandle, global_context&, local_context&, rule& rule)
 	{
 		rule.disable();
@@ -296,6 +477,91 @@ namespace CheekyLayer::rules::actions
 		return out;
 	}
 
+	void reload_rules_action::execute(selector_type, VkHandle, global_context&, local_context& local, rule&)
+	{
+		// the reload waits for all rules to finish, so it cannot happen right here
+		local.instance->reloadRequested = true;
+	}
+
+	void reload_rules_action::read(std::istream& in)
+	{
+		check_stream(in, ')');
+	}
+
+	std::ostream& reload_rules_action::print(std::ostream& out)
+	{
+		out << "reload_rules()";
+		return out;
+	}
+
+	void profile_reset_action::execute(selector_type, VkHandle, global_context& global, local_context& local, rule&)
+	{
+		if(!global.profile_rules)
+			throw RULE_ERROR("rule profiling is disabled, set profileRules=true");
+		profile_reset(*local.instance->rules.read());
+	}
+
+	void profile_reset_action::read(std::istream& in)
+	{
+		check_stream(in, ')');
+	}
+
+	std::ostream& profile_reset_action::print(std::ostream& out)
+	{
+		out << "profile_reset()";
+		return out;
+	}
+
+	void fire_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule)
+	{
+		// custom rules can fire each other, so stop before we run out of stack
+		static thread_local int depth = 0;
+		constexpr int max_depth = 16;
+		if(depth >= max_depth)
+			throw RULE_ERROR("custom rules fired each other more than "+std::to_string(max_depth)+" times");
+
+		calling_context ctx{
+			.info = local.info ? std::optional{*local.info} : std::nullopt,
+			.commandBuffer = local.commandBuffer,
+			.commandBufferState = local.commandBufferState,
+			.customTag = std::get<std::string>(m_tag->get(stype, data_type::String, handle, global, local, rule)),
+			.local_variables = local.snapshot_variables(),
+			.customPointer = local.customPointer,
+		};
+
+		depth++;
+		try
+		{
+			if(local.device)
+				local.device->execute_rules(selector_type::Custom, handle, ctx);
+			else
+				local.instance->execute_rules(selector_type::Custom, handle, ctx);
+		}
+		catch(...)
+		{
+			depth--;
+			throw;
+		}
+		depth--;
+	}
+
+	void fire_action::read(std::istream& in)
+	{
+		m_tag = read_data(in, m_type);
+		check_stream(in, ')');
+
+		if(!m_tag->supports(m_type, data_type::String))
+			throw RULE_ERROR("tag must support strings");
+	}
+
+	std::ostream& fire_action::print(std::ostream& out)
+	{
+		out << "fire(";
+		m_tag->print(out);
+		out << ")";
+		return out;
+	}
+
 	void log_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule&)
 	{
 		std::string s = m_text;
@@ -370,12 +636,13 @@ namespace CheekyLayer::rules::actions
 
 	void override_action::execute(selector_type, VkHandle, global_context&, local_context& local, rule &)
 	{
-		local.overrides.push_back(m_expression);
+		local.overrides.push_back(&m_assignment);
 	}
 
 	void override_action::read(std::istream& in)
 	{
 		std::getline(in, m_expression, ')');
+		m_assignment = reflection::compile_assign(m_expression, "VkGraphicsPipelineCreateInfo");
 	}
 
 	std::ostream& override_action::print(std::ostream& out)
@@ -479,7 +746,7 @@ namespace CheekyLayer::rules::actions
 		auto& fd = global.fds[m_fd];
 
 		int extra = 0;
-		if(stype == Receive || (stype == Custom && local.customTag == "connect"))
+		if(local.info && (stype == Receive || (stype == Custom && local.customTag == "connect")))
 		{
 			extra = std::get<receive_info>(*local.info).extra;
 		}
@@ -487,16 +754,14 @@ namespace CheekyLayer::rules::actions
 		if(m_data->supports(stype, data_type::Raw))
 		{
 			data_value val = m_data->get(stype, data_type::Raw, handle, global, local, rule);
-			auto& v = std::get<std::vector<uint8_t>>(val);
-			if(fd->write(v, extra) < 0)
+			if(fd->write(raw_bytes(val), extra) < 0)
 				throw RULE_ERROR("failed to send data to file descriptor \""+m_fd+"\": " + strerror(errno));
 		}
 		else if(m_data->supports(stype, data_type::String))
 		{
 			data_value val = m_data->get(stype, data_type::String, handle, global, local, rule);
 			auto& s = std::get<std::string>(val);
-			std::vector<uint8_t> v(s.begin(), s.end());
-			if(fd->write(v, extra) < 0)
+			if(fd->write(std::span<const uint8_t>((const uint8_t*)s.data(), s.size()), extra) < 0)
 				throw RULE_ERROR("failed to write data to file descriptor \""+m_fd+"\": " + strerror(errno));
 		}
 		else
@@ -530,20 +795,26 @@ namespace CheekyLayer::rules::actions
 		std::scoped_lock l(global_lock);
 		if(m_mode == mode::Data)
 		{
-			std::vector<uint8_t> data = std::get<std::vector<uint8_t>>(m_data->get(stype, data_type::Raw, handle, global, local, rule));
-			std::thread t(&load_image_action::workTry, this, std::ref(*local.device), h, std::string{}, data);
-			global.threads.push_back(std::move(t));
+			std::vector<uint8_t> data = std::get<std::vector<uint8_t>>(materialize(m_data->get(stype, data_type::Raw, handle, global, local, rule)));
+			local.device->workers.submit(worker_pool::lane::Interactive, [this, &device = *local.device, h, data = std::move(data), keep = local.keep_rules_alive()](std::stop_token stop){
+				if(!stop.stop_requested())
+					workTry(device, h, std::string{}, data);
+			});
 		}
 		else if(m_mode == mode::FileFromData)
 		{
 			std::string filename = std::get<std::string>(m_data->get(stype, data_type::String, handle, global, local, rule));
-			std::thread t(&load_image_action::workTry, this, std::ref(*local.device), h, filename, std::vector<uint8_t>{});
-			global.threads.push_back(std::move(t));
+			local.device->workers.submit(worker_pool::lane::Interactive, [this, &device = *local.device, h, filename, keep = local.keep_rules_alive()](std::stop_token stop){
+				if(!stop.stop_requested())
+					workTry(device, h, filename, {});
+			});
 		}
 		else
 		{
-			std::thread t(&load_image_action::workTry, this, std::ref(*local.device), h, m_filename, std::vector<uint8_t>{});
-			global.threads.push_back(std::move(t));
+			local.device->workers.submit(worker_pool::lane::Interactive, [this, &device = *local.device, h, keep = local.keep_rules_alive()](std::stop_token stop){
+				if(!stop.stop_requested())
+					workTry(device, h, m_filename, {});
+			});
 		}
 	}
 
@@ -564,23 +835,12 @@ namespace CheekyLayer::rules::actions
 #else
 	bool imageTools = false;
 #endif
-	// cache for preloading (must be kinda specific, because format, extent and mipLevels must match)
-	struct image_key
-	{
-		std::string filename;
-		VkFormat format;
-		uint32_t width;
-		uint32_t height;
-		uint32_t mipLevels;
-
-		auto operator<=>(const image_key&) const = default;
-	};
-	std::map<image_key, std::pair<std::vector<uint8_t>, std::vector<VkDeviceSize>>> imageFileCache;
 	void load_image_action::work(device& device, VkHandle handle, std::string optFilename, std::vector<uint8_t> optData)
 	{
-		VkResult result;
 		std::vector<uint8_t> data(16);
 		std::vector<VkDeviceSize> offsets;
+		// precompressed mip levels are copied straight from the mapped file into the staging memory
+		std::unique_ptr<texture_file> texture;
 
 		auto t0 = std::chrono::high_resolution_clock::now();
 		if(m_mode == mode::Data)
@@ -589,42 +849,22 @@ namespace CheekyLayer::rules::actions
 		}
 		else
 		{
-			if(optFilename.ends_with(".png") && imageTools)
+			if(texture_file::is_texture_file(optFilename))
+			{
+				texture = std::make_unique<texture_file>(optFilename);
+				texture->validate(device.images.at((VkImage)handle).createInfo);
+			}
+			else if(optFilename.ends_with(".png") && imageTools)
 			{
+#ifdef USE_IMAGE_TOOLS
 				VkImageCreateInfo imgInfo = device.images.at((VkImage)handle).createInfo;
-				decltype(imageFileCache.begin()->first) cacheKey = {optFilename, imgInfo.format, imgInfo.extent.width, imgInfo.extent.height, imgInfo.mipLevels};
-				if(imageFileCache.contains(cacheKey))
-				{
-					data = imageFileCache[cacheKey].first;
-					offsets = imageFileCache[cacheKey].second;
-				}
-				else
-				{
-					int w, h, comp;
-					uint8_t* buf = stbi_load(optFilename.c_str(), &w, &h, &comp, STBI_rgb_alpha);
-					image_tools::image image(w, h, buf);
-
-					if(imgInfo.mipLevels <= 1)
-					{
-						offsets.push_back(0);
-						image_tools::compress(imgInfo.format, image, data, imgInfo.extent.width, imgInfo.extent.height);
-					}
-					else
-					{
-						data.clear();
-						for(int i=0; i<imgInfo.mipLevels; i++)
-						{
-							offsets.push_back(data.size());
-
-							std::vector<uint8_t> v;
-							image_tools::compress(imgInfo.format, image, v, imgInfo.extent.width / (1<<i), imgInfo.extent.height / (1<<i));
-							std::copy(v.begin(), v.end(), std::back_inserter(data));
-						}
-					}
-
-					stbi_image_free(buf);
-					imageFileCache[cacheKey] = {data, offsets}; // do we want to store here? it needs so much RAM T_T
-				}
+				image_file_cache::key cacheKey = {optFilename, imgInfo.format, imgInfo.extent.width, imgInfo.extent.height, imgInfo.mipLevels};
+				image_file_cache::value cached = device.inst->imageCache.get(cacheKey, [&](){
+					return transcode_png(cacheKey, device.workers.threads_per_worker());
+				});
+				data = cached->data;
+				offsets = cached->offsets;
+#endif
 			}
 			else if(optFilename.find("${mip}") != std::string::npos)
 			{
@@ -659,140 +899,62 @@ namespace CheekyLayer::rules::actions
 		}
 		auto tDataReady = std::chrono::high_resolution_clock::now();
 
-		VkBufferCreateInfo bufferInfo;
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.pNext = nullptr;
-		bufferInfo.flags = 0;
-		bufferInfo.size = data.size();
-		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferInfo.queueFamilyIndexCount = 0;
-		bufferInfo.pQueueFamilyIndices = nullptr;
-		VkBuffer buffer;
-		if((result = device.dispatch.CreateBuffer(*device, &bufferInfo, nullptr, &buffer)) != VK_SUCCESS)
-			throw RULE_ERROR("failed to create staging buffer: "+vk::to_string((vk::Result)result));
-
-		VkMemoryRequirements requirements;
-		device.dispatch.GetBufferMemoryRequirements(*device, buffer, &requirements);
-
-		VkMemoryAllocateInfo allocateInfo;
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.pNext = nullptr;
-		allocateInfo.memoryTypeIndex = findMemoryType(device.memProperties, requirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		allocateInfo.allocationSize = requirements.size;
-		VkDeviceMemory memory;
-		if(device.dispatch.AllocateMemory(*device, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
-			throw RULE_ERROR("failed to allocate memory for staging buffer");
-
-		if(device.dispatch.BindBufferMemory(*device, buffer, memory, 0) != VK_SUCCESS)
-			throw RULE_ERROR("failed to bind memory to staging buffer");
-
-		void* bufferPointer;
-		if(device.dispatch.MapMemory(*device, memory, 0, data.size(), 0, &bufferPointer) != VK_SUCCESS)
-			throw RULE_ERROR("failed to map staging memory");
-		memcpy(bufferPointer, data.data(), data.size());
-		device.dispatch.UnmapMemory(*device, memory);
-
-		auto tStagingReady = std::chrono::high_resolution_clock::now();
-
+		VkImageCreateInfo imgInfo = device.images.at((VkImage)handle).createInfo;
+		VkDeviceSize size = data.size();
+		if(texture)
 		{
-			scoped_lock l(transfer_lock);
-
-			VkCommandBuffer commandBuffer = device.transferBuffer;
-			if(commandBuffer == VK_NULL_HANDLE)
-				throw RULE_ERROR("command buffer is NULL");
-
-			if(device.dispatch.ResetCommandBuffer(commandBuffer, 0) != VK_SUCCESS)
-				throw RULE_ERROR("failed to reset command buffer");
-
-			VkCommandBufferBeginInfo beginInfo;
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.pNext = nullptr;
-			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-			beginInfo.pInheritanceInfo = nullptr;
-			if(device.dispatch.BeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-				throw RULE_ERROR("failed to begin the command buffer");
-
+			size = 0;
+			for(uint32_t i=0; i<texture->levels_for(imgInfo.mipLevels); i++)
 			{
-				VkImageCreateInfo imgInfo = device.images.at((VkImage)handle).createInfo;
-
-				VkImageMemoryBarrier memoryBarrier{};
-				memoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				memoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				memoryBarrier.image = (VkImage) handle;
-				memoryBarrier.srcAccessMask = 0;
-				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				memoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				memoryBarrier.subresourceRange.layerCount = imgInfo.arrayLayers;
-				memoryBarrier.subresourceRange.levelCount = imgInfo.mipLevels;
-				memoryBarrier.subresourceRange.baseArrayLayer = 0;
-				memoryBarrier.subresourceRange.baseMipLevel = 0;
-				memoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				memoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				memoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				memoryBarrier.pNext = nullptr;
-
-				device.dispatch.CmdPipelineBarrier(commandBuffer,
-					VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &memoryBarrier);
-
-				std::vector<VkBufferImageCopy> copies(offsets.size());
-				for(int i=0; i<copies.size(); i++)
-				{
-					VkBufferImageCopy copy{};
-					copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-					copy.imageSubresource.baseArrayLayer = 0;
-					copy.imageSubresource.layerCount = 1;
-					copy.imageSubresource.mipLevel = i;
-					copy.imageExtent = { .width = imgInfo.extent.width / (1<<i), .height = imgInfo.extent.height / (1<<i), .depth = 1 };
-					copy.bufferOffset = offsets[i];
-
-					copies[i] = copy;
-				}
-				device.dispatch.CmdCopyBufferToImage(commandBuffer, buffer, (VkImage)handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					copies.size(), copies.data());
+				offsets.push_back(size);
+				size += texture->levels()[i].size();
 			}
+		}
 
-			if(device.dispatch.EndCommandBuffer(commandBuffer) != VK_SUCCESS)
-				throw RULE_ERROR("failed to end command buffer");
-
-			auto tCommandReady = std::chrono::high_resolution_clock::now();
-
-			VkQueue queue = device.transferQueue;
-			if(queue == VK_NULL_HANDLE)
-				throw RULE_ERROR("command buffer is NULL");
-
-			if(device.dispatch.QueueWaitIdle(queue) != VK_SUCCESS)
-				throw RULE_ERROR("cannot wait for queue to be idle before copying");
-			auto tIdle1 = std::chrono::high_resolution_clock::now();
-
-			VkSubmitInfo submitInfo{};
-			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-			submitInfo.commandBufferCount = 1;
-			submitInfo.pCommandBuffers = &commandBuffer;
-			if(device.dispatch.QueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-				throw RULE_ERROR("failed to submit command buffer");
-
-			if(device.dispatch.QueueWaitIdle(queue) != VK_SUCCESS)
-				throw RULE_ERROR("cannot wait for queue to be idle after copying");
-			auto tIdle2 = std::chrono::high_resolution_clock::now();
-
-			device.dispatch.DestroyBuffer(*device, buffer, nullptr);
-			device.dispatch.FreeMemory(*device, memory, nullptr);
+		upload_batcher::upload upload{
+			.image = (VkImage)handle,
+			.range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, imgInfo.mipLevels, 0, imgInfo.arrayLayers},
+			.staging = device.staging.allocate(size),
+		};
+		if(texture)
+		{
+			for(size_t i=0; i<offsets.size(); i++)
+				memcpy(upload.staging.data + offsets[i], texture->levels()[i].data(), texture->levels()[i].size());
+		}
+		else
+		{
+			memcpy(upload.staging.data, data.data(), data.size());
+		}
+		for(int i=0; i<offsets.size(); i++)
+		{
+			VkBufferImageCopy copy{};
+			copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.imageSubresource.baseArrayLayer = 0;
+			copy.imageSubresource.layerCount = 1;
+			copy.imageSubresource.mipLevel = i;
+			copy.imageExtent = { .width = std::max(imgInfo.extent.width >> i, 1u), .height = std::max(imgInfo.extent.height >> i, 1u), .depth = 1 };
+			copy.bufferOffset = upload.staging.offset + offsets[i];
+			upload.copies.push_back(copy);
+		}
+		auto tStagingReady = std::chrono::high_resolution_clock::now();
 
+		upload.done = [&device, handle, t0, tDataReady, tStagingReady](bool success){
+			if(!success)
+			{
+				device.logger->debug("overload of {} was replaced by a newer one or could not be submitted", handle);
+				return;
+			}
+			auto tCopied = std::chrono::high_resolution_clock::now();
 			device.logger->debug(
 R"(overload timing:
 	image load: {}
 	staging buffer: {}
-	command buffer: {}
-	queue wait: {}
-	copy operation: {})",
+	batched copy: {})",
 				std::chrono::duration_cast<std::chrono::milliseconds>(tDataReady - t0).count(),
 				std::chrono::duration_cast<std::chrono::milliseconds>(tStagingReady - tDataReady).count(),
-				std::chrono::duration_cast<std::chrono::milliseconds>(tCommandReady - tStagingReady).count(),
-				std::chrono::duration_cast<std::chrono::milliseconds>(tIdle1 - tCommandReady).count(),
-				std::chrono::duration_cast<std::chrono::milliseconds>(tIdle2 - tIdle1).count());
-		}
+				std::chrono::duration_cast<std::chrono::milliseconds>(tCopied - tStagingReady).count());
+		};
+		device.uploads.submit(std::move(upload));
 	}
 
 	void load_image_action::read(std::istream& in)
@@ -863,8 +1025,12 @@ R"(overload timing:
 	{
 		std::string filename = std::get<std::string>(m_filename->get(type, data_type::String, handle, global, local, rule));
 		VkHandle h = std::get<VkHandle>(m_target->get(type, data_type::Handle, handle, global, local, rule));
-		std::thread t(&preload_image_action::work, this, std::ref(*local.device), h, filename);
-		global.threads.push_back(std::move(t));
+		bool queued = local.device->workers.submit(worker_pool::lane::Background, [this, &device = *local.device, h, filename, keep = local.keep_rules_alive()](std::stop_token stop){
+			if(!stop.stop_requested())
+				work(device, h, filename);
+		});
+		if(!queued)
+			local.logger.warn("Dropped preload of {}, the worker queue is full", filename);
 	}
 
 	void preload_image_action::work(device& device, VkHandle handle, std::string optFilename)
@@ -873,42 +1039,13 @@ R"(overload timing:
 		{
 			if(optFilename.ends_with(".png") && imageTools)
 			{
+#ifdef USE_IMAGE_TOOLS
 				VkImageCreateInfo imgInfo = device.images.at((VkImage)handle).createInfo;
-				decltype(imageFileCache.begin()->first) cacheKey = {optFilename, imgInfo.format, imgInfo.extent.width, imgInfo.extent.height, imgInfo.mipLevels};
-				if(imageFileCache.contains(cacheKey))
-				{
-					return;
-				}
-				else
-				{
-					std::vector<uint8_t> data;
-					std::vector<VkDeviceSize> offsets;
-
-					int w, h, comp;
-					uint8_t* buf = stbi_load(optFilename.c_str(), &w, &h, &comp, STBI_rgb_alpha);
-					image_tools::image image(w, h, buf);
-
-					if(imgInfo.mipLevels <= 1)
-					{
-						offsets.push_back(0);
-						image_tools::compress(imgInfo.format, image, data, imgInfo.extent.width, imgInfo.extent.height);
-					}
-					else
-					{
-						data.clear();
-						for(int i=0; i<imgInfo.mipLevels; i++)
-						{
-							offsets.push_back(data.size());
-
-							std::vector<uint8_t> v;
-							image_tools::compress(imgInfo.format, image, v, imgInfo.extent.width / (1<<i), imgInfo.extent.height / (1<<i));
-							std::copy(v.begin(), v.end(), std::back_inserter(data));
-						}
-					}
-
-					stbi_image_free(buf);
-					imageFileCache[cacheKey] = {data, offsets};
-				}
+				image_file_cache::key cacheKey = {optFilename, imgInfo.format, imgInfo.extent.width, imgInfo.extent.height, imgInfo.mipLevels};
+				device.inst->imageCache.get(cacheKey, [&](){
+					return transcode_png(cacheKey, device.workers.threads_per_worker());
+				});
+#endif
 			}
 		}
 		catch(const std::exception& ex)
@@ -942,200 +1079,182 @@ R"(overload timing:
 		return out;
 	}
 
-	void dump_framebuffer_action::execute(selector_type, VkHandle, global_context& global, local_context &local, rule&)
+	static framebuffer_readback::request framebuffer_request(local_context& local, int attachment)
 	{
 		auto& device = *local.device;
+		auto& state = *local.commandBufferState;
 
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-		VkEvent event;
-
-		VkFramebuffer fb = local.commandBufferState->framebuffer;
+		VkFramebuffer fb = state.framebuffer;
 		if(fb == VK_NULL_HANDLE)
 			throw RULE_ERROR("cannot dump framebuffer, because framebuffer is NULL");
 		if(!device.framebuffers.contains(fb))
 			throw RULE_ERROR("cannot dump framebuffer, because framebuffer is unknown");
 		auto& fb_info = device.framebuffers.at(fb);
-		if(fb_info.attachments.size() <= m_attachment)
+		if(attachment < 0 || fb_info.attachments.size() <= attachment)
 			throw RULE_ERROR("cannot dump framebuffer, because attachment is out of bounds");
 
-		VkImageView view = device.framebuffers.at(fb).attachments.at(m_attachment);
+		VkImageView view = fb_info.attachments.at(attachment);
 		VkImage image = device.imageViewToImage.at(view);
 		VkImageCreateInfo imageInfo = device.images.at(image).createInfo;
+		bool depth = FormatHasDepth(imageInfo.format);
+		if(!FormatIsColor(imageInfo.format) && !depth)
+			throw RULE_ERROR("cannot dump framebuffer, because attachment "+std::to_string(attachment)+" has format "+vk::to_string(vk::Format(imageInfo.format))+", which is neither a color nor a depth format");
+
+		// copies are not allowed inside of a render pass, so they happen once it ended and the attachment is in its final layout
+		VkImageLayout layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		if(auto it = device.renderPasses.find(state.renderpass); it != device.renderPasses.end() && attachment < it->second.finalLayouts.size())
+			layout = it->second.finalLayouts[attachment];
+
+		return {image, imageInfo, layout, static_cast<uint32_t>(attachment)};
+	}
+
+	static void record_readback(local_context& local, const framebuffer_readback::request& request)
+	{
+		auto& device = *local.device;
+		auto record = [&device, request](local_context& local){
+			if(!device.readbacks.record(local.commandBuffer, *local.commandBufferState, request))
+				local.logger.warn("Dropped readback of framebuffer attachment {}, because all readback buffers are in use", request.attachment);
+		};
+		if(local.commandBufferState->renderPassActive)
+			local.commandBufferState->on(command_buffer_event::EndRenderPass, record);
+		else
+			record(local);
+	}
+
+	void dump_framebuffer_action::execute(selector_type, VkHandle, global_context&, local_context &local, rule&)
+	{
+		framebuffer_readback::request request = framebuffer_request(local, m_attachment);
 		local.logger.debug("Dumping framebuffer attachment {} with format {} and extent {}x{}",
-			m_attachment, vk::to_string(vk::Format(imageInfo.format)), imageInfo.extent.width, imageInfo.extent.height);
-
-		VkMemoryRequirements req;
-		device.dispatch.GetImageMemoryRequirements(*device, image, &req);
-		VkDeviceSize size = req.size;
-
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = size;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-		device.dispatch.CreateBuffer(*device, &bufferCreateInfo, nullptr, &buffer);
-
-		device.dispatch.GetBufferMemoryRequirements(*device, buffer, &req);
-
-		VkMemoryAllocateInfo allocateInfo{};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = req.size;
-		allocateInfo.memoryTypeIndex = findMemoryType(device.memProperties,
-			req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		device.dispatch.AllocateMemory(*device, &allocateInfo, nullptr, &memory);
-
-		device.dispatch.BindBufferMemory(*device, buffer, memory, 0);
-
-		VkEventCreateInfo eventCreateInfo{};
-		eventCreateInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
-		device.dispatch.CreateEvent(*device, &eventCreateInfo, nullptr, &event);
-
-		VkBufferImageCopy copy{};
-		copy.imageSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-		copy.imageExtent = imageInfo.extent;
-
-		VkImageMemoryBarrier barrier{};
-		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.image = image;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-
-		device.dispatch.CmdPipelineBarrier(local.commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr, 0, nullptr, 1, &barrier);
-		device.dispatch.CmdCopyImageToBuffer(local.commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &copy);
-		device.dispatch.CmdSetEvent(local.commandBuffer, event, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-
-		std::thread thread([this, &device, imageInfo, size, buffer, memory, event](){
-			for(;;)
-			{
-				if(device.dispatch.GetEventStatus(*device, event) == VK_EVENT_SET)
-					break;
-				using std::chrono::operator""ms;
-				std::this_thread::sleep_for(10ms);
-			}
+			m_attachment, vk::to_string(vk::Format(request.info.format)), request.info.extent.width, request.info.extent.height);
+		record_readback(local, request);
+	}
 
+	void dump_framebuffer_action::read(std::istream& in)
+	{
+		in >> m_attachment;
+		skip_ws(in);
+		check_stream(in, ')');
+	}
+
+	std::ostream& dump_framebuffer_action::print(std::ostream& out)
+	{
+		out << "dumpfb(" << m_attachment << ")";
+		return out;
+	}
+
+	void capture_framebuffer_action::execute(selector_type, VkHandle, global_context&, local_context &local, rule&)
+	{
+		auto& device = *local.device;
+		uint64_t frame = device.inst->presentCount;
+		if(m_frames > 0)
+		{
+			// only the first of the draw calls of a frame that races for it captures
+			uint64_t next = m_nextFrame.load(std::memory_order_relaxed);
+			if(frame < next || !m_nextFrame.compare_exchange_strong(next, frame + m_frames, std::memory_order_relaxed))
+				return;
+		}
+
+		framebuffer_readback::request request = framebuffer_request(local, m_attachment);
+		VkDeviceSize size = framebuffer_readback::size(request.info);
+
+		{
+			std::scoped_lock lock(device.captureLock);
+			auto it = device.captureRings.find(m_name);
+			if(it == device.captureRings.end() || it->second->capacity() < size)
 			{
-				std::vector<char> data(size);
+				if(auto failed = device.captureRingsFailed.find(m_name); failed != device.captureRingsFailed.end() && frame < failed->second.retryFrame)
+					return;
 
+				// creating and mapping the file takes a while, so a worker does it and the captures until then are dropped
+				if(device.captureRingsCreating.insert(m_name).second)
 				{
-					scoped_lock l(global_lock);
-					char* p;
-					device.dispatch.MapMemory(*device, memory, 0, size, 0, (void**)&p);
-					std::copy(p, p+size, data.begin());
-					device.dispatch.UnmapMemory(*device, memory);
-
-					device.dispatch.DestroyBuffer(*device, buffer, nullptr);
-					device.dispatch.FreeMemory(*device, memory, nullptr);
-					device.dispatch.DestroyEvent(*device, event, nullptr);
-				}
+					local.logger.info("Capturing framebuffer attachment {} with format {} and extent {}x{} into ring {}",
+						m_attachment, vk::to_string(vk::Format(request.info.format)), request.info.extent.width, request.info.extent.height, m_name);
+					bool submitted = device.workers.submit(worker_pool::lane::Dump, [&device, name = m_name, size](std::stop_token stop){
+						if(stop.stop_requested())
+						{
+							std::scoped_lock lock(device.captureLock);
+							device.captureRingsCreating.erase(name);
+							return;
+						}
 
-				auto t = std::chrono::high_resolution_clock::now();
-				std::chrono::duration<long> seconds = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch());
+						std::shared_ptr<capture_ring> ring;
+						std::string error;
+						try
+						{
+							ring = std::make_shared<capture_ring>(device.inst->config.capture_directory / name, device.inst->config.capture_slots, size);
+						}
+						catch(const std::exception& ex)
+						{
+							error = ex.what();
+						}
 
-				std::string name = std::to_string(seconds.count()) + "_" + std::to_string(m_attachment);
+						std::scoped_lock lock(device.captureLock);
+						device.captureRingsCreating.erase(name);
+						if(ring)
+						{
+							// the old ring stays alive until the captures that are still in flight for it are published
+							device.captureRings[name] = ring;
+							device.captureRingsFailed.erase(name);
+							return;
+						}
 
-#ifdef USE_IMAGE_TOOLS
-				bool decompression = image_tools::is_decompression_supported(imageInfo.format);
-				if(decompression ||
-					imageInfo.format == VK_FORMAT_R8G8B8A8_SRGB ||
-					imageInfo.format == VK_FORMAT_R8G8B8A8_UNORM ||
-					imageInfo.format == VK_FORMAT_R16G16B16A16_SFLOAT ||
-					imageInfo.format == VK_FORMAT_R16G16_SFLOAT ||
-					imageInfo.format == VK_FORMAT_R16G16B16A16_UINT)
-				{
-					std::string filename = device.inst->config.dump_directory / "images/framebuffers" / (name+".png");
-					try
-					{
-						int w = imageInfo.extent.width;
-						int h = imageInfo.extent.height;
-
-						image_tools::image image(w, h);
-
-						if(decompression)
-							image_tools::decompress(imageInfo.format, (uint8_t*)data.data(), image, w, h);
-						else if(imageInfo.format == VK_FORMAT_R8G8B8A8_SRGB || imageInfo.format == VK_FORMAT_R8G8B8A8_UNORM)
-							std::copy((uint32_t*)data.data(), ((uint32_t*)data.data())+w*h, image.begin());
-						else if(imageInfo.format == VK_FORMAT_R16G16B16A16_SFLOAT)
-							std::transform((uint64_t*)data.data(), ((uint64_t*)data.data())+w*h, image.begin(), [](uint64_t u){
-								glm::vec4 v = glm::unpackHalf4x16(u);
-								v = glm::clamp(v, glm::vec4(0.0), glm::vec4(1.0));
-								return image_tools::color(v);
-							});
-						else if(imageInfo.format == VK_FORMAT_R16G16_SFLOAT)
-							std::transform((uint32_t*)data.data(), ((uint32_t*)data.data())+w*h, image.begin(), [](uint64_t u){
-								glm::vec2 v = glm::unpackHalf2x16(u);
-								v = glm::clamp(v, glm::vec2(0.0), glm::vec2(1.0));
-								return image_tools::color(glm::vec4(v, 0.0, 1.0));
-							});
-						else if(imageInfo.format == VK_FORMAT_R16G16B16A16_UINT)
-							std::transform((uint64_t*)data.data(), ((uint64_t*)data.data())+w*h, image.begin(), [](uint64_t u){
-								glm::u16vec4 uv = glm::unpackUint4x16(u);
-								glm::vec4 v = glm::vec4(
-									((double)uv.r)/((double)UINT16_MAX),
-									((double)uv.g)/((double)UINT16_MAX),
-									((double)uv.b)/((double)UINT16_MAX),
-									((double)uv.a)/((double)UINT16_MAX));
-								v = glm::clamp(v, glm::vec4(0.0), glm::vec4(1.0));
-								return image_tools::color(v);
-							});
-
-						stbi_write_png(filename.c_str(), w, h, 4, image, w*4);
-						device.logger->info("Framebuffer #{} of size {}x{} and format {} was encoded and written to PNG file \"{}\".",
-							m_attachment, imageInfo.extent.width, imageInfo.extent.height, vk::to_string((vk::Format)imageInfo.format), filename);
-					}
-					catch(const std::exception& ex)
-					{
-						device.logger->error("Could not encode and write framebuffer to PNG file \"{}\": {}", filename, ex.what());
-					}
-				}
-				else {
-#endif
-				std::string filename = device.inst->config.dump_directory / "images/framebuffers" / (name+".image");
-				try
-				{
-					std::ofstream of(filename, std::ios::binary);
-					if(!of.good())
-						throw RULE_ERROR("ofstream is not good");
-					of.write(data.data(), data.size());
-					device.logger->info("Framebuffer #{} of size {}x{} and format {} was written to file \"{}\".",
-						m_attachment, imageInfo.extent.width, imageInfo.extent.height, vk::to_string((vk::Format)imageInfo.format), filename);
-				}
-				catch(const std::exception& ex)
-				{
-					device.logger->error("Could not write framebuffer of size {} to file \"{}\": {}",
-						size, filename, ex.what());
-				}
-#ifdef USE_IMAGE_TOOLS
+						// a failure is likely to repeat (full disk, missing directory), so wait 60, 120, ... up to 3840 frames before the next try
+						auto& failure = device.captureRingsFailed[name];
+						uint64_t backoff = uint64_t(60) << std::min(failure.count++, 6u);
+						failure.retryFrame = device.inst->presentCount + backoff;
+						device.logger->error("Failed to create capture ring {}, trying again in {} frames: {}", name, backoff, error);
+					});
+					if(!submitted)
+						device.captureRingsCreating.erase(m_name);
 				}
-#endif
+				return;
 			}
-		});
-		global.threads.push_back(std::move(thread));
+			request.capture = it->second;
+		}
+		request.frame = frame;
+		request.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		record_readback(local, request);
 	}
 
-	void dump_framebuffer_action::read(std::istream& in)
+	void capture_framebuffer_action::read(std::istream& in)
 	{
 		in >> m_attachment;
 		skip_ws(in);
+		check_stream(in, ',');
+		skip_ws(in);
+		m_name.clear();
+		while(in.good() && in.peek() != ',' && in.peek() != ')')
+			m_name += static_cast<char>(in.get());
+		m_name.erase(std::find_if_not(m_name.rbegin(), m_name.rend(), [](unsigned char c){return std::isspace(c);}).base(), m_name.end());
+		if(m_name.empty() || m_name.find('/') != std::string::npos)
+			throw std::runtime_error("the name of a capture ring must not be empty or contain a '/', but it is \""+m_name+"\"");
+
+		if(in.peek() == ',')
+		{
+			in.get();
+			skip_ws(in);
+			in >> m_frames;
+			if(!in || m_frames == 0)
+				throw std::runtime_error("the number of frames between two captures must be a positive number");
+			skip_ws(in);
+		}
 		check_stream(in, ')');
 	}
 
-	std::ostream& dump_framebuffer_action::print(std::ostream& out)
+	std::ostream& capture_framebuffer_action::print(std::ostream& out)
 	{
-		out << "dumpfb(" << m_attachment << ")";
+		out << "capturefb(" << m_attachment << ", " << m_name;
+		if(m_frames > 0)
+			out << ", " << m_frames;
+		out << ")";
 		return out;
 	}
 
 	void every_action::execute(selector_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		if(m_i == 0)
+		if(m_i.fetch_add(1, std::memory_order_relaxed) % m_n == 0)
 			m_action->execute(type, handle, global, local, rule);
-
-		m_i++;
-		m_i %= m_n;
 	}
 
 	void every_action::read(std::istream& in)
@@ -1157,6 +1276,20 @@ R"(overload timing:
 		return out;
 	}
 
+	void every_action::migrate(action& previous)
+	{
+		if(auto* p = dynamic_cast<every_action*>(&previous))
+		{
+			m_i.store(p->m_i.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			m_action->migrate(*p->m_action);
+		}
+	}
+
+	void every_action::retire()
+	{
+		m_action->retire();
+	}
+
 	void buffer_copy_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
 		VkHandle srcHandle, dstHandle;
@@ -1164,8 +1297,8 @@ R"(overload timing:
 		if(m_src->supports(stype, data_type::List))
 		{
 			data_list src = std::get<data_list>(m_src->get(stype, data_type::List, handle, global, local, rule));
-			srcHandle = std::get<VkHandle>(src.values.at(0));
-			srcOffset = std::get<double>(src.values.at(1));
+			srcHandle = std::get<VkHandle>(src.at(0));
+			srcOffset = src.number_at(1);
 		}
 		else
 		{
@@ -1174,14 +1307,33 @@ R"(overload timing:
 		if(m_dst->supports(stype, data_type::List))
 		{
 			data_list dst = std::get<data_list>(m_dst->get(stype, data_type::List, handle, global, local, rule));
-			dstHandle = std::get<VkHandle>(dst.values.at(0));
-			dstOffset = std::get<double>(dst.values.at(1));
+			dstHandle = std::get<VkHandle>(dst.at(0));
+			dstOffset = dst.number_at(1);
 		}
 		else
 		{
 			dstHandle = std::get<VkHandle>(m_dst->get(stype, data_type::Handle, handle, global, local, rule));
 		}
 
+		// copy straight from one mapping into the other, unless both buffers live in the same memory
+		// that is not mapped yet, because that memory cannot be mapped twice at the same time
+		VkDeviceMemory srcMemory = local.device->buffers.at((VkBuffer) srcHandle).memory;
+		VkDeviceMemory dstMemory = local.device->buffers.at((VkBuffer) dstHandle).memory;
+		if(srcMemory != dstMemory || local.device->memoryMappings.contains(srcMemory))
+		{
+			local.device->memory_access((VkBuffer) srcHandle, [this, &local, srcHandle, dstHandle, dstOffset](void* src, VkDeviceSize srcSize){
+				local.device->memory_access((VkBuffer) dstHandle, [this, &local, srcHandle, dstHandle, src, srcSize](void* dst, VkDeviceSize dstSize){
+					// like the transfer buffer below, whatever the source is too short for is filled with zeros
+					VkDeviceSize size = std::min(m_size, dstSize);
+					VkDeviceSize copied = std::min(size, srcSize);
+					local.logger.debug("Copying {} bytes from buffer {} to buffer {}", copied, srcHandle, dstHandle);
+					std::memmove(dst, src, copied);
+					std::memset((uint8_t*)dst + copied, 0, size - copied);
+				}, dstOffset + m_dstOffset);
+			}, srcOffset + m_srcOffset);
+			return;
+		}
+
 		std::vector<uint8_t> transferBuffer(m_size);
 
 		local.device->memory_access((VkBuffer) srcHandle, [&transferBuffer, this, &local, srcHandle](void* ptr, VkDeviceSize size){
@@ -1235,7 +1387,8 @@ R"(overload timing:
 
 	void set_global_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		global.global_variables[m_name] = m_data->get(stype, m_dtype, handle, global, local, rule);
+		// globals outlive the hook and the buffers raw views point into
+		global.global_variables.set(m_name, materialize(m_data->get(stype, m_dtype, handle, global, local, rule)));
 	}
 
 	void set_global_action::read(std::istream& in)
@@ -1269,9 +1422,72 @@ R"(overload timing:
 		return out << ")";
 	}
 
+	void compare_and_set_global_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule)
+	{
+		// the expected version is evaluated first, so a value computed from an outdated variable is never stored
+		auto expected = static_cast<uint64_t>(std::get<double>(m_expected->get(stype, data_type::Number, handle, global, local, rule)));
+		bool stored = global.global_variables.compare_and_set(m_name, expected, materialize(m_data->get(stype, m_dtype, handle, global, local, rule)));
+		if(!m_result.empty())
+			local.set_variable(m_result, m_resultSlot, stored ? 1.0 : 0.0);
+	}
+
+	void compare_and_set_global_action::read(std::istream& in)
+	{
+		std::string dtype;
+		std::getline(in, dtype, ',');
+		skip_ws(in);
+		m_dtype = data_type_from_string(dtype);
+
+		std::getline(in, m_name, ',');
+		skip_ws(in);
+
+		m_expected = read_data(in, m_type);
+		if(!m_expected->supports(m_type, data_type::Number))
+			throw RULE_ERROR("expected version must be a number");
+		skip_ws(in);
+		check_stream(in, ',');
+		skip_ws(in);
+
+		m_data = read_data(in, m_type);
+		if(!m_data->supports(m_type, m_dtype))
+		{
+			std::ostringstream of;
+			of << "Data \"";
+			m_data->print(of);
+			of << "\" does not support type " << to_string(m_dtype) << " for selector " << to_string(m_type) << ".";
+			throw RULE_ERROR(of.str());
+		}
+
+		skip_ws(in);
+		if(in.peek() == ',')
+		{
+			in.get();
+			skip_ws(in);
+			std::getline(in, m_result, ')');
+			while(!m_result.empty() && std::isspace(static_cast<unsigned char>(m_result.back())))
+				m_result.pop_back();
+			if(m_result.empty())
+				throw RULE_ERROR("expected the name of a local variable for the result");
+			m_resultSlot = variable_slot(m_result);
+			return;
+		}
+		check_stream(in, ')');
+	}
+
+	std::ostream& compare_and_set_global_action::print(std::ostream& out)
+	{
+		out << "global_cas(" << to_string(m_dtype) << ", " << m_name << ", ";
+		m_expected->print(out);
+		out << ", ";
+		m_data->print(out);
+		if(!m_result.empty())
+			out << ", " << m_result;
+		return out << ")";
+	}
+
 	void set_local_action::execute(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		local.local_variables[m_name] = m_data->get(stype, m_dtype, handle, global, local, rule);
+		local.set_variable(m_name, m_slot, m_data->get(stype, m_dtype, handle, global, local, rule));
 	}
 
 	void set_local_action::read(std::istream& in)
@@ -1282,6 +1498,7 @@ R"(overload timing:
 		m_dtype = data_type_from_string(dtype);
 
 		std::getline(in, m_name, ',');
+		m_slot = variable_slot(m_name);
 		skip_ws(in);
 
 		m_data = read_data(in, m_type);
@@ -1307,30 +1524,33 @@ R"(overload timing:
 
 	void thread_action::execute(selector_type, VkHandle, global_context& global, local_context& local, rule& rule)
 	{
-		m_instance = local.instance;
-		m_device = local.device;
-		m_local_variables = local.local_variables;
+		// the timer reads this state, so it is only written once, before the timer is started
+		std::unique_lock lock(m_mutex);
 		if(m_done) return;
 		m_done = true;
 
-		m_thread = std::jthread([this, &rule](std::stop_token stop_token){
-			std::mutex mutex;
-			std::unique_lock<std::mutex> lock(mutex);
-			do
-			{
-				calling_context ctx = {
-					.customTag = "thread",
-					.local_variables = m_local_variables,
-				};
-				if(m_device) {
-					m_device->execute_rules(rules::selector_type::Custom, VK_NULL_HANDLE, ctx);
-				}
-				else if(m_instance) {
-					m_instance->execute_rules(rules::selector_type::Custom, VK_NULL_HANDLE, ctx);
-				}
+		m_instance = local.instance;
+		m_device = local.device;
+		m_local_variables = local.snapshot_variables();
+		m_scheduler = &global.timers;
+		start();
+	}
+
+	void thread_action::start()
+	{
+		auto tick = [this](){
+			calling_context ctx = {
+				.customTag = "thread",
+				.local_variables = m_local_variables,
+			};
+			if(m_device) {
+				m_device->execute_rules(rules::selector_type::Custom, VK_NULL_HANDLE, ctx);
 			}
-			while(!std::condition_variable_any().wait_for(lock, stop_token, std::chrono::milliseconds(m_delay), [&stop_token]{return stop_token.stop_requested();}));
-		});
+			else if(m_instance) {
+				m_instance->execute_rules(rules::selector_type::Custom, VK_NULL_HANDLE, ctx);
+			}
+		};
+		m_timer = m_frames ? m_scheduler->every_frames(m_delay, tick) : m_scheduler->every(std::chrono::milliseconds(m_delay), tick);
 	}
 
 	void thread_action::read(std::istream& in)
@@ -1341,6 +1561,21 @@ R"(overload timing:
 		skip_ws(in);
 
 		in >> m_delay;
+		skip_ws(in);
+		if(in.peek() == ',')
+		{
+			in.get();
+			skip_ws(in);
+
+			std::string unit;
+			while(std::isalpha(in.peek()))
+				unit += static_cast<char>(in.get());
+			if(unit == "Frames")
+				m_frames = true;
+			else if(unit != "Milliseconds")
+				throw RULE_ERROR("unknown unit "+unit+", expected Milliseconds or Frames");
+		}
+		skip_ws(in);
 		check_stream(in, ')');
 	}
 
@@ -1348,7 +1583,41 @@ R"(overload timing:
 	{
 		out << "thread(";
 		m_action->print(out);
-		return out << ", " << m_delay << ")";
+		out << ", " << m_delay;
+		if(m_frames)
+			out << ", Frames";
+		return out << ")";
+	}
+
+	void thread_action::migrate(action& previous)
+	{
+		auto* p = dynamic_cast<thread_action*>(&previous);
+		if(!p)
+			return;
+
+		std::scoped_lock lock(m_mutex, p->m_mutex);
+		if(!p->m_done)
+			return;
+
+		// stop the old timer first, otherwise both would fire for a moment
+		p->m_scheduler->cancel(p->m_timer);
+		p->m_timer = 0;
+
+		m_instance = p->m_instance;
+		m_device = p->m_device;
+		m_local_variables = p->m_local_variables;
+		m_scheduler = p->m_scheduler;
+		m_done = true;
+		start();
+	}
+
+	void thread_action::retire()
+	{
+		m_action->retire();
+		std::unique_lock lock(m_mutex);
+		if(m_scheduler && m_timer)
+			m_scheduler->cancel(m_timer);
+		m_timer = 0;
 	}
 
 	void define_function_action::read(std::istream& in)
@@ -1413,19 +1682,28 @@ R"(overload timing:
 		return out << ")";
 	}
 
-	void define_function_action::execute(selector_type, VkHandle, global_context& global, local_context &, rule &)
+	void define_function_action::execute(selector_type, VkHandle, global_context& global, local_context& local, rule &)
 	{
-		register_function(global);
+		register_function(global, local.keep_rules_alive());
 	}
 
-	void define_function_action::register_function(global_context& global)
+	void define_function_action::register_function(global_context& global, std::shared_ptr<ruleset> owner)
 	{
 		user_function fnc = {
 			.data = m_function.get(),
 			.arguments = m_arguments,
-			.default_arguments = std::vector<class data*>(m_default_arguments.size())
+			.default_arguments = std::vector<class data*>(m_default_arguments.size()),
+			.owner = std::move(owner),
 		};
 		std::transform(m_default_arguments.cbegin(), m_default_arguments.cend(), fnc.default_arguments.begin(), std::mem_fn(&std::unique_ptr<data>::get));
 		global.user_functions[m_name] = std::move(fnc);
 	}
 }
+
+namespace CheekyLayer::rules
+{
+	std::unique_ptr<action> make_async_action(std::unique_ptr<action> action, selector_type type)
+	{
+		return std::make_unique<actions::async_action>(type, std::move(action));
+	}
+}
@@ -0,0 +1,159 @@
+#include "rules/async.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace CheekyLayer::rules
+{
+	async_executor::~async_executor()
+	{
+		shutdown();
+	}
+
+	void async_executor::configure(size_t workers, size_t capacity)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_capacity = std::max<size_t>(capacity, 1);
+		}
+		m_pool.configure(std::max<size_t>(workers, 1), m_capacity);
+	}
+
+	bool async_executor::submit(const std::string& key, task t, const void* owner)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			if(m_shutdown || m_cancelling.contains(owner))
+				return false;
+			if(m_depth >= m_capacity)
+			{
+				m_dropped++;
+				return false;
+			}
+
+			m_submitted++;
+			m_depth++;
+			m_maxDepth = std::max(m_maxDepth, m_depth);
+
+			if(key.empty())
+				m_unkeyed.push_back({std::move(t), owner});
+			else
+			{
+				auto [it, idle] = m_strands.try_emplace(key);
+				it->second.push_back({std::move(t), owner});
+				if(!idle)
+					return true; // the task draining this strand will pick it up
+			}
+		}
+
+		worker_pool::task run = key.empty()
+			? worker_pool::task([this](std::stop_token stop){ run_unkeyed(stop); })
+			: worker_pool::task([this, key](std::stop_token stop){ drain(key, stop); });
+		if(m_pool.submit(worker_pool::lane::Interactive, run))
+			return true;
+
+		// the pool was shut down after we checked, drop what we just queued
+		std::stop_source stopped;
+		stopped.request_stop();
+		run(stopped.get_token());
+		return false;
+	}
+
+	void async_executor::drain(const std::string& key, std::stop_token stop)
+	{
+		while(true)
+		{
+			entry e;
+			{
+				std::unique_lock lock(m_mutex);
+				auto it = m_strands.find(key);
+				auto& queue = it->second;
+				if(queue.empty() || stop.stop_requested())
+				{
+					m_dropped += queue.size();
+					m_depth -= queue.size();
+					m_strands.erase(it);
+					return;
+				}
+				e = std::move(queue.front());
+				queue.pop_front();
+				m_running[e.owner]++;
+			}
+			execute(e);
+		}
+	}
+
+	void async_executor::run_unkeyed(std::stop_token stop)
+	{
+		entry e;
+		{
+			std::unique_lock lock(m_mutex);
+			if(m_unkeyed.empty())
+				return;
+			e = std::move(m_unkeyed.front());
+			m_unkeyed.pop_front();
+			if(stop.stop_requested())
+			{
+				m_dropped++;
+				m_depth--;
+				return;
+			}
+			m_running[e.owner]++;
+		}
+		execute(e);
+	}
+
+	void async_executor::execute(const entry& e)
+	{
+		try
+		{
+			e.t();
+		}
+		catch(const std::exception& ex)
+		{
+			spdlog::error("Failed to execute async action: {}", ex.what());
+		}
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_depth--;
+			m_executed++;
+			if(--m_running[e.owner] == 0)
+				m_running.erase(e.owner);
+		}
+		m_cv.notify_all();
+	}
+
+	void async_executor::cancel(const void* owner)
+	{
+		std::unique_lock lock(m_mutex);
+		m_cancelling.insert(owner);
+
+		auto purge = [this, owner](std::deque<entry>& queue){
+			size_t count = std::erase_if(queue, [owner](const entry& e){return e.owner == owner;});
+			m_dropped += count;
+			m_depth -= count;
+		};
+		purge(m_unkeyed);
+		for(auto& [key, queue] : m_strands)
+			purge(queue);
+
+		m_cv.wait(lock, [this, owner]{return !m_running.contains(owner);});
+		m_cancelling.erase(owner);
+	}
+
+	async_executor::statistics async_executor::stats()
+	{
+		std::unique_lock lock(m_mutex);
+		return {m_depth, m_maxDepth, m_submitted, m_executed, m_dropped};
+	}
+
+	void async_executor::shutdown()
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_shutdown = true;
+		}
+		// pending tasks are dropped, only the ones already running are waited for
+		m_pool.shutdown();
+	}
+}
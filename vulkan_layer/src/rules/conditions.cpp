@@ -2,6 +2,7 @@
 #include "rules/rules.hpp"
 #include "rules/execution_env.hpp"
 
+#include <algorithm>
 #include <compare>
 #include <memory>
 #include <ostream>
@@ -182,9 +183,10 @@ namespace CheekyLayer::rules::conditions
 			case data_type::String:
 				result = std::get<std::string>(v1) <=> std::get<std::string>(v2);
 				break;
-			case data_type::Raw:
-				result = std::get<std::vector<uint8_t>>(v1) <=> std::get<std::vector<uint8_t>>(v2);
-				break;
+			case data_type::Raw: {
+				std::span<const uint8_t> r1 = raw_bytes(v1), r2 = raw_bytes(v2);
+				result = std::lexicographical_compare_three_way(r1.begin(), r1.end(), r2.begin(), r2.end());
+				break; }
 			default:
 				break;
 		}
@@ -1,3 +1,4 @@
+#include "objects.hpp"
 #include "rules/data.hpp"
 #include "rules/execution_env.hpp"
 #include "rules/rules.hpp"
@@ -9,6 +10,9 @@ namespace CheekyLayer::rules::datas
 	data_register<string_data> string_data::reg2("s");
 	data_register<concat_data> concat_data::reg("concat");
 	data_register<received_data> received_data::reg("received");
+	data_register<async_stats_data> async_stats_data::reg("async_stats");
+	data_register<worker_stats_data> worker_stats_data::reg("worker_stats");
+	data_register<profile_report_data> profile_report_data::reg("profile_report");
 	data_register<string_clean_data> string_clean_data::reg("strclean");
 	data_register<number_data> number_data::reg("number");
 	data_register<split_data> split_data::reg("split");
@@ -84,8 +88,9 @@ namespace CheekyLayer::rules::datas
 
 			for(auto& p : m_parts)
 			{
-				auto v = std::get<std::vector<uint8_t>>(p->get(stype, type, handle, global, local, rule));
-				std::copy(v.begin(), v.end(), std::back_inserter(vs));
+				data_value part = p->get(stype, type, handle, global, local, rule);
+				std::span<const uint8_t> v = raw_bytes(part);
+				vs.insert(vs.end(), v.begin(), v.end());
 			}
 			return vs;
 		}
@@ -121,7 +126,7 @@ namespace CheekyLayer::rules::datas
 		if(type != data_type::Raw)
 			throw RULE_ERROR("cannot return data type "+to_string(type));
 		receive_info& info = std::get<receive_info>(*local.info);
-		return std::vector<uint8_t>(info.buffer, info.buffer + info.size);
+		return raw_view{std::span<const uint8_t>(info.buffer, info.size), info.owner};
 	}
 
 	bool received_data::supports(selector_type, data_type type)
@@ -135,6 +140,137 @@ namespace CheekyLayer::rules::datas
 		return out;
 	}
 
+	void async_stats_data::read(std::istream& in)
+	{
+		std::getline(in, m_stat, ')');
+		if(m_stat != "depth" && m_stat != "max_depth" && m_stat != "submitted" && m_stat != "executed" && m_stat != "dropped")
+			throw RULE_ERROR("unknown async statistic \""+m_stat+"\"");
+	}
+
+	data_value async_stats_data::get(selector_type, data_type type, VkHandle, global_context& global, local_context&, rule &)
+	{
+		auto stats = global.async.stats();
+		double value;
+		if(m_stat == "depth")
+			value = stats.depth;
+		else if(m_stat == "max_depth")
+			value = stats.maxDepth;
+		else if(m_stat == "submitted")
+			value = stats.submitted;
+		else if(m_stat == "executed")
+			value = stats.executed;
+		else
+			value = stats.dropped;
+
+		switch(type)
+		{
+			case data_type::Number:
+				return value;
+			case data_type::String:
+				return std::to_string(static_cast<uint64_t>(value));
+			default:
+				throw RULE_ERROR("cannot return data type "+to_string(type));
+		}
+	}
+
+	bool async_stats_data::supports(selector_type, data_type type)
+	{
+		return type == data_type::Number || type == data_type::String;
+	}
+
+	std::ostream& async_stats_data::print(std::ostream& out)
+	{
+		return out << "async_stats(" << m_stat << ")";
+	}
+
+	void worker_stats_data::read(std::istream& in)
+	{
+		std::getline(in, m_stat, ')');
+		if(m_stat != "depth" && m_stat != "interactive_depth" && m_stat != "background_depth" && m_stat != "dump_depth" &&
+			m_stat != "max_depth" && m_stat != "submitted" && m_stat != "executed" && m_stat != "dropped" && m_stat != "cancelled")
+			throw RULE_ERROR("unknown worker statistic \""+m_stat+"\"");
+	}
+
+	data_value worker_stats_data::get(selector_type, data_type type, VkHandle, global_context&, local_context& local, rule &)
+	{
+		if(!local.device)
+			throw RULE_ERROR("worker statistics are only available for device level selectors");
+
+		auto stats = local.device->workers.stats();
+		auto lane = [&stats](worker_pool::lane l){return stats.depth[static_cast<size_t>(l)];};
+		double value;
+		if(m_stat == "depth")
+			value = lane(worker_pool::lane::Interactive) + lane(worker_pool::lane::Background) + lane(worker_pool::lane::Dump);
+		else if(m_stat == "interactive_depth")
+			value = lane(worker_pool::lane::Interactive);
+		else if(m_stat == "background_depth")
+			value = lane(worker_pool::lane::Background);
+		else if(m_stat == "dump_depth")
+			value = lane(worker_pool::lane::Dump);
+		else if(m_stat == "max_depth")
+			value = stats.maxDepth;
+		else if(m_stat == "submitted")
+			value = stats.submitted;
+		else if(m_stat == "executed")
+			value = stats.executed;
+		else if(m_stat == "dropped")
+			value = stats.dropped;
+		else
+			value = stats.cancelled;
+
+		switch(type)
+		{
+			case data_type::Number:
+				return value;
+			case data_type::String:
+				return std::to_string(static_cast<uint64_t>(value));
+			default:
+				throw RULE_ERROR("cannot return data type "+to_string(type));
+		}
+	}
+
+	bool worker_stats_data::supports(selector_type, data_type type)
+	{
+		return type == data_type::Number || type == data_type::String;
+	}
+
+	std::ostream& worker_stats_data::print(std::ostream& out)
+	{
+		return out << "worker_stats(" << m_stat << ")";
+	}
+
+	void profile_report_data::read(std::istream& in)
+	{
+		check_stream(in, ')');
+	}
+
+	data_value profile_report_data::get(selector_type, data_type type, VkHandle, global_context& global, local_context& local, rule &)
+	{
+		if(!global.profile_rules)
+			throw RULE_ERROR("rule profiling is disabled, set profileRules=true");
+
+		std::string report = profile_report(*local.instance->rules.read());
+		switch(type)
+		{
+			case data_type::String:
+				return report;
+			case data_type::Raw:
+				return std::vector<uint8_t>(report.begin(), report.end());
+			default:
+				throw RULE_ERROR("cannot return data type "+to_string(type));
+		}
+	}
+
+	bool profile_report_data::supports(selector_type, data_type type)
+	{
+		return type == data_type::String || type == data_type::Raw;
+	}
+
+	std::ostream& profile_report_data::print(std::ostream& out)
+	{
+		return out << "profile_report()";
+	}
+
 	void string_clean_data::read(std::istream& in)
 	{
 		m_data = read_data(in, m_type);
@@ -264,7 +400,7 @@ namespace CheekyLayer::rules::datas
 	data_value at_data::get(selector_type stype, data_type dtype, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
 		auto list = std::get<data_list>(m_src->get(stype, data_type::List, handle, global, local, rule));
-		auto& thing = list.values.at(m_index);
+		data_value thing = list.at(m_index);
 
 		bool okay = true;
 		switch(dtype)
@@ -273,7 +409,7 @@ namespace CheekyLayer::rules::datas
 				okay = std::holds_alternative<std::string>(thing);
 				break;
 			case Raw:
-				okay = std::holds_alternative<std::vector<uint8_t>>(thing);
+				okay = is_raw(thing);
 				break;
 			case Handle:
 				okay = std::holds_alternative<VkHandle>(thing);
@@ -49,7 +49,7 @@ namespace CheekyLayer::rules::datas
 				}
 			}
 			case data_type::Raw: {
-				std::vector<uint8_t> raw = std::get<std::vector<uint8_t>>(value);
+				std::span<const uint8_t> raw = raw_bytes(value);
 				switch(dstType)
 				{
 					case data_type::String:
@@ -49,27 +49,29 @@ namespace CheekyLayer::rules::datas
 		if(func.arguments.size() - func.default_arguments.size() > m_args.size())
 			throw RULE_ERROR("not enough arguments to call function " + m_function);
 
+		// Arguments are bound one after another, so later argument expressions already see the earlier ones.
+		variable_frame frame{.parent = local.frame};
+		frame.arguments.reserve(func.arguments.size());
+
 		struct restore {
 			decltype(local)& ctx;
-			decltype(ctx.local_variables) vars;
+			variable_frame* previous;
 
-			restore(decltype(ctx)& ctx) : ctx(ctx), vars(ctx.local_variables) {}
-			~restore() {ctx.local_variables = vars;}
-		} restore = {local};
+			restore(decltype(ctx)& ctx, variable_frame* frame) : ctx(ctx), previous(ctx.frame) {ctx.frame = frame;}
+			~restore() {ctx.frame = previous;}
+		} restore = {local, &frame};
 
 		int args = std::min(func.arguments.size(), m_args.size());
 		for(int i=0; i<args; i++)
 		{
-			std::string argName = "_"+std::to_string(i+1);
 			data_value value = m_args.at(i)->get(stype, func.arguments.at(i), handle, global, local, rule);
-			local.local_variables[argName] = value;
+			frame.arguments.push_back(std::move(value));
 		}
 		for(int i=args; i<func.arguments.size(); i++)
 		{
-			std::string argName = "_"+std::to_string(i+1);
 			int index = i-func.arguments.size()+func.default_arguments.size();
 			data_value value = func.default_arguments.at(index)->get(stype, func.arguments.at(i), handle, global, local, rule);
-			local.local_variables[argName] = value;
+			frame.arguments.push_back(std::move(value));
 		}
 		return func.data->get(stype, dtype, handle, global, local, rule);
 	}
@@ -25,7 +25,7 @@ namespace CheekyLayer::rules::datas
 				okay = std::holds_alternative<std::string>(*local.currentElement);
 				break;
 			case Raw:
-				okay = std::holds_alternative<std::vector<uint8_t>>(*local.currentElement);
+				okay = is_raw(*local.currentElement);
 				break;
 			case Handle:
 				okay = std::holds_alternative<VkHandle>(*local.currentElement);
@@ -111,17 +111,44 @@ namespace CheekyLayer::rules::datas
 
 	data_value map_data::get(selector_type stype, data_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		data_list src = std::get<data_list>(m_src->get(stype, data_type::List, handle, global, local, rule));
-
-		auto saved = local.currentElement;
-		for(data_value& elem : src.values)
+		if(m_elementDstType == data_type::Number)
 		{
-			local.currentElement = &elem;
-			elem = m_mapper->get(stype, m_elementDstType, handle, global, local, rule);
+			// numbers are collected unboxed, no matter how the source is stored
+			std::vector<double> numbers;
+			numbers.reserve(count_hint().value_or(0));
+			stream(stype, handle, global, local, rule, [&numbers](data_value& elem, size_t){
+				numbers.push_back(std::get<double>(elem));
+			});
+			return data_list(number_array(std::move(numbers)));
 		}
-		local.currentElement = saved;
 
-		return src;
+		data_list result;
+		result.values.reserve(count_hint().value_or(0));
+		stream(stype, handle, global, local, rule, [&result](data_value& elem, size_t){
+			result.values.push_back(std::move(elem));
+		});
+		return result;
+	}
+
+	void map_data::stream(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule, const element_callback& f)
+	{
+		auto savedElem = local.currentElement;
+		auto savedIndex = local.currentIndex;
+
+		m_src->stream(stype, handle, global, local, rule, [&](data_value& elem, size_t i){
+			local.currentElement = &elem;
+			local.currentIndex = i;
+			data_value mapped = m_mapper->get(stype, m_elementDstType, handle, global, local, rule);
+			f(mapped, i);
+		});
+
+		local.currentElement = savedElem;
+		local.currentIndex = savedIndex;
+	}
+
+	std::optional<size_t> map_data::count_hint()
+	{
+		return m_src->count_hint();
 	}
 
 	std::ostream& map_data::print(std::ostream& out)
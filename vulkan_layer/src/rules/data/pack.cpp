@@ -2,6 +2,15 @@
 #include "rules/execution_env.hpp"
 #include "rules/rules.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PACK_X86_F16C
+#include <immintrin.h>
+#define F16C_TARGET __attribute__((target("avx,f16c")))
+#endif
+
 namespace CheekyLayer::rules::datas
 {
 	data_register<unpack_data> unpack_data::reg("unpack");
@@ -19,6 +28,7 @@ namespace CheekyLayer::rules::datas
 		if(s=="UInt32") return raw_type::UInt32;
 		if(s=="UInt64") return raw_type::UInt64;
 
+		if(s=="Half") return raw_type::Half;
 		if(s=="Float") return raw_type::Float;
 		if(s=="Double") return raw_type::Double;
 
@@ -41,6 +51,7 @@ namespace CheekyLayer::rules::datas
 			case raw_type::UInt32: return "UInt32";
 			case raw_type::UInt64: return "UInt64";
 
+			case raw_type::Half: return "Half";
 			case raw_type::Float: return "Float";
 			case raw_type::Double: return "Double";
 
@@ -92,75 +103,265 @@ namespace CheekyLayer::rules::datas
 		}
 	}
 
-	static double unpack(raw_type type, void* ptr)
+	static size_t raw_size(raw_type type)
 	{
 		switch(type)
 		{
-			case raw_type::SInt8: return (double) (*((int8_t*)ptr));
-			case raw_type::SInt16: return (double) (*((int16_t*)ptr));
-			case raw_type::SInt32: return (double) (*((int32_t*)ptr));
-			case raw_type::SInt64: return (double) (*((int64_t*)ptr));
+			case raw_type::SInt8: return sizeof(int8_t);
+			case raw_type::SInt16: return sizeof(int16_t);
+			case raw_type::SInt32: return sizeof(int32_t);
+			case raw_type::SInt64: return sizeof(int64_t);
 
-			case raw_type::UInt8: return (double) (*((uint8_t*)ptr));
-			case raw_type::UInt16: return (double) (*((uint16_t*)ptr));
-			case raw_type::UInt32: return (double) (*((uint32_t*)ptr));
-			case raw_type::UInt64: return (double) (*((uint64_t*)ptr));
+			case raw_type::UInt8: return sizeof(uint8_t);
+			case raw_type::UInt16: return sizeof(uint16_t);
+			case raw_type::UInt32: return sizeof(uint32_t);
+			case raw_type::UInt64: return sizeof(uint64_t);
 
-			case raw_type::Float: return (double) (*((float*)ptr));
-			case raw_type::Double: return (double) (*((double*)ptr));
+			case raw_type::Half: return sizeof(uint16_t);
+			case raw_type::Float: return sizeof(float);
+			case raw_type::Double: return sizeof(double);
+
+			case raw_type::Array: __builtin_unreachable(); break;
+		}
+		return 0;
+	}
+
+	static double unpack(raw_type type, const void* ptr)
+	{
+		switch(type)
+		{
+			case raw_type::SInt8: return (double) (*((const int8_t*)ptr));
+			case raw_type::SInt16: return (double) (*((const int16_t*)ptr));
+			case raw_type::SInt32: return (double) (*((const int32_t*)ptr));
+			case raw_type::SInt64: return (double) (*((const int64_t*)ptr));
+
+			case raw_type::UInt8: return (double) (*((const uint8_t*)ptr));
+			case raw_type::UInt16: return (double) (*((const uint16_t*)ptr));
+			case raw_type::UInt32: return (double) (*((const uint32_t*)ptr));
+			case raw_type::UInt64: return (double) (*((const uint64_t*)ptr));
+
+			case raw_type::Half: return (double) glm::unpackHalf1x16(*((const uint16_t*)ptr));
+			case raw_type::Float: return (double) (*((const float*)ptr));
+			case raw_type::Double: return (double) (*((const double*)ptr));
 
 			case raw_type::Array: __builtin_unreachable(); break;
 		}
 		return std::numeric_limits<double>::signaling_NaN();
 	}
 
-	data_value unpack_data::get(selector_type type, data_type dtype, VkHandle handle, global_context& global, local_context& local, rule& rule)
+#ifdef PACK_X86_F16C
+	// compiled for F16C regardless of the build flags, only called if the CPU supports it
+	F16C_TARGET static size_t half_to_float_f16c(const uint8_t* src, float* dst, size_t count)
 	{
-		if(!supports(type, dtype))
-			throw RULE_ERROR("cannot return data type "+CheekyLayer::rules::to_string(dtype));
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i*sizeof(uint16_t)))));
+		return i;
+	}
 
-		std::vector<uint8_t> v = std::get<std::vector<uint8_t>>(m_src->get(type, data_type::Raw, handle, global, local, rule));
+	F16C_TARGET static size_t float_to_half_f16c(const float* src, uint8_t* dst, size_t count)
+	{
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i*)(dst + i*sizeof(uint16_t)), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+		return i;
+	}
+#endif
 
-		int count = m_count == -1 ? 1 : m_count;
-		size_t theSize;
-		switch(m_rawType)
+	static bool has_f16c()
+	{
+#ifdef PACK_X86_F16C
+		static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+	static void half_to_float(const uint8_t* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+#ifdef PACK_X86_F16C
+		if(has_f16c())
+			i = half_to_float_f16c(src, dst, count);
+#endif
+		for(; i < count; i++)
 		{
-			case raw_type::SInt8: theSize = sizeof(int8_t); break;
-			case raw_type::SInt16: theSize = sizeof(int16_t); break;
-			case raw_type::SInt32: theSize = sizeof(int32_t); break;
-			case raw_type::SInt64: theSize = sizeof(int64_t); break;
+			uint16_t h;
+			std::memcpy(&h, src + i*sizeof(uint16_t), sizeof(h));
+			dst[i] = glm::unpackHalf1x16(h);
+		}
+	}
+
+	static void float_to_half(const float* src, uint8_t* dst, size_t count)
+	{
+		size_t i = 0;
+#ifdef PACK_X86_F16C
+		if(has_f16c())
+			i = float_to_half_f16c(src, dst, count);
+#endif
+		for(; i < count; i++)
+		{
+			uint16_t h = glm::packHalf1x16(src[i]);
+			std::memcpy(dst + i*sizeof(uint16_t), &h, sizeof(h));
+		}
+	}
+
+	template<typename T>
+	static number_array unpack_array(const uint8_t* src, size_t count)
+	{
+		// the elements are stored in their raw type, so this is a plain copy
+		std::vector<T> v(count);
+		std::memcpy(v.data(), src, count * sizeof(T));
+		return v;
+	}
+
+	static number_array unpack_array(raw_type type, const uint8_t* src, size_t count)
+	{
+		switch(type)
+		{
+			case raw_type::SInt8: return unpack_array<int8_t>(src, count);
+			case raw_type::SInt16: return unpack_array<int16_t>(src, count);
+			case raw_type::SInt32: return unpack_array<int32_t>(src, count);
+			case raw_type::SInt64: return unpack_array<int64_t>(src, count);
+
+			case raw_type::UInt8: return unpack_array<uint8_t>(src, count);
+			case raw_type::UInt16: return unpack_array<uint16_t>(src, count);
+			case raw_type::UInt32: return unpack_array<uint32_t>(src, count);
+			case raw_type::UInt64: return unpack_array<uint64_t>(src, count);
+
+			case raw_type::Half: {
+				std::vector<float> v(count);
+				half_to_float(src, v.data(), count);
+				return v; }
+			case raw_type::Float: return unpack_array<float>(src, count);
+			case raw_type::Double: return unpack_array<double>(src, count);
+
+			case raw_type::Array: __builtin_unreachable(); break;
+		}
+		__builtin_unreachable();
+	}
+
+	template<typename T>
+	static std::vector<T> to_typed(const data_list& list)
+	{
+		std::vector<T> v(list.size());
+		if(list.numbers)
+		{
+			std::visit([&v](const auto& src){
+				std::transform(src.begin(), src.end(), v.begin(), [](auto n){return static_cast<T>(n);});
+			}, *list.numbers);
+		}
+		else
+		{
+			std::transform(list.values.begin(), list.values.end(), v.begin(), [](const data_value& n){return static_cast<T>(std::get<double>(n));});
+		}
+		return v;
+	}
 
-			case raw_type::UInt8: theSize = sizeof(uint8_t); break;
-			case raw_type::UInt16: theSize = sizeof(uint16_t); break;
-			case raw_type::UInt32: theSize = sizeof(uint32_t); break;
-			case raw_type::UInt64: theSize = sizeof(uint64_t); break;
+	template<typename T>
+	static std::vector<uint8_t> pack_array(const data_list& list)
+	{
+		std::vector<uint8_t> out(list.size() * sizeof(T));
+		if(const std::vector<T>* same = list.numbers ? std::get_if<std::vector<T>>(&*list.numbers) : nullptr)
+		{
+			std::memcpy(out.data(), same->data(), out.size());
+		}
+		else
+		{
+			std::vector<T> converted = to_typed<T>(list);
+			std::memcpy(out.data(), converted.data(), out.size());
+		}
+		return out;
+	}
 
-			case raw_type::Float: theSize = sizeof(float); break;
-			case raw_type::Double: theSize = sizeof(double); break;
+	static std::vector<uint8_t> pack_array(raw_type type, const data_list& list)
+	{
+		switch(type)
+		{
+			case raw_type::SInt8: return pack_array<int8_t>(list);
+			case raw_type::SInt16: return pack_array<int16_t>(list);
+			case raw_type::SInt32: return pack_array<int32_t>(list);
+			case raw_type::SInt64: return pack_array<int64_t>(list);
+
+			case raw_type::UInt8: return pack_array<uint8_t>(list);
+			case raw_type::UInt16: return pack_array<uint16_t>(list);
+			case raw_type::UInt32: return pack_array<uint32_t>(list);
+			case raw_type::UInt64: return pack_array<uint64_t>(list);
+
+			case raw_type::Half: {
+				std::vector<float> floats = to_typed<float>(list);
+				std::vector<uint8_t> out(floats.size() * sizeof(uint16_t));
+				float_to_half(floats.data(), out.data(), floats.size());
+				return out; }
+			case raw_type::Float: return pack_array<float>(list);
+			case raw_type::Double: return pack_array<double>(list);
 
 			case raw_type::Array: __builtin_unreachable(); break;
 		}
-		if(v.size()-m_offset < theSize*count)
+		__builtin_unreachable();
+	}
+
+	const uint8_t* unpack_data::elements(std::span<const uint8_t> v)
+	{
+		size_t count = m_count == -1 ? 1 : m_count;
+		if(m_offset > v.size() || v.size()-m_offset < raw_size(m_rawType)*count)
 			throw RULE_ERROR("Raw data of size "+std::to_string(v.size())+" is not big enough to contain "+std::to_string(count)+" number(s) of type "
 				+to_string(m_rawType)+" at offset "+std::to_string(m_offset));
+		return v.data() + m_offset;
+	}
+
+	data_value unpack_data::get(selector_type type, data_type dtype, VkHandle handle, global_context& global, local_context& local, rule& rule)
+	{
+		if(!supports(type, dtype))
+			throw RULE_ERROR("cannot return data type "+CheekyLayer::rules::to_string(dtype));
 
-		void* ptr = v.data() + m_offset;
+		// keep the value alive, but do not copy the bytes out of raw views
+		data_value src = m_src->get(type, data_type::Raw, handle, global, local, rule);
+		const uint8_t* ptr = elements(raw_bytes(src));
 		if(m_count == -1)
 		{
 			return unpack(m_rawType, ptr);
 		}
 		else
 		{
-			data_list list{};
-			list.values.resize(m_count);
-			for(int i=0; i<m_count; i++)
-			{
-				list.values[i] = unpack(m_rawType, (char*)ptr + theSize*i);
-			}
-			return list;
+			return data_list(unpack_array(m_rawType, ptr, m_count));
 		}
 	}
 
+	void unpack_data::stream(selector_type type, VkHandle handle, global_context& global, local_context& local, rule& rule, const element_callback& f)
+	{
+		if(m_count == -1)
+			throw RULE_ERROR("cannot return data type "+CheekyLayer::rules::to_string(data_type::List));
+
+		data_value src = m_src->get(type, data_type::Raw, handle, global, local, rule);
+		const uint8_t* ptr = elements(raw_bytes(src));
+
+		// elements are unpacked in chunks, so the whole array is never held twice
+		constexpr size_t chunk_size = 256;
+		size_t theSize = raw_size(m_rawType);
+		data_value element = 0.0;
+		for(size_t first=0; first<(size_t)m_count; first+=chunk_size)
+		{
+			size_t count = std::min(chunk_size, m_count - first);
+			number_array chunk = unpack_array(m_rawType, ptr + theSize*first, count);
+			std::visit([&](const auto& numbers){
+				for(size_t i=0; i<count; i++)
+				{
+					element = static_cast<double>(numbers[i]);
+					f(element, first+i);
+				}
+			}, chunk);
+		}
+	}
+
+	std::optional<size_t> unpack_data::count_hint()
+	{
+		if(m_count == -1)
+			return std::nullopt;
+		return m_count;
+	}
+
 	bool unpack_data::supports(selector_type, data_type type)
 	{
 		return m_count == -1 ? type == Number : type == List;
@@ -191,17 +392,27 @@ namespace CheekyLayer::rules::datas
 		skip_ws(in);
 
 		if(m_rawType == raw_type::Array)
-			throw RULE_ERROR("\""+to_string(m_rawType)+"\" is not supported");
+		{
+			m_array = true;
+
+			std::getline(in, type, ',');
+			m_rawType = from_string(type);
+			skip_ws(in);
+
+			if(m_rawType == raw_type::Array)
+				throw RULE_ERROR("nested \""+to_string(m_rawType)+"\" is not supported");
+		}
 
 		m_src = read_data(in, m_type);
 		check_stream(in, ')');
 
-		if(!m_src->supports(m_type, data_type::Number))
+		data_type srcType = m_array ? data_type::List : data_type::Number;
+		if(!m_src->supports(m_type, srcType))
 		{
 			std::ostringstream of;
 			of << "Source \"";
 			m_src->print(of);
-			of << "\" does not support type Number.";
+			of << "\" does not support type " << CheekyLayer::rules::to_string(srcType) << ".";
 			throw RULE_ERROR(of.str());
 		}
 	}
@@ -211,28 +422,15 @@ namespace CheekyLayer::rules::datas
 		if(dtype != data_type::Raw)
 			throw RULE_ERROR("cannot return data type "+CheekyLayer::rules::to_string(dtype));
 
-		double d = std::get<double>(m_src->get(type, data_type::Number, handle, global, local, rule));
-
-		size_t minSize;
-		switch(m_rawType)
+		if(m_array)
 		{
-			case raw_type::SInt8: minSize = sizeof(int8_t); break;
-			case raw_type::SInt16: minSize = sizeof(int16_t); break;
-			case raw_type::SInt32: minSize = sizeof(int32_t); break;
-			case raw_type::SInt64: minSize = sizeof(int64_t); break;
-
-			case raw_type::UInt8: minSize = sizeof(uint8_t); break;
-			case raw_type::UInt16: minSize = sizeof(uint16_t); break;
-			case raw_type::UInt32: minSize = sizeof(uint32_t); break;
-			case raw_type::UInt64: minSize = sizeof(uint64_t); break;
-
-			case raw_type::Float: minSize = sizeof(float); break;
-			case raw_type::Double: minSize = sizeof(double); break;
-
-			case raw_type::Array: __builtin_unreachable(); break;
+			data_list list = std::get<data_list>(m_src->get(type, data_type::List, handle, global, local, rule));
+			return pack_array(m_rawType, list);
 		}
 
-		std::vector<uint8_t> v(minSize);
+		double d = std::get<double>(m_src->get(type, data_type::Number, handle, global, local, rule));
+
+		std::vector<uint8_t> v(raw_size(m_rawType));
 		void* ptr = v.data();
 
 		switch(m_rawType)
@@ -247,6 +445,7 @@ namespace CheekyLayer::rules::datas
 			case raw_type::UInt32: (*(uint32_t*)ptr) = (uint32_t) d; break;
 			case raw_type::UInt64: (*(uint64_t*)ptr) = (uint64_t) d; break;
 
+			case raw_type::Half: (*(uint16_t*)ptr) = glm::packHalf1x16((float) d); break;
 			case raw_type::Float: (*(float*)ptr) = (float) d; break;
 			case raw_type::Double: (*(double*)ptr) = (double) d; break;
 
@@ -262,7 +461,10 @@ namespace CheekyLayer::rules::datas
 
 	std::ostream& pack_data::print(std::ostream& out)
 	{
-		out << "pack(" << to_string(m_rawType) << ", ";
+		out << "pack(";
+		if(m_array)
+			out << to_string(raw_type::Array) << ", ";
+		out << to_string(m_rawType) << ", ";
 		m_src->print(out);
 		out << ")";
 		return out;
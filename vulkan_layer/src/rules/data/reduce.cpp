@@ -24,7 +24,7 @@ namespace CheekyLayer::rules::datas
 				okay = std::holds_alternative<std::string>(*local.currentReduction);
 				break;
 			case Raw:
-				okay = std::holds_alternative<std::vector<uint8_t>>(*local.currentReduction);
+				okay = is_raw(*local.currentReduction);
 				break;
 			case Handle:
 				okay = std::holds_alternative<VkHandle>(*local.currentReduction);
@@ -102,19 +102,20 @@ namespace CheekyLayer::rules::datas
 
 	data_value reduce_data::get(selector_type stype, data_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
-		data_list src = std::get<data_list>(m_src->get(stype, data_type::List, handle, global, local, rule));
-
 		auto savedElem = local.currentElement;
+		auto savedIndex = local.currentIndex;
 		auto savedRedu = local.currentReduction;
 
 		data_value val = m_init->get(stype, m_dstType, handle, global, local, rule);
-		local.currentReduction = &val;
-		for(data_value& elem : src.values)
-		{
+		m_src->stream(stype, handle, global, local, rule, [&](data_value& elem, size_t i){
+			// the source (e.g. a map) is evaluated in between, it must see the same reduction as without streaming
+			local.currentReduction = &val;
 			local.currentElement = &elem;
+			local.currentIndex = i;
 			val = m_accumulator->get(stype, m_dstType, handle, global, local, rule);
-		}
-		local.currentReduction = savedRedu;
+			local.currentReduction = savedRedu;
+		});
+		local.currentIndex = savedIndex;
 		local.currentElement = savedElem;
 
 		return val;
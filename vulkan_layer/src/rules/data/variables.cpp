@@ -2,13 +2,161 @@
 #include "rules/execution_env.hpp"
 #include "rules/rules.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <experimental/iterator>
+#include <mutex>
 #include <ranges>
 
+namespace CheekyLayer::rules
+{
+	bool is_raw(const data_value& value)
+	{
+		return std::holds_alternative<std::vector<uint8_t>>(value) || std::holds_alternative<raw_view>(value);
+	}
+
+	std::span<const uint8_t> raw_bytes(const data_value& value)
+	{
+		if(const raw_view* view = std::get_if<raw_view>(&value))
+			return view->bytes;
+		return std::get<std::vector<uint8_t>>(value);
+	}
+
+	data_value materialize(data_value value, bool keepOwned)
+	{
+		if(raw_view* view = std::get_if<raw_view>(&value))
+		{
+			if(keepOwned && view->owner)
+				return value;
+			return std::vector<uint8_t>(view->bytes.begin(), view->bytes.end());
+		}
+		if(data_list* list = std::get_if<data_list>(&value))
+		{
+			for(auto& v : list->values)
+				v = materialize(std::move(v), keepOwned);
+		}
+		return value;
+	}
+
+	int variable_slot(const std::string& name)
+	{
+		if(name.size() < 2 || name[0] != '_' || !std::all_of(name.begin()+1, name.end(), ::isdigit))
+			return -1;
+		return std::stoi(name.substr(1)) - 1;
+	}
+
+	const data_value* local_context::find_variable(const std::string& name, int slot) const
+	{
+		for(const variable_frame* f = frame; f; f = f->parent)
+		{
+			if(slot >= 0 && slot < f->arguments.size())
+				return &f->arguments[slot];
+			if(auto it = f->variables.find(name); it != f->variables.end())
+				return &it->second;
+		}
+		if(auto it = local_variables.find(name); it != local_variables.end())
+			return &it->second;
+		return nullptr;
+	}
+
+	void local_context::set_variable(const std::string& name, int slot, data_value value)
+	{
+		if(!frame)
+			local_variables[name] = std::move(value);
+		else if(slot >= 0 && slot < frame->arguments.size())
+			frame->arguments[slot] = std::move(value);
+		else
+			frame->variables[name] = std::move(value);
+	}
+
+	variable_map local_context::snapshot_variables() const
+	{
+		std::vector<const variable_frame*> frames;
+		for(const variable_frame* f = frame; f; f = f->parent)
+			frames.push_back(f);
+
+		// the snapshot outlives the hook, so views without an owner must not end up in it
+		variable_map vars;
+		for(const auto& [k, v] : local_variables)
+			vars[k] = materialize(v, true);
+		for(auto it = frames.rbegin(); it != frames.rend(); it++)
+		{
+			for(const auto& [k, v] : (*it)->variables)
+				vars[k] = materialize(v, true);
+			for(int i=0; i<(*it)->arguments.size(); i++)
+				vars["_"+std::to_string(i+1)] = materialize((*it)->arguments[i], true);
+		}
+		return vars;
+	}
+
+	const variable_store::variable* variable_store::find(const std::string& name) const
+	{
+		std::shared_lock lock(m_mutex);
+		auto it = m_variables.find(name);
+		return it != m_variables.end() ? it->second.get() : nullptr;
+	}
+
+	variable_store::snapshot variable_store::get(const std::string& name) const
+	{
+		const variable* v = find(name);
+		return v ? v->load() : nullptr;
+	}
+
+	variable_store::variable& variable_store::get_or_create(const std::string& name)
+	{
+		{
+			std::shared_lock lock(m_mutex);
+			if(auto it = m_variables.find(name); it != m_variables.end())
+				return *it->second;
+		}
+
+		std::unique_lock lock(m_mutex);
+		auto& v = m_variables[name];
+		if(!v)
+			v = std::make_unique<variable>();
+		return *v;
+	}
+
+	uint64_t variable_store::set(const std::string& name, data_value value)
+	{
+		variable& v = get_or_create(name);
+		auto next = std::make_shared<global_value>(std::move(value), 0);
+		snapshot current = v.m_value.load();
+		do
+		{
+			next->version = (current ? current->version : 0) + 1;
+		}
+		while(!v.m_value.compare_exchange_weak(current, next));
+		return next->version;
+	}
+
+	bool variable_store::compare_and_set(const std::string& name, uint64_t expected, data_value value)
+	{
+		variable& v = get_or_create(name);
+		snapshot current = v.m_value.load();
+		if((current ? current->version : 0) != expected)
+			return false;
+		return v.m_value.compare_exchange_strong(current, std::make_shared<const global_value>(std::move(value), expected+1));
+	}
+
+	std::vector<std::string> variable_store::names() const
+	{
+		std::shared_lock lock(m_mutex);
+		std::vector<std::string> names;
+		for(const auto& [name, v] : m_variables)
+		{
+			if(v->load())
+				names.push_back(name);
+		}
+		return names;
+	}
+}
+
 namespace CheekyLayer::rules::datas
 {
 	data_register<global_data> global_data::reg("global");
 	data_register<local_data> local_data::reg("local");
+	data_register<global_version_data> global_version_data::reg("global_version");
 
 	void global_data::read(std::istream& in)
 	{
@@ -22,15 +170,24 @@ namespace CheekyLayer::rules::datas
 
 	data_value global_data::get(selector_type, data_type type, VkHandle, global_context& global, local_context&, rule &)
 	{
-		if(!global.global_variables.contains(m_name))
+		const variable_store::variable* variable = m_variable.load(std::memory_order_acquire);
+		if(!variable)
+		{
+			variable = global.global_variables.find(m_name);
+			m_variable.store(variable, std::memory_order_release);
+		}
+
+		// keeps the value alive even if another thread replaces it
+		variable_store::snapshot value = variable ? variable->load() : nullptr;
+		if(!value)
 		{
 			auto message = fmt::format("no such global variable: {}, the following are available: {}", m_name,
-				fmt::join(global.global_variables | std::ranges::views::keys, ", "));
+				fmt::join(global.global_variables.names(), ", "));
 
 			throw RULE_ERROR(message);
 		}
 
-		auto& data = global.global_variables.at(m_name);
+		auto& data = value->value;
 
 		bool okay = true;
 		switch(type)
@@ -39,7 +196,7 @@ namespace CheekyLayer::rules::datas
 				okay = std::holds_alternative<std::string>(data);
 				break;
 			case Raw:
-				okay = std::holds_alternative<std::vector<uint8_t>>(data);
+				okay = is_raw(data);
 				break;
 			case Handle:
 				okay = std::holds_alternative<VkHandle>(data);
@@ -62,9 +219,31 @@ namespace CheekyLayer::rules::datas
 		return out << "global(" << m_name << ")";
 	}
 
+	void global_version_data::read(std::istream& in)
+	{
+		std::getline(in, m_name, ')');
+	}
+
+	bool global_version_data::supports(selector_type, data_type type)
+	{
+		return type == data_type::Number;
+	}
+
+	data_value global_version_data::get(selector_type, data_type, VkHandle, global_context& global, local_context&, rule &)
+	{
+		variable_store::snapshot value = global.global_variables.get(m_name);
+		return static_cast<double>(value ? value->version : 0);
+	}
+
+	std::ostream& global_version_data::print(std::ostream& out)
+	{
+		return out << "global_version(" << m_name << ")";
+	}
+
 	void local_data::read(std::istream& in)
 	{
 		std::getline(in, m_name, ')');
+		m_slot = variable_slot(m_name);
 	}
 
 	bool local_data::supports(selector_type, data_type)
@@ -74,15 +253,16 @@ namespace CheekyLayer::rules::datas
 
 	data_value local_data::get(selector_type, data_type type, VkHandle, global_context&, local_context& local, rule &)
 	{
-		if(!local.local_variables.contains(m_name))
+		const data_value* variable = local.find_variable(m_name, m_slot);
+		if(!variable)
 		{
 			auto message = fmt::format("no such local variable: {}, the following are available: {}", m_name,
-				fmt::join(local.local_variables | std::ranges::views::keys, ", "));
+				fmt::join(local.snapshot_variables() | std::ranges::views::keys, ", "));
 
 			throw RULE_ERROR(message);
 		}
 
-		auto& data = local.local_variables.at(m_name);
+		auto& data = *variable;
 
 		bool okay = true;
 		switch(type)
@@ -91,7 +271,7 @@ namespace CheekyLayer::rules::datas
 				okay = std::holds_alternative<std::string>(data);
 				break;
 			case Raw:
-				okay = std::holds_alternative<std::vector<uint8_t>>(data);
+				okay = is_raw(data);
 				break;
 			case Handle:
 				okay = std::holds_alternative<VkHandle>(data);
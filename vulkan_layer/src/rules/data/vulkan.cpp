@@ -16,37 +16,47 @@ namespace CheekyLayer::rules::datas
 		switch(m_type)
 		{
 			case selector_type::Pipeline:
-				reflection::parse_get_type(m_path, "VkGraphicsPipelineCreateInfo");
+				m_compiled = reflection::compile_path(m_path, "VkGraphicsPipelineCreateInfo");
 				break;
 			case selector_type::Draw:
-				reflection::parse_get_type(m_path, "VkCmdDrawIndexed");
+				m_compiled = reflection::compile_path(m_path, "VkCmdDrawIndexed");
+				try
+				{
+					m_compiledDraw = reflection::compile_path(m_path, "VkCmdDraw");
+				}
+				catch(const std::runtime_error&) {} // e.g. "indexCount" only exists for indexed draws
 				break;
 			default:
 				throw RULE_ERROR("cannot work with selector type "+to_string(m_type));
 		}
+		if(m_compiled.kind == reflection::primitive_kind::None)
+			throw RULE_ERROR("cannot return non-primitive and non-enum type \""+m_compiled.type+"\"");
 	}
 
 	data_value vkstruct_data::get(selector_type stype, data_type type, VkHandle handle, global_context& global, local_context& local, rule& rule)
 	{
+		if(!local.info)
+			throw RULE_ERROR("no Vulkan struct available, e.g. because the rule is executed asynchronously");
+
 		const void* structData;
-		std::string structType;
+		const reflection::compiled_path* path = &m_compiled;
 		switch(stype)
 		{
 			case selector_type::Pipeline:
 				structData = std::get<pipeline_info>(*local.info).info;
-				structType = "VkGraphicsPipelineCreateInfo";
 				break;
 			case selector_type::Draw: {
 				auto v = std::get<draw_info>(*local.info).info;
 				if(std::holds_alternative<const reflection::VkCmdDrawIndexed*>(v))
 				{
 					structData = std::get<const reflection::VkCmdDrawIndexed*>(v);
-					structType = "VkCmdDrawIndexed";
 				}
-				else if(std::holds_alternative<const reflection::VkCmdDraw*>(v))
+				else
 				{
+					if(!m_compiledDraw)
+						throw RULE_ERROR("path \""+m_path+"\" does not exist for non-indexed draws");
 					structData = std::get<const reflection::VkCmdDraw*>(v);
-					structType = "VkCmdDraw";
+					path = &*m_compiledDraw;
 				}
 				break;
 			}
@@ -57,11 +67,11 @@ namespace CheekyLayer::rules::datas
 		switch(type)
 		{
 			case data_type::Number:
-				return (double) std::any_cast<uint32_t>(reflection::parse_get(m_path, structData, structType));
+				return path->get_number(structData);
 			case data_type::String:
-				return reflection::parse_get_string(m_path, structData, structType);
+				return path->get_string(structData);
 			case data_type::Raw: {
-				uint32_t r = std::any_cast<uint32_t>(reflection::parse_get(m_path, structData, structType));
+				uint32_t r = path->get_raw(structData);
 				std::vector<uint8_t> v(sizeof(r));
 				std::copy((uint8_t*)&r, (uint8_t*)(&r+1), v.begin());
 				return v; }
@@ -100,6 +110,8 @@ namespace CheekyLayer::rules::datas
 
 	data_value vkdescriptor_data::get(selector_type, data_type, VkHandle, global_context& global, local_context& local, rule &)
 	{
+		if(!local.commandBufferState)
+			throw RULE_ERROR("no command buffer state available, e.g. because the rule is executed asynchronously");
 		VkDescriptorSet set = local.commandBufferState->descriptorSets.at(m_set);
 		const descriptor_state& descriptorState = local.device->descriptorStates.at(set);
 		const descriptor_binding& binding = descriptorState.bindings.at(m_binding);
@@ -31,9 +31,9 @@ namespace CheekyLayer::rules::ipc
 		m_stream->close();
 	}
 
-	size_t local_file::write(std::vector<uint8_t>& data, int arg)
+	size_t local_file::write(std::span<const uint8_t> data, int arg)
 	{
-		m_stream->write((char*)data.data(), data.size());
+		m_stream->write((const char*)data.data(), data.size());
 		return data.size();
 	}
 
@@ -120,12 +120,12 @@ namespace CheekyLayer::rules::ipc
 		::close(m_fd);
 	}
 
-	size_t socket::writeRaw(void* buf, size_t size)
+	size_t socket::writeRaw(const void* buf, size_t size)
 	{
 		return ::write(m_fd, buf, size);
 	}
 
-	size_t socket::write(std::vector<uint8_t>& data, int arg)
+	size_t socket::write(std::span<const uint8_t> data, int arg)
 	{
 		switch(m_protocol)
 		{
@@ -147,13 +147,18 @@ namespace CheekyLayer::rules::ipc
 	}
 
 	constexpr size_t RECEIVE_BUFFER_SIZE = 1024;
-	void listen_helper(std::stop_token& stop, protocol_type protocol, int fd, std::function<void(uint8_t*, size_t)> handler)
+	void listen_helper(std::stop_token& stop, protocol_type protocol, int fd, std::function<void(std::shared_ptr<const void>, uint8_t*, size_t)> handler)
 	{
 		if(protocol == protocol_type::Raw)
 		{
-			std::vector<uint8_t> buffer(RECEIVE_BUFFER_SIZE);
+			auto owner = std::make_shared<std::vector<uint8_t>>(RECEIVE_BUFFER_SIZE);
 			while(!stop.stop_requested())
 			{
+				// only reuse the buffer if no rule kept a view of the last message
+				if(owner.use_count() > 1)
+					owner = std::make_shared<std::vector<uint8_t>>(RECEIVE_BUFFER_SIZE);
+				std::vector<uint8_t>& buffer = *owner;
+
 				struct pollfd pfd = { fd, POLLIN , 0 };
 				if(poll(&pfd, 1, 100) > 0)
 				{
@@ -177,7 +182,7 @@ namespace CheekyLayer::rules::ipc
 						spdlog::error("Receive failed: {}", ex.what());
 					}
 
-					handler(buffer.data(), buffer.size());
+					handler(owner, buffer.data(), buffer.size());
 
 					total = 0;
 					buffer.resize(RECEIVE_BUFFER_SIZE);
@@ -195,11 +200,11 @@ namespace CheekyLayer::rules::ipc
 					size_t size;
 					if((n = read(fd, &size, sizeof(size))) == sizeof(size))
 					{
-						uint8_t* buffer = new uint8_t[size];
+						auto buffer = std::make_shared_for_overwrite<uint8_t[]>(size);
 
-						n = read(fd, buffer, size);
+						n = read(fd, buffer.get(), size);
 
-						handler(buffer, n);
+						handler(buffer, buffer.get(), n);
 					}
 					else if(n == 0) break;
 					else if(n < 0) break;
@@ -222,10 +227,10 @@ namespace CheekyLayer::rules::ipc
 					auto pos = std::find(buf, buf+RECEIVE_BUFFER_SIZE, '\n');
 					if(pos != (buf+RECEIVE_BUFFER_SIZE))
 					{
-						std::string data = buffer + std::string(buf, std::distance(buf, pos));
+						auto data = std::make_shared<std::string>(buffer + std::string(buf, std::distance(buf, pos)));
 						buffer = std::string(pos+1, std::distance(pos+1, buf+n)); // pos+1 -> skip \n
 
-						handler((uint8_t*)data.data(), data.size());
+						handler(data, (uint8_t*)data->data(), data->size());
 					}
 					else
 					{
@@ -238,8 +243,8 @@ namespace CheekyLayer::rules::ipc
 
 	void socket::receiveThread(std::stop_token stop)
 	{
-		listen_helper(stop, m_protocol, m_fd, [this](uint8_t* data, size_t size){
-			receive_info info = { .socket = this, .buffer = data, .size = size };
+		listen_helper(stop, m_protocol, m_fd, [this](std::shared_ptr<const void> owner, uint8_t* data, size_t size){
+			receive_info info = { .socket = this, .buffer = data, .size = size, .owner = std::move(owner) };
 			calling_context ctx{
 				.info = info,
 				.local_variables = {{"socket:name", m_name}}
@@ -337,8 +342,8 @@ namespace CheekyLayer::rules::ipc
 			}
 		}
 
-		listen_helper(stop, m_protocol, fd, [this, fd](uint8_t* data, size_t size){
-			receive_info info = { .socket = this, .buffer = data, .size = size };
+		listen_helper(stop, m_protocol, fd, [this, fd](std::shared_ptr<const void> owner, uint8_t* data, size_t size){
+			receive_info info = { .socket = this, .buffer = data, .size = size, .owner = std::move(owner) };
 			calling_context ctx{
 				.info = info,
 				.local_variables = {{"socket:name", m_name}}
@@ -353,7 +358,7 @@ namespace CheekyLayer::rules::ipc
 		LOGGER->info("client {} ({}:{}) for server {} disconnected", fd, ip, port, m_name);
 	}
 
-	size_t server_socket::write(std::vector<uint8_t>& data, int fd)
+	size_t server_socket::write(std::span<const uint8_t> data, int fd)
 	{
 		switch(m_protocol)
 		{
@@ -374,7 +379,7 @@ namespace CheekyLayer::rules::ipc
 		return -1;
 	}
 
-	size_t server_socket::writeRaw(int fd, void* buf, size_t size)
+	size_t server_socket::writeRaw(int fd, const void* buf, size_t size)
 	{
 		return ::write(fd, buf, size);
 	}
@@ -1,9 +1,14 @@
 #include "rules/rules.hpp"
 #include "rules/execution_env.hpp"
+#include "rules/ruleset.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
+#include <iomanip>
 #include <istream>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 
@@ -27,6 +32,30 @@ namespace CheekyLayer::rules
 			throw std::runtime_error("expected '"+std::string(1, expected)+"' but got '"+std::string(1, static_cast<char>(c))+"' ("+std::to_string(c)+") instead");
 	}
 
+	static thread_local const std::unordered_set<std::string>* default_async_actions = nullptr;
+
+	default_async_scope::default_async_scope(const std::unordered_set<std::string>& actions) : m_previous(default_async_actions)
+	{
+		default_async_actions = &actions;
+	}
+
+	default_async_scope::~default_async_scope()
+	{
+		default_async_actions = m_previous;
+	}
+
+	bool is_async_action(const std::string& name)
+	{
+		try
+		{
+			return action_factory::make_unique_action(name, selector_type::Custom)->async_safe();
+		}
+		catch(const std::exception&)
+		{
+			return false;
+		}
+	}
+
 	std::unique_ptr<action> read_action(std::istream& in, selector_type type)
 	{
 		std::string actionType;
@@ -35,6 +64,12 @@ namespace CheekyLayer::rules
 		skip_ws(in);
 		std::unique_ptr<action> cptr = action_factory::make_unique_action(actionType, type);
 		cptr->read(in);
+		if(default_async_actions && default_async_actions->contains(actionType))
+		{
+			if(!cptr->async_safe())
+				throw std::runtime_error("the \""+actionType+"\" action is asynchronous by default, but contains actions that cannot be executed asynchronously");
+			return make_async_action(std::move(cptr), type);
+		}
 		return cptr;
 	}
 
@@ -82,6 +117,11 @@ namespace CheekyLayer::rules
 		return cptr;
 	}
 
+	void data::stream(selector_type stype, VkHandle handle, global_context& global, local_context& local, rule& rule, const element_callback& f)
+	{
+		std::get<data_list>(get(stype, data_type::List, handle, global, local, rule)).for_each(f);
+	}
+
 	std::istream& operator>>(std::istream& in, selector& selector)
 	{
 		std::string type;
@@ -188,6 +228,42 @@ namespace CheekyLayer::rules
 		}
 	}
 
+	size_t data_list::size() const
+	{
+		if(numbers)
+			return std::visit([](const auto& v){return v.size();}, *numbers);
+		return values.size();
+	}
+
+	double data_list::number_at(size_t index) const
+	{
+		if(numbers)
+			return std::visit([index](const auto& v){return static_cast<double>(v.at(index));}, *numbers);
+		return std::get<double>(values.at(index));
+	}
+
+	data_value data_list::at(size_t index) const
+	{
+		if(numbers)
+			return number_at(index);
+		return values.at(index);
+	}
+
+	std::vector<data_value>& data_list::boxed()
+	{
+		if(numbers)
+		{
+			std::visit([this](const auto& v){
+				values.clear();
+				values.reserve(v.size());
+				for(auto n : v)
+					values.push_back(static_cast<double>(n));
+			}, *numbers);
+			numbers.reset();
+		}
+		return values;
+	}
+
 	data_type data_type_from_string(const std::string& s)
 	{
 		if(s=="string")
@@ -215,6 +291,16 @@ namespace CheekyLayer::rules
 		return true;
 	}
 
+	const std::string* selector::custom_tag() const
+	{
+		for(auto& c : m_conditions)
+		{
+			if(const std::string* tag = c->custom_tag())
+				return tag;
+		}
+		return nullptr;
+	}
+
 	void rule::execute(selector_type type, VkHandle handle, global_context& global, local_context& local)
 	{
 		if(m_disabled)
@@ -224,6 +310,53 @@ namespace CheekyLayer::rules
 			m_action->execute(type, handle, global, local, *this);
 	}
 
+	void rule::execute_profiled(selector_type type, VkHandle handle, global_context& global, local_context& local)
+	{
+		if(m_disabled)
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+		struct profile_timer {
+			rule_profile& profile;
+			std::chrono::steady_clock::time_point start;
+
+			~profile_timer() {
+				uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				profile.totalNanoseconds.fetch_add(ns, std::memory_order_relaxed);
+				uint64_t max = profile.maxNanoseconds.load(std::memory_order_relaxed);
+				while(ns > max && !profile.maxNanoseconds.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+			}
+		} timer = {m_profile, start};
+
+		m_profile.invocations.fetch_add(1, std::memory_order_relaxed);
+		if(m_selector->test(type, handle, global, local))
+		{
+			m_profile.passed.fetch_add(1, std::memory_order_relaxed);
+			m_action->execute(type, handle, global, local, *this);
+			m_profile.executed.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void rule::reset_profile()
+	{
+		m_profile.invocations = 0;
+		m_profile.passed = 0;
+		m_profile.executed = 0;
+		m_profile.totalNanoseconds = 0;
+		m_profile.maxNanoseconds = 0;
+	}
+
+	void rule::migrate(rule& previous)
+	{
+		m_disabled = previous.m_disabled;
+		m_action->migrate(*previous.m_action);
+	}
+
+	void rule::retire()
+	{
+		m_action->retire();
+	}
+
 	void rule::disable()
 	{
 		m_disabled = true;
@@ -233,13 +366,17 @@ namespace CheekyLayer::rules
 		}
 	}
 
-	void execute_rules(std::vector<std::unique_ptr<rule>>& rules, selector_type type, VkHandle handle, global_context& global, local_context& local)
+	template<bool profiled, typename Rules>
+	void execute_rules_impl(const Rules& rules, selector_type type, VkHandle handle, global_context& global, local_context& local)
 	{
 		for(auto& r : rules)
 		{
 			try
 			{
-				r->execute(type, handle, global, local);
+				if constexpr (profiled)
+					r->execute_profiled(type, handle, global, local);
+				else
+					r->execute(type, handle, global, local);
 			}
 			catch(const rule_error& ex)
 			{
@@ -259,6 +396,61 @@ namespace CheekyLayer::rules
 		}
 	}
 
+	void execute_rules(ruleset& rules, selector_type type, VkHandle handle, global_context& global, local_context& local)
+	{
+		local.currentRuleset = &rules;
+		if(type == selector_type::Custom)
+		{
+			// only visit the rules that can match the tag
+			const auto& custom = rules.custom_rules(local.customTag);
+			if(global.profile_rules)
+				execute_rules_impl<true>(custom, type, handle, global, local);
+			else
+				execute_rules_impl<false>(custom, type, handle, global, local);
+			return;
+		}
+
+		if(global.profile_rules)
+			execute_rules_impl<true>(rules.rules, type, handle, global, local);
+		else
+			execute_rules_impl<false>(rules.rules, type, handle, global, local);
+	}
+
+	void profile_reset(ruleset& rules)
+	{
+		for(auto& r : rules.rules)
+			r->reset_profile();
+	}
+
+	std::string profile_report(ruleset& rules)
+	{
+		std::vector<rule*> sorted;
+		std::transform(rules.rules.begin(), rules.rules.end(), std::back_inserter(sorted), [](auto& r){return r.get();});
+		std::stable_sort(sorted.begin(), sorted.end(), [](rule* a, rule* b){
+			return a->profile().totalNanoseconds > b->profile().totalNanoseconds;
+		});
+
+		std::ostringstream out;
+		out << "rule profile:\n";
+		out << "  | total ms |   max us | invocations | passed % | executed | rule\n";
+		for(rule* r : sorted)
+		{
+			const rule_profile& p = r->profile();
+			uint64_t invocations = p.invocations;
+			double passed = invocations ? 100.0 * p.passed / invocations : 0.0;
+
+			out << "  | " << std::setw(8) << std::fixed << std::setprecision(2) << p.totalNanoseconds / 1e6
+				<< " | " << std::setw(8) << std::setprecision(1) << p.maxNanoseconds / 1e3
+				<< " | " << std::setw(11) << invocations
+				<< " | " << std::setw(8) << std::setprecision(1) << passed
+				<< " | " << std::setw(8) << p.executed.load()
+				<< " | ";
+			r->print(out);
+			out << '\n';
+		}
+		return out.str();
+	}
+
 	std::ostream& rule::print(std::ostream &out)
 	{
 		m_selector->print(out);
@@ -0,0 +1,164 @@
+#include "rules/ruleset.hpp"
+#include "rules/reader.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace CheekyLayer::rules
+{
+	void ruleset::migrate_from(ruleset& previous)
+	{
+		std::unordered_multimap<std::string, rule*> old;
+		for(auto& r : previous.rules)
+		{
+			std::ostringstream oss;
+			r->print(oss);
+			old.emplace(oss.str(), r.get());
+		}
+
+		for(auto& r : rules)
+		{
+			std::ostringstream oss;
+			r->print(oss);
+			if(auto it = old.find(oss.str()); it != old.end())
+			{
+				r->migrate(*it->second);
+				old.erase(it);
+			}
+		}
+	}
+
+	void ruleset::build_index()
+	{
+		m_customByTag.clear();
+		m_customUntagged.clear();
+		for(auto& r : rules)
+		{
+			if(r->get_type() != selector_type::Custom)
+				continue;
+			if(const std::string* tag = r->custom_tag())
+				m_customByTag.try_emplace(*tag);
+		}
+
+		for(auto& r : rules)
+		{
+			if(r->get_type() != selector_type::Custom)
+				continue;
+			if(const std::string* tag = r->custom_tag())
+			{
+				m_customByTag[*tag].push_back(r.get());
+			}
+			else
+			{
+				m_customUntagged.push_back(r.get());
+				for(auto& [_, tagged] : m_customByTag)
+					tagged.push_back(r.get());
+			}
+		}
+	}
+
+	const std::vector<rule*>& ruleset::custom_rules(const std::string& tag) const
+	{
+		auto it = m_customByTag.find(tag);
+		return it != m_customByTag.end() ? it->second : m_customUntagged;
+	}
+
+	void ruleset::retire()
+	{
+		for(auto& r : rules)
+			r->retire();
+	}
+
+	parsed_ruleset parse_ruleset(const std::filesystem::path& file, spdlog::logger& logger, const std::unordered_set<std::string>& asyncActions)
+	{
+		parsed_ruleset result = {std::make_shared<ruleset>(), true};
+		default_async_scope scope(asyncActions);
+
+		std::ifstream rulesIn(file);
+		numbered_streambuf numberer{rulesIn};
+		while(rulesIn.good())
+		{
+			try
+			{
+				std::unique_ptr<rule> rule = std::make_unique<CheekyLayer::rules::rule>();
+				rulesIn >> *rule;
+
+				result.rules->rules.push_back(std::move(rule));
+			}
+			catch(const std::exception& ex)
+			{
+				logger.error("Error at {}:{}: {}", numberer.line(), numberer.col(), ex.what());
+				result.complete = false;
+				break;
+			}
+		}
+		result.rules->build_index();
+		return result;
+	}
+
+	std::shared_ptr<ruleset> local_context::keep_rules_alive() const
+	{
+		return currentRuleset ? currentRuleset->shared_from_this() : nullptr;
+	}
+
+	ruleset_holder::reader::reader(ruleset_holder& holder) : m_holder(holder)
+	{
+		// the counter is incremented before the pointer is loaded, so publish() cannot miss us
+		m_parity = holder.m_epoch.load() & 1;
+		holder.m_readers[m_parity].fetch_add(1);
+		m_ruleset = holder.m_current.load();
+	}
+
+	ruleset_holder::reader::~reader()
+	{
+		m_holder.m_readers[m_parity].fetch_sub(1, std::memory_order_release);
+	}
+
+	ruleset_holder::ruleset_holder()
+	{
+		m_owner = std::make_shared<ruleset>();
+		m_current = m_owner.get();
+	}
+
+	ruleset_holder& ruleset_holder::operator=(ruleset_holder&& other)
+	{
+		m_owner = std::move(other.m_owner);
+		m_current = m_owner.get();
+		other.m_owner = std::make_shared<ruleset>();
+		other.m_current = other.m_owner.get();
+		return *this;
+	}
+
+	std::shared_ptr<ruleset> ruleset_holder::current()
+	{
+		std::scoped_lock lock(m_writeLock);
+		return m_owner;
+	}
+
+	std::shared_ptr<ruleset> ruleset_holder::publish(std::shared_ptr<ruleset> next)
+	{
+		std::scoped_lock lock(m_writeLock);
+		next->generation = m_owner->generation + 1;
+		m_current.store(next.get());
+		synchronize();
+
+		std::shared_ptr<ruleset> previous = std::move(m_owner);
+		m_owner = std::move(next);
+		return previous;
+	}
+
+	void ruleset_holder::synchronize()
+	{
+		// A reader might have read the epoch right before the previous flip and only incremented
+		// its counter afterwards, so both counters have to drain once.
+		for(int phase=0; phase<2; phase++)
+		{
+			size_t parity = m_epoch.fetch_add(1) & 1;
+			while(m_readers[parity].load() != 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+}
@@ -0,0 +1,235 @@
+#include "rules/scheduler.hpp"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace CheekyLayer::rules
+{
+	timer_scheduler::~timer_scheduler()
+	{
+		shutdown();
+	}
+
+	timer_scheduler::timer_id timer_scheduler::every(std::chrono::milliseconds period, task t)
+	{
+		std::unique_lock lock(m_mutex);
+		if(m_shutdown)
+			return 0;
+		if(!m_thread.joinable())
+			start();
+
+		timer_id id = m_next++;
+		uint64_t ticks = std::max<uint64_t>(period / tick, 1);
+		insert({id, now_tick(), ticks, false, std::move(t)});
+
+		m_changed = true;
+		m_wakeup.notify_one();
+		return id;
+	}
+
+	timer_scheduler::timer_id timer_scheduler::every_frames(uint64_t frames, task t)
+	{
+		std::unique_lock lock(m_mutex);
+		if(m_shutdown)
+			return 0;
+		if(!m_thread.joinable())
+			start();
+
+		timer_id id = m_next++;
+		frames = std::max<uint64_t>(frames, 1);
+		m_frameTimers.push_back({id, m_frame.load() + frames, frames, true, std::move(t)});
+		update_next_frame();
+		return id;
+	}
+
+	void timer_scheduler::cancel(timer_id id)
+	{
+		std::unique_lock lock(m_mutex);
+		auto matches = [id](const timer& t){return t.id == id;};
+		for(auto& slot : m_wheel)
+			m_timerCount -= std::erase_if(slot, matches);
+		if(std::erase_if(m_frameTimers, matches))
+			update_next_frame();
+
+		if(m_running.contains(id))
+		{
+			m_cancelled.insert(id);
+			if(std::this_thread::get_id() != m_thread.get_id())
+				m_finished.wait(lock, [this, id]{return !m_running.contains(id);});
+		}
+	}
+
+	void timer_scheduler::frame()
+	{
+		// only take the lock if a frame timer is actually due
+		if(++m_frame < m_nextFrame.load(std::memory_order_relaxed))
+			return;
+
+		std::unique_lock lock(m_mutex);
+		m_changed = true;
+		m_wakeup.notify_one();
+	}
+
+	void timer_scheduler::shutdown()
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_shutdown = true;
+			for(auto& slot : m_wheel)
+				slot.clear();
+			m_timerCount = 0;
+			m_frameTimers.clear();
+			update_next_frame();
+		}
+		if(m_thread.joinable())
+		{
+			m_thread.request_stop();
+			m_thread.join();
+		}
+	}
+
+	void timer_scheduler::start()
+	{
+		m_tick = now_tick();
+		m_thread = std::jthread([this](std::stop_token stop){
+			run(stop);
+		});
+	}
+
+	void timer_scheduler::run(std::stop_token stop)
+	{
+		std::vector<timer> due;
+
+		std::unique_lock lock(m_mutex);
+		while(!stop.stop_requested())
+		{
+			collect_due(due);
+			if(due.empty())
+			{
+				m_changed = false;
+				if(auto next = next_due())
+					m_wakeup.wait_until(lock, stop, m_epoch + *next * tick, [this]{return m_changed;});
+				else
+					m_wakeup.wait(lock, stop, [this]{return m_changed;});
+				continue;
+			}
+
+			for(auto& t : due)
+				m_running.insert(t.id);
+			lock.unlock();
+
+			for(auto& t : due)
+			{
+				try
+				{
+					t.t();
+				}
+				catch(const std::exception& ex)
+				{
+					spdlog::error("Failed to execute scheduled action: {}", ex.what());
+				}
+			}
+
+			lock.lock();
+			for(auto& t : due)
+			{
+				m_running.erase(t.id);
+				if(m_cancelled.erase(t.id) || m_shutdown)
+					continue;
+				reschedule(std::move(t));
+			}
+			due.clear();
+			m_finished.notify_all();
+		}
+	}
+
+	uint64_t timer_scheduler::now_tick() const
+	{
+		return (clock::now() - m_epoch) / tick;
+	}
+
+	void timer_scheduler::insert(timer t)
+	{
+		// ticks before m_tick were already processed
+		t.due = std::max(t.due, m_tick);
+		m_wheel[t.due % wheel_size].push_back(std::move(t));
+		m_timerCount++;
+	}
+
+	void timer_scheduler::collect_due(std::vector<timer>& due)
+	{
+		uint64_t now = now_tick();
+		if(m_timerCount > 0 && now >= m_tick)
+		{
+			// every slot is visited at most once, even if we slept for more than a whole turn of the wheel
+			uint64_t last = std::min(now, m_tick + wheel_size - 1);
+			for(uint64_t t = m_tick; t <= last; t++)
+			{
+				auto& slot = m_wheel[t % wheel_size];
+				auto it = std::partition(slot.begin(), slot.end(), [now](const timer& e){return e.due > now;});
+				std::move(it, slot.end(), std::back_inserter(due));
+				m_timerCount -= std::distance(it, slot.end());
+				slot.erase(it, slot.end());
+			}
+		}
+		m_tick = std::max(m_tick, now + 1);
+
+		uint64_t frame = m_frame.load();
+		if(frame >= m_nextFrame.load())
+		{
+			auto it = std::partition(m_frameTimers.begin(), m_frameTimers.end(), [frame](const timer& e){return e.due > frame;});
+			std::move(it, m_frameTimers.end(), std::back_inserter(due));
+			m_frameTimers.erase(it, m_frameTimers.end());
+			update_next_frame();
+		}
+	}
+
+	void timer_scheduler::reschedule(timer t)
+	{
+		uint64_t now = t.frames ? m_frame.load() : now_tick();
+		t.due += t.period;
+		if(t.due <= now)
+		{
+			// we fell behind, skip the missed runs instead of running them back to back
+			t.due += (now - t.due) / t.period * t.period + t.period;
+		}
+
+		if(t.frames)
+		{
+			m_frameTimers.push_back(std::move(t));
+			update_next_frame();
+		}
+		else
+		{
+			insert(std::move(t));
+		}
+	}
+
+	std::optional<uint64_t> timer_scheduler::next_due() const
+	{
+		if(m_timerCount == 0)
+			return std::nullopt;
+
+		for(uint64_t t = m_tick; t < m_tick + wheel_size; t++)
+		{
+			auto& slot = m_wheel[t % wheel_size];
+			if(std::ranges::any_of(slot, [t](const timer& e){return e.due == t;}))
+				return t;
+		}
+
+		// nothing due within one turn of the wheel
+		uint64_t next = std::numeric_limits<uint64_t>::max();
+		for(auto& slot : m_wheel)
+			for(auto& e : slot)
+				next = std::min(next, e.due);
+		return next;
+	}
+
+	void timer_scheduler::update_next_frame()
+	{
+		uint64_t next = std::numeric_limits<uint64_t>::max();
+		for(auto& t : m_frameTimers)
+			next = std::min(next, t.due);
+		m_nextFrame = next;
+	}
+}
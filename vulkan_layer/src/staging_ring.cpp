@@ -0,0 +1,238 @@
+#include "staging_ring.hpp"
+
+#include "objects.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vulkan/vulkan.hpp>
+
+namespace CheekyLayer {
+
+staging_ring::~staging_ring() {
+    destroy();
+}
+
+void staging_ring::configure(device* device, VkDeviceSize capacity) {
+    std::unique_lock lock(m_mutex);
+    if(m_buffer != VK_NULL_HANDLE)
+        return; // the ring was already created with the old capacity
+    m_device = device;
+    m_capacity = capacity;
+    m_alignment = std::max<VkDeviceSize>(device->props.limits.optimalBufferCopyOffsetAlignment, 16);
+}
+
+bool staging_ring::create() {
+    device& dev = *m_device;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_capacity;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(VkResult result = dev.dispatch.CreateBuffer(*dev, &bufferInfo, nullptr, &m_buffer); result != VK_SUCCESS) {
+        dev.logger->error("Failed to create staging ring of {} bytes: {}", m_capacity, vk::to_string((vk::Result)result));
+        m_buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    dev.dispatch.GetBufferMemoryRequirements(*dev, m_buffer, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = findMemoryType(dev.memProperties, requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(VkResult result = dev.dispatch.AllocateMemory(*dev, &allocateInfo, nullptr, &m_memory); result != VK_SUCCESS) {
+        dev.logger->error("Failed to allocate memory for staging ring of {} bytes: {}", m_capacity, vk::to_string((vk::Result)result));
+        dev.dispatch.DestroyBuffer(*dev, m_buffer, nullptr);
+        m_buffer = VK_NULL_HANDLE;
+        m_memory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    if(dev.dispatch.BindBufferMemory(*dev, m_buffer, m_memory, 0) != VK_SUCCESS ||
+        dev.dispatch.MapMemory(*dev, m_memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&m_data)) != VK_SUCCESS) {
+        dev.logger->error("Failed to bind and map memory of staging ring");
+        dev.dispatch.DestroyBuffer(*dev, m_buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, m_memory, nullptr);
+        m_buffer = VK_NULL_HANDLE;
+        m_memory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    dev.logger->debug("Created staging ring of {} bytes", m_capacity);
+    return true;
+}
+
+bool staging_ring::suballocate(VkDeviceSize size, VkDeviceSize& offset) {
+    if(m_blocks.empty()) {
+        if(size > m_capacity)
+            return false;
+        offset = 0;
+        m_head = size;
+        return true;
+    }
+
+    VkDeviceSize tail = m_blocks.front().offset;
+    VkDeviceSize head = (m_head + m_alignment - 1) / m_alignment * m_alignment;
+    if(m_head > tail) {
+        // the used memory is [tail, m_head), try the end first and then wrap around
+        if(head + size <= m_capacity) {
+            offset = head;
+        } else if(size <= tail) {
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else {
+        // wrapped around, the free memory is [m_head, tail)
+        if(head + size > tail)
+            return false;
+        offset = head;
+    }
+    m_head = offset + size;
+    return true;
+}
+
+staging_ring::allocation staging_ring::allocate(VkDeviceSize size) {
+    size = std::max<VkDeviceSize>(size, 1);
+    {
+        std::unique_lock lock(m_mutex);
+        m_allocations++;
+        if(m_capacity > 0 && !m_failed) {
+            if(m_buffer == VK_NULL_HANDLE && !create())
+                m_failed = true; // do not try again for every allocation
+            reclaim();
+
+            VkDeviceSize offset;
+            if(m_buffer != VK_NULL_HANDLE && suballocate(size, offset)) {
+                uint64_t id = m_next++;
+                m_blocks.push_back({id, offset, size, false, VK_NULL_HANDLE});
+                return {m_buffer, offset, size, m_data + offset, id, VK_NULL_HANDLE};
+            }
+        }
+        m_dedicated++;
+    }
+    return allocate_dedicated(size);
+}
+
+staging_ring::allocation staging_ring::allocate_dedicated(VkDeviceSize size) {
+    device& dev = *m_device;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if(VkResult result = dev.dispatch.CreateBuffer(*dev, &bufferInfo, nullptr, &buffer); result != VK_SUCCESS)
+        throw std::runtime_error("failed to create staging buffer: "+vk::to_string((vk::Result)result));
+
+    VkMemoryRequirements requirements;
+    dev.dispatch.GetBufferMemoryRequirements(*dev, buffer, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = findMemoryType(dev.memProperties, requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkDeviceMemory memory;
+    if(dev.dispatch.AllocateMemory(*dev, &allocateInfo, nullptr, &memory) != VK_SUCCESS) {
+        dev.dispatch.DestroyBuffer(*dev, buffer, nullptr);
+        throw std::runtime_error("failed to allocate memory for staging buffer");
+    }
+
+    void* data;
+    if(dev.dispatch.BindBufferMemory(*dev, buffer, memory, 0) != VK_SUCCESS ||
+        dev.dispatch.MapMemory(*dev, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+        dev.dispatch.DestroyBuffer(*dev, buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, memory, nullptr);
+        throw std::runtime_error("failed to bind and map memory of staging buffer");
+    }
+
+    return {buffer, 0, size, static_cast<uint8_t*>(data), 0, memory};
+}
+
+void staging_ring::release(const allocation& a, VkFence fence) {
+    std::unique_lock lock(m_mutex);
+    if(a.memory != VK_NULL_HANDLE) {
+        m_pendingDedicated.push_back({a.buffer, a.memory, fence});
+    } else {
+        auto it = std::ranges::find_if(m_blocks, [&a](const block& b){return b.id == a.id;});
+        if(it != m_blocks.end()) {
+            it->released = true;
+            it->fence = fence;
+        }
+    }
+    reclaim();
+}
+
+bool staging_ring::signaled(VkFence fence) {
+    return fence == VK_NULL_HANDLE || m_device->dispatch.GetFenceStatus(**m_device, fence) == VK_SUCCESS;
+}
+
+void staging_ring::reclaim() {
+    device& dev = *m_device;
+
+    // memory is reused in allocation order, so only the oldest blocks can be freed
+    while(!m_blocks.empty() && m_blocks.front().released && signaled(m_blocks.front().fence)) {
+        if(m_blocks.front().fence != VK_NULL_HANDLE)
+            dev.dispatch.DestroyFence(*dev, m_blocks.front().fence, nullptr);
+        m_blocks.pop_front();
+    }
+    if(m_blocks.empty())
+        m_head = 0;
+
+    std::erase_if(m_pendingDedicated, [this, &dev](const dedicated_block& b){
+        if(!signaled(b.fence))
+            return false;
+        dev.dispatch.DestroyBuffer(*dev, b.buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, b.memory, nullptr);
+        if(b.fence != VK_NULL_HANDLE)
+            dev.dispatch.DestroyFence(*dev, b.fence, nullptr);
+        return true;
+    });
+}
+
+staging_ring::statistics staging_ring::stats() {
+    std::unique_lock lock(m_mutex);
+    statistics s{m_buffer != VK_NULL_HANDLE ? m_capacity : 0, 0, m_allocations, m_dedicated};
+    for(auto& b : m_blocks)
+        s.used += b.size;
+    return s;
+}
+
+void staging_ring::destroy() {
+    std::unique_lock lock(m_mutex);
+    if(!m_device)
+        return;
+    device& dev = *m_device;
+
+    for(auto& b : m_blocks) {
+        if(b.fence != VK_NULL_HANDLE)
+            dev.dispatch.DestroyFence(*dev, b.fence, nullptr);
+    }
+    m_blocks.clear();
+    m_head = 0;
+
+    for(auto& b : m_pendingDedicated) {
+        dev.dispatch.DestroyBuffer(*dev, b.buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, b.memory, nullptr);
+        if(b.fence != VK_NULL_HANDLE)
+            dev.dispatch.DestroyFence(*dev, b.fence, nullptr);
+    }
+    m_pendingDedicated.clear();
+
+    if(m_buffer != VK_NULL_HANDLE) {
+        dev.dispatch.DestroyBuffer(*dev, m_buffer, nullptr);
+        dev.dispatch.FreeMemory(*dev, m_memory, nullptr);
+        m_buffer = VK_NULL_HANDLE;
+        m_memory = VK_NULL_HANDLE;
+        m_data = nullptr;
+    }
+    m_device = nullptr;
+}
+
+}
@@ -0,0 +1,234 @@
+#include "texture_file.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vk_format_utils.h>
+#include <vulkan/vulkan.hpp>
+
+namespace CheekyLayer {
+
+namespace {
+    constexpr std::string_view dds_magic = "DDS ";
+    constexpr uint8_t ktx2_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+    constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    constexpr uint32_t DDPF_FOURCC = 0x4;
+    constexpr uint32_t DDPF_RGB = 0x40;
+    constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+    constexpr uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE3D = 4;
+
+    // callers check the size of the span, the files are little endian like everything the layer runs on
+    template<typename T>
+    T read(std::span<const uint8_t> data, size_t offset) {
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        return value;
+    }
+
+    constexpr uint32_t fourcc(const char (&s)[5]) {
+        return uint32_t(uint8_t(s[0])) | uint32_t(uint8_t(s[1])) << 8 | uint32_t(uint8_t(s[2])) << 16 | uint32_t(uint8_t(s[3])) << 24;
+    }
+
+    VkFormat dxgi_format(uint32_t dxgi) {
+        switch(dxgi) {
+            case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+            case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+            case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+            case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+            case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+            case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+            case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+            case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+            case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+            case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+            case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+            case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+            case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+            case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+            case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+            case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    VkFormat legacy_dds_format(uint32_t code) {
+        switch(code) {
+            case fourcc("DXT1"): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            case fourcc("DXT2"):
+            case fourcc("DXT3"): return VK_FORMAT_BC2_UNORM_BLOCK;
+            case fourcc("DXT4"):
+            case fourcc("DXT5"): return VK_FORMAT_BC3_UNORM_BLOCK;
+            case fourcc("ATI1"):
+            case fourcc("BC4U"): return VK_FORMAT_BC4_UNORM_BLOCK;
+            case fourcc("BC4S"): return VK_FORMAT_BC4_SNORM_BLOCK;
+            case fourcc("ATI2"):
+            case fourcc("BC5U"): return VK_FORMAT_BC5_UNORM_BLOCK;
+            case fourcc("BC5S"): return VK_FORMAT_BC5_SNORM_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    // legacy DDS files cannot tell sRGB from UNORM or BC1 with alpha from BC1 without, the data is the same anyway
+    VkFormat data_layout(VkFormat format) {
+        switch(format) {
+            case VK_FORMAT_R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_UNORM;
+            case VK_FORMAT_B8G8R8A8_SRGB: return VK_FORMAT_B8G8R8A8_UNORM;
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            case VK_FORMAT_BC2_SRGB_BLOCK: return VK_FORMAT_BC2_UNORM_BLOCK;
+            case VK_FORMAT_BC3_SRGB_BLOCK: return VK_FORMAT_BC3_UNORM_BLOCK;
+            case VK_FORMAT_BC7_SRGB_BLOCK: return VK_FORMAT_BC7_UNORM_BLOCK;
+            default: return format;
+        }
+    }
+}
+
+texture_file::texture_file(const std::filesystem::path& path) : m_path(path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        throw std::runtime_error("cannot open "+path.string()+": "+strerror(errno));
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("cannot read "+path.string());
+    }
+    m_size = st.st_size;
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        throw std::runtime_error("cannot map "+path.string()+": "+strerror(errno));
+    m_data = static_cast<const uint8_t*>(data);
+    // all of it is copied into the staging buffer right away
+    madvise(data, m_size, MADV_WILLNEED);
+
+    try {
+        if(m_size >= sizeof(ktx2_identifier) && std::memcmp(m_data, ktx2_identifier, sizeof(ktx2_identifier)) == 0)
+            parse_ktx2();
+        else if(m_size >= dds_magic.size() && std::memcmp(m_data, dds_magic.data(), dds_magic.size()) == 0)
+            parse_dds();
+        else
+            throw std::runtime_error(path.string()+" is neither a DDS nor a KTX2 file");
+    } catch(...) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+        throw;
+    }
+}
+
+texture_file::~texture_file() {
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+bool texture_file::is_texture_file(const std::filesystem::path& path) {
+    auto extension = path.extension();
+    return extension == ".dds" || extension == ".ktx2";
+}
+
+std::span<const uint8_t> texture_file::range(uint64_t offset, uint64_t size) const {
+    if(offset > m_size || size > m_size - offset)
+        throw std::runtime_error(m_path.string()+" is truncated");
+    return {m_data + offset, static_cast<size_t>(size)};
+}
+
+void texture_file::parse_dds() {
+    auto header = range(0, 128);
+    if(read<uint32_t>(header, 4) != 124)
+        throw std::runtime_error(m_path.string()+" has an invalid DDS header");
+
+    uint32_t flags = read<uint32_t>(header, 8);
+    m_extent = {read<uint32_t>(header, 16), read<uint32_t>(header, 12), 1};
+    uint32_t mipCount = (flags & DDSD_MIPMAPCOUNT) ? std::max(read<uint32_t>(header, 28), 1u) : 1;
+    uint32_t pixelFlags = read<uint32_t>(header, 80);
+    uint32_t code = read<uint32_t>(header, 84);
+    if(read<uint32_t>(header, 112) & DDSCAPS2_VOLUME)
+        throw std::runtime_error(m_path.string()+" is a volume texture");
+
+    size_t offset = header.size();
+    if((pixelFlags & DDPF_FOURCC) && code == fourcc("DX10")) {
+        auto dx10 = range(offset, 20);
+        m_format = dxgi_format(read<uint32_t>(dx10, 0));
+        if(read<uint32_t>(dx10, 4) == D3D10_RESOURCE_DIMENSION_TEXTURE3D)
+            throw std::runtime_error(m_path.string()+" is a volume texture");
+        offset += dx10.size();
+    } else if(pixelFlags & DDPF_FOURCC) {
+        m_format = legacy_dds_format(code);
+    } else if((pixelFlags & DDPF_RGB) && read<uint32_t>(header, 88) == 32) {
+        uint32_t red = read<uint32_t>(header, 92);
+        uint32_t blue = read<uint32_t>(header, 100);
+        if(red == 0x000000ff && blue == 0x00ff0000)
+            m_format = VK_FORMAT_R8G8B8A8_UNORM;
+        else if(red == 0x00ff0000 && blue == 0x000000ff)
+            m_format = VK_FORMAT_B8G8R8A8_UNORM;
+    }
+    if(m_format == VK_FORMAT_UNDEFINED)
+        throw std::runtime_error(m_path.string()+" uses an unsupported DDS pixel format");
+
+    // the mip levels of the first array layer come first
+    for(uint32_t i=0; i<mipCount && (m_extent.width >> i || m_extent.height >> i); i++) {
+        VkDeviceSize size = level_size(i);
+        m_levels.push_back(range(offset, size));
+        offset += size;
+    }
+}
+
+void texture_file::parse_ktx2() {
+    auto header = range(0, 80);
+    m_format = static_cast<VkFormat>(read<uint32_t>(header, 12));
+    m_extent = {read<uint32_t>(header, 20), std::max(read<uint32_t>(header, 24), 1u), 1};
+    uint32_t depth = read<uint32_t>(header, 28);
+    uint32_t levelCount = std::max(read<uint32_t>(header, 40), 1u);
+    uint32_t supercompression = read<uint32_t>(header, 44);
+
+    if(m_format == VK_FORMAT_UNDEFINED)
+        throw std::runtime_error(m_path.string()+" has no Vulkan format (Basis Universal is not supported)");
+    if(supercompression != 0)
+        throw std::runtime_error(m_path.string()+" uses supercompression scheme "+std::to_string(supercompression)+", which is not supported");
+    if(depth > 1)
+        throw std::runtime_error(m_path.string()+" is a volume texture");
+
+    auto index = range(header.size(), uint64_t(levelCount) * 24);
+    for(uint32_t i=0; i<levelCount; i++) {
+        uint64_t offset = read<uint64_t>(index, i*24 + 0);
+        uint64_t length = read<uint64_t>(index, i*24 + 8);
+        // the first layer and face come first within each level
+        VkDeviceSize size = level_size(i);
+        if(length < size)
+            throw std::runtime_error(m_path.string()+" has a mip level "+std::to_string(i)+" that is too small");
+        m_levels.push_back(range(offset, size));
+    }
+}
+
+VkExtent3D texture_file::extent(uint32_t level) const {
+    return {std::max(m_extent.width >> level, 1u), std::max(m_extent.height >> level, 1u), 1};
+}
+
+VkDeviceSize texture_file::level_size(uint32_t level) const {
+    VkExtent3D block = FormatTexelBlockExtent(m_format);
+    VkExtent3D e = extent(level);
+    VkDeviceSize blocksX = (e.width + block.width - 1) / block.width;
+    VkDeviceSize blocksY = (e.height + block.height - 1) / block.height;
+    return blocksX * blocksY * FormatElementSize(m_format);
+}
+
+void texture_file::validate(const VkImageCreateInfo& info) const {
+    if(data_layout(m_format) != data_layout(info.format))
+        throw std::runtime_error(fmt::format("{} has format {}, but the image has format {}", m_path.string(),
+            vk::to_string(vk::Format(m_format)), vk::to_string(vk::Format(info.format))));
+    if(m_extent.width != info.extent.width || m_extent.height != info.extent.height || info.extent.depth > 1)
+        throw std::runtime_error(fmt::format("{} is {}x{}, but the image is {}x{}x{}", m_path.string(),
+            m_extent.width, m_extent.height, info.extent.width, info.extent.height, info.extent.depth));
+    if(m_levels.empty())
+        throw std::runtime_error(m_path.string()+" contains no mip levels");
+}
+
+}
@@ -0,0 +1,475 @@
+#include "upload_batcher.hpp"
+
+#include "layer.hpp"
+#include "objects.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+namespace CheekyLayer {
+
+upload_batcher::~upload_batcher() {
+    shutdown();
+}
+
+void upload_batcher::configure(device* device, std::chrono::microseconds window) {
+    std::unique_lock lock(m_mutex);
+    m_device = device;
+    m_window = window;
+}
+
+void upload_batcher::submit(upload u) {
+    {
+        std::unique_lock lock(m_mutex);
+        if(!m_shutdown) {
+            if(!m_thread.joinable()) {
+                m_thread = std::jthread([this](std::stop_token stop){
+                    run(stop);
+                });
+            }
+            m_pending.push_back(std::move(u));
+            m_uploads++;
+            m_cv.notify_one();
+            return;
+        }
+    }
+    finish(u, false);
+}
+
+void upload_batcher::run(std::stop_token stop) {
+    using namespace std::chrono_literals;
+    std::unique_lock lock(m_mutex);
+    while(!stop.stop_requested()) {
+        if(m_pending.empty()) {
+            // poll the fences of submitted batches, but sleep for good when there are none
+            if(m_inFlightCount == 0)
+                m_cv.wait(lock, stop, [this]{return !m_pending.empty();});
+            else
+                m_cv.wait_for(lock, stop, 1ms, [this]{return !m_pending.empty();});
+        } else {
+            // give other uploads of the same burst the chance to end up in this batch
+            m_cv.wait_for(lock, stop, m_window, []{return false;});
+            std::vector<upload> uploads = std::move(m_pending);
+            m_pending.clear();
+
+            lock.unlock();
+            flush(std::move(uploads));
+            lock.lock();
+        }
+
+        lock.unlock();
+        retire(false);
+        lock.lock();
+    }
+}
+
+void upload_batcher::flush(std::vector<upload> uploads) {
+    device& dev = *m_device;
+
+    // a later upload overwrites the whole image, so only the last one per image is copied
+    std::unordered_map<VkImage, size_t> last;
+    for(size_t i=0; i<uploads.size(); i++)
+        last[uploads[i].image] = i;
+    std::vector<upload> batched;
+    for(size_t i=0; i<uploads.size(); i++) {
+        if(last[uploads[i].image] == i) {
+            batched.push_back(std::move(uploads[i]));
+        } else {
+            finish(uploads[i], false);
+            std::unique_lock lock(m_mutex);
+            m_superseded++;
+        }
+    }
+
+    // the images have to be handed over if the application uses them on a queue of another family
+    bool handover = dev.transferQueueFamily != dev.graphicsQueueFamily;
+
+    batch b;
+    if(dev.transferQueue == VK_NULL_HANDLE || dev.graphicsQueue == VK_NULL_HANDLE || !acquire(b, handover)) {
+        dev.logger->error("Cannot upload {} images, because there is no transfer queue or command buffer", batched.size());
+        for(auto& u : batched)
+            finish(u, false);
+        return;
+    }
+
+    record(b.commandBuffer, batched, handover);
+    if(handover)
+        record_acquire(b.acquireBuffer, batched);
+
+    if(!handover) {
+        if(VkResult result = submit(b); result != VK_SUCCESS) {
+            dev.logger->error("Failed to submit {} image uploads: {}", batched.size(), vk::to_string((vk::Result)result));
+            for(auto& u : batched)
+                finish(u, false);
+            m_free.push_back(std::move(b));
+            return;
+        }
+    }
+
+    {
+        std::unique_lock lock(m_mutex);
+        m_batches++;
+        m_maxBatch = std::max(m_maxBatch, batched.size());
+    }
+    b.uploads = std::move(batched);
+    std::unique_lock lock(m_submitMutex);
+    if(handover)
+        m_recorded.push_back(std::move(b));
+    else
+        m_inFlight.push_back(std::move(b));
+    update_counts();
+}
+
+VkResult upload_batcher::submit(batch& b) {
+    device& dev = *m_device;
+    std::scoped_lock l(transfer_lock);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &b.commandBuffer;
+    return dev.dispatch.QueueSubmit(dev.transferQueue, 1, &submitInfo, b.fence);
+}
+
+void upload_batcher::submitting(VkQueue queue, submit_extension& submit) {
+    if(m_handoverCount == 0 || queue != m_device->graphicsQueue)
+        return;
+
+    std::unique_lock lock(m_submitMutex);
+    acquire_finished(submit);
+    start(submit);
+    if(m_acquiring.empty() && m_starting.empty())
+        return;
+    update_counts();
+    submit.submitted.push_back([this](VkResult result, std::shared_ptr<submit_fence> fence){
+        submitted(result, std::move(fence));
+    });
+}
+
+void upload_batcher::acquire_finished(submit_extension& submit) {
+    device& dev = *m_device;
+
+    // Only copies that already finished are acquired, so the application's work does not wait for them.
+    // Their semaphore is signaled by then, but still orders the release before the acquire.
+    while(!m_copying.empty() && dev.dispatch.GetFenceStatus(*dev, m_copying.front().fence) == VK_SUCCESS) {
+        // the acquires are done once the application's submit is
+        if(!dev.fence_for(submit))
+            break;
+        batch& b = m_copying.front();
+        submit.waitSemaphores.push_back(b.semaphore);
+        submit.waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        submit.commandBuffers.push_back(b.acquireBuffer);
+        m_acquiring.push_back(std::move(b));
+        m_copying.pop_front();
+    }
+}
+
+void upload_batcher::start(submit_extension& submit) {
+    // the copies discard the old contents, so they have to wait for everything that might still use the images
+    for(auto& b : m_recorded) {
+        submit.signalSemaphores.push_back(b.graphicsSemaphore);
+        m_starting.push_back(std::move(b));
+    }
+    m_recorded.clear();
+}
+
+void upload_batcher::submitted(VkResult result, std::shared_ptr<submit_fence> fence) {
+    device& dev = *m_device;
+    std::unique_lock lock(m_submitMutex);
+
+    // nothing of a failed submit happened, so it is all tried again with the next one
+    if(result != VK_SUCCESS) {
+        dev.logger->warn("Cannot start {} and acquire {} upload batches, trying again with the next submit: {}",
+            m_starting.size(), m_acquiring.size(), vk::to_string((vk::Result)result));
+        m_copying.insert(m_copying.begin(), std::make_move_iterator(m_acquiring.begin()), std::make_move_iterator(m_acquiring.end()));
+        m_recorded.insert(m_recorded.begin(), std::make_move_iterator(m_starting.begin()), std::make_move_iterator(m_starting.end()));
+        m_acquiring.clear();
+        m_starting.clear();
+        update_counts();
+        return;
+    }
+
+    for(auto& b : m_acquiring) {
+        b.acquireFence = fence;
+        m_inFlight.push_back(std::move(b));
+    }
+    m_acquiring.clear();
+
+    bool failed = false;
+    {
+        std::scoped_lock l(transfer_lock);
+        for(auto& b : m_starting) {
+            VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &b.graphicsSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStage;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &b.commandBuffer;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &b.semaphore;
+            if(VkResult result = dev.dispatch.QueueSubmit(dev.transferQueue, 1, &submitInfo, b.fence); result != VK_SUCCESS) {
+                dev.logger->error("Failed to submit {} image uploads: {}", b.uploads.size(), vk::to_string((vk::Result)result));
+                b.failed = true;
+                failed = true;
+                m_inFlight.push_back(std::move(b));
+            } else {
+                m_copying.push_back(std::move(b));
+            }
+        }
+    }
+    m_starting.clear();
+    update_counts();
+
+    // nobody is going to wait for the semaphores of the failed batches, they are destroyed once they signaled
+    if(failed)
+        dev.dispatch.QueueWaitIdle(dev.graphicsQueue);
+}
+
+void upload_batcher::update_counts() {
+    m_handoverCount = m_recorded.size() + m_copying.size() + m_starting.size() + m_acquiring.size();
+    m_inFlightCount = m_handoverCount + m_inFlight.size();
+}
+
+void upload_batcher::record(VkCommandBuffer commandBuffer, const std::vector<upload>& uploads, bool handover) {
+    device& dev = *m_device;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    dev.dispatch.BeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // The old contents are discarded, so the transfer queue does not need to acquire the images.
+    std::vector<VkImageMemoryBarrier> barriers(uploads.size());
+    for(size_t i=0; i<uploads.size(); i++) {
+        VkImageMemoryBarrier& barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = uploads[i].image;
+        barrier.subresourceRange = uploads[i].range;
+    }
+    dev.dispatch.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+    for(auto& u : uploads) {
+        dev.dispatch.CmdCopyBufferToImage(commandBuffer, u.staging.buffer, u.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            u.copies.size(), u.copies.data());
+    }
+
+    // The image keeps the TRANSFER_DST_OPTIMAL layout. On the application's queue the writes are made
+    // available to everything that comes after the batch, otherwise the images are released to its family.
+    for(auto& barrier : barriers) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = handover ? 0 : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        if(handover) {
+            barrier.srcQueueFamilyIndex = dev.transferQueueFamily;
+            barrier.dstQueueFamilyIndex = dev.graphicsQueueFamily;
+        }
+    }
+    dev.dispatch.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        handover ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+    dev.dispatch.EndCommandBuffer(commandBuffer);
+}
+
+void upload_batcher::record_acquire(VkCommandBuffer commandBuffer, const std::vector<upload>& uploads) {
+    device& dev = *m_device;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    dev.dispatch.BeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // must match the release barriers of record()
+    std::vector<VkImageMemoryBarrier> barriers(uploads.size());
+    for(size_t i=0; i<uploads.size(); i++) {
+        VkImageMemoryBarrier& barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = dev.transferQueueFamily;
+        barrier.dstQueueFamilyIndex = dev.graphicsQueueFamily;
+        barrier.image = uploads[i].image;
+        barrier.subresourceRange = uploads[i].range;
+    }
+    dev.dispatch.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+    dev.dispatch.EndCommandBuffer(commandBuffer);
+}
+
+bool upload_batcher::acquire(batch& b, bool handover) {
+    device& dev = *m_device;
+
+    if(!m_free.empty()) {
+        b = std::move(m_free.back());
+        m_free.pop_back();
+        if(dev.dispatch.ResetCommandBuffer(b.commandBuffer, 0) != VK_SUCCESS)
+            return false;
+    } else {
+        VkCommandBufferAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = dev.transferPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        if(dev.dispatch.AllocateCommandBuffers(*dev, &allocateInfo, &b.commandBuffer) != VK_SUCCESS)
+            return false;
+        *reinterpret_cast<void**>(b.commandBuffer) = *reinterpret_cast<void**>(*dev);
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if(dev.dispatch.CreateFence(*dev, &fenceInfo, nullptr, &b.fence) != VK_SUCCESS) {
+            dev.dispatch.FreeCommandBuffers(*dev, dev.transferPool, 1, &b.commandBuffer);
+            return false;
+        }
+    }
+
+    if(!handover)
+        return true;
+
+    if(b.acquireBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = dev.graphicsPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        if(dev.dispatch.AllocateCommandBuffers(*dev, &allocateInfo, &b.acquireBuffer) != VK_SUCCESS) {
+            b.acquireBuffer = VK_NULL_HANDLE;
+            m_free.push_back(std::move(b));
+            return false;
+        }
+        *reinterpret_cast<void**>(b.acquireBuffer) = *reinterpret_cast<void**>(*dev);
+    } else if(dev.dispatch.ResetCommandBuffer(b.acquireBuffer, 0) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for(VkSemaphore* semaphore : {&b.semaphore, &b.graphicsSemaphore}) {
+        if(*semaphore == VK_NULL_HANDLE && dev.dispatch.CreateSemaphore(*dev, &semaphoreInfo, nullptr, semaphore) != VK_SUCCESS) {
+            *semaphore = VK_NULL_HANDLE;
+            m_free.push_back(std::move(b));
+            return false;
+        }
+    }
+    return true;
+}
+
+void upload_batcher::retire(bool wait) {
+    device& dev = *m_device;
+
+    // batches complete in submission order on the same queue
+    while(true) {
+        batch b;
+        {
+            std::unique_lock lock(m_submitMutex);
+            if(m_inFlight.empty())
+                break;
+            const batch& front = m_inFlight.front();
+            // handed over batches are done once the application's submit that acquired them is
+            VkFence fence = front.failed ? VK_NULL_HANDLE :
+                front.acquireBuffer == VK_NULL_HANDLE ? front.fence :
+                front.acquireFence ? front.acquireFence->handle : VK_NULL_HANDLE;
+            if(fence != VK_NULL_HANDLE) {
+                VkResult status = wait ?
+                    dev.dispatch.WaitForFences(*dev, 1, &fence, VK_TRUE, UINT64_MAX) :
+                    dev.dispatch.GetFenceStatus(*dev, fence);
+                if(status != VK_SUCCESS)
+                    break;
+            }
+            b = std::move(m_inFlight.front());
+            m_inFlight.pop_front();
+            update_counts();
+        }
+
+        for(auto& u : b.uploads)
+            finish(u, !b.failed);
+        b.uploads.clear();
+        b.acquireFence.reset();
+        dev.dispatch.ResetFences(*dev, 1, &b.fence);
+        if(b.failed) {
+            for(VkSemaphore* semaphore : {&b.semaphore, &b.graphicsSemaphore}) {
+                if(*semaphore != VK_NULL_HANDLE)
+                    dev.dispatch.DestroySemaphore(*dev, *semaphore, nullptr);
+                *semaphore = VK_NULL_HANDLE;
+            }
+            b.failed = false;
+        }
+
+        m_free.push_back(std::move(b));
+    }
+}
+
+void upload_batcher::finish(upload& u, bool success) {
+    m_device->staging.release(u.staging);
+    if(u.done)
+        u.done(success);
+}
+
+upload_batcher::statistics upload_batcher::stats() {
+    std::unique_lock lock(m_mutex);
+    return {m_uploads, m_batches, m_superseded, m_maxBatch, m_inFlightCount};
+}
+
+void upload_batcher::shutdown() {
+    std::vector<upload> pending;
+    {
+        std::unique_lock lock(m_mutex);
+        if(m_shutdown)
+            return;
+        m_shutdown = true;
+        pending = std::move(m_pending);
+        m_pending.clear();
+    }
+    if(m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+    if(!m_device)
+        return;
+
+    for(auto& u : pending)
+        finish(u, false);
+
+    // handed over batches the application did not submit for anymore are not acquired
+    device& dev = *m_device;
+    {
+        std::unique_lock lock(m_submitMutex);
+        for(auto& b : m_copying)
+            dev.dispatch.WaitForFences(*dev, 1, &b.fence, VK_TRUE, UINT64_MAX);
+        for(auto* queue : {&m_copying, &m_recorded}) {
+            for(auto& b : *queue) {
+                b.failed = true;
+                m_inFlight.push_back(std::move(b));
+            }
+            queue->clear();
+        }
+        update_counts();
+    }
+    retire(true);
+
+    for(auto& b : m_free) {
+        dev.dispatch.FreeCommandBuffers(*dev, dev.transferPool, 1, &b.commandBuffer);
+        dev.dispatch.DestroyFence(*dev, b.fence, nullptr);
+        if(b.acquireBuffer != VK_NULL_HANDLE)
+            dev.dispatch.FreeCommandBuffers(*dev, dev.graphicsPool, 1, &b.acquireBuffer);
+        for(VkSemaphore semaphore : {b.semaphore, b.graphicsSemaphore}) {
+            if(semaphore != VK_NULL_HANDLE)
+                dev.dispatch.DestroySemaphore(*dev, semaphore, nullptr);
+        }
+    }
+    m_free.clear();
+}
+
+}
@@ -0,0 +1,125 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
+namespace CheekyLayer {
+
+worker_pool::~worker_pool() {
+    shutdown();
+}
+
+void worker_pool::configure(size_t workers, size_t capacity) {
+    std::unique_lock lock(m_mutex);
+    if(!m_workers.empty())
+        return; // the workers are already running with the old configuration
+    m_workerCount = std::max<size_t>(workers, 1);
+    m_capacity = std::max<size_t>(capacity, 1);
+}
+
+void worker_pool::start() {
+    for(size_t i=0; i<m_workerCount; i++) {
+        m_workers.emplace_back([this](std::stop_token stop){
+            work(stop);
+        });
+    }
+}
+
+bool worker_pool::submit(lane l, task t) {
+    {
+        std::unique_lock lock(m_mutex);
+        if(m_shutdown)
+            return false;
+
+        auto& queue = m_lanes[static_cast<size_t>(l)];
+        if(l == lane::Background && queue.size() >= m_capacity) {
+            m_dropped++;
+            return false;
+        }
+        if(m_workers.empty())
+            start();
+
+        queue.push_back(std::move(t));
+        m_submitted++;
+
+        size_t depth = 0;
+        for(auto& q : m_lanes)
+            depth += q.size();
+        m_maxDepth = std::max(m_maxDepth, depth);
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+unsigned int worker_pool::threads_per_worker() {
+    std::unique_lock lock(m_mutex);
+    return std::max<unsigned int>(std::thread::hardware_concurrency() / m_workerCount, 1);
+}
+
+void worker_pool::work(std::stop_token stop) {
+    while(true) {
+        task t;
+        {
+            std::unique_lock lock(m_mutex);
+            auto next = [this]{
+                return std::ranges::find_if(m_lanes, [](auto& q){return !q.empty();});
+            };
+            if(!m_cv.wait(lock, stop, [&]{return next() != m_lanes.end();}))
+                return;
+
+            auto& queue = *next();
+            t = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        try {
+            t(stop);
+        } catch(const std::exception& ex) {
+            spdlog::error("Failed to execute worker task: {}", ex.what());
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_executed++;
+    }
+}
+
+worker_pool::statistics worker_pool::stats() {
+    std::unique_lock lock(m_mutex);
+    statistics s{{}, m_maxDepth, m_submitted, m_executed, m_dropped, m_cancelled};
+    for(size_t i=0; i<lane_count; i++)
+        s.depth[i] = m_lanes[i].size();
+    return s;
+}
+
+void worker_pool::shutdown() {
+    std::vector<std::jthread> workers;
+    std::vector<task> cancelled;
+    {
+        std::unique_lock lock(m_mutex);
+        m_shutdown = true;
+        for(auto& q : m_lanes) {
+            std::ranges::move(q, std::back_inserter(cancelled));
+            q.clear();
+        }
+        m_cancelled += cancelled.size();
+        workers = std::move(m_workers);
+    }
+    for(auto& w : workers) {
+        w.request_stop();
+        w.join();
+    }
+
+    // queued tasks still run once with a stopped token, so they can give back what they own
+    std::stop_source stopped;
+    stopped.request_stop();
+    for(auto& t : cancelled) {
+        try {
+            t(stopped.get_token());
+        } catch(const std::exception& ex) {
+            spdlog::error("Failed to cancel worker task: {}", ex.what());
+        }
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <cstdint>
+#include <stdexcept>
+#include <vulkan/vulkan_core.h>
+
+#include "reflection/reflectionparser.hpp"
+
+using namespace CheekyLayer::reflection;
+
+int main()
+{
+	VkGraphicsPipelineCreateInfo info;
+	VkPipelineDepthStencilStateCreateInfo depth;
+	VkPipelineViewportStateCreateInfo viewport;
+	VkPipelineRasterizationStateCreateInfo rasterization;
+	VkRect2D scissors[2] = {{.extent = {.width = 1024}}, {.extent = {.width = 1023}}};
+
+	depth.depthTestEnable = VK_TRUE;
+	depth.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+	viewport.scissorCount = 2;
+	viewport.pScissors = scissors;
+	rasterization.lineWidth = 1.0f;
+	info.pDepthStencilState = &depth;
+	info.pViewportState = &viewport;
+	info.pRasterizationState = &rasterization;
+
+	compiled_path depthTest = compile_path("pDepthStencilState->depthTestEnable", "VkGraphicsPipelineCreateInfo");
+	assert(depthTest.kind == primitive_kind::Bool32);
+	assert(depthTest.get_raw(&info) == VK_TRUE);
+	assert(depthTest.get_string(&info) == "VK_TRUE");
+
+	compiled_path compareOp = compile_path("pDepthStencilState->depthCompareOp", "VkGraphicsPipelineCreateInfo");
+	assert(compareOp.kind == primitive_kind::Enum);
+	assert(compareOp.get_string(&info) == "VK_COMPARE_OP_ALWAYS");
+
+	// "pScissors[1].extent.width" must fold into a single indexed step
+	compiled_path width = compile_path("pViewportState->pScissors[1].extent.width", "VkGraphicsPipelineCreateInfo");
+	assert(width.steps.size() == 3);
+	assert(width.get_number(&info) == 1023);
+	width.set_raw(&info, 511);
+	assert(scissors[1].extent.width == 511);
+	assert(scissors[0].extent.width == 1024);
+
+	compiled_assignment disable = compile_assign("pDepthStencilState->depthTestEnable = VK_FALSE", "VkGraphicsPipelineCreateInfo");
+	disable.apply(&info);
+	assert(depth.depthTestEnable == VK_FALSE);
+
+	compiled_assignment lineWidth = compile_assign("pRasterizationState->lineWidth = 2.5", "VkGraphicsPipelineCreateInfo");
+	lineWidth.apply(&info);
+	assert(rasterization.lineWidth == 2.5f);
+
+	try // test null pointer check
+	{
+		info.pDepthStencilState = nullptr;
+		depthTest.get_raw(&info);
+		assert(false);
+	}
+	catch(const std::runtime_error& e)
+	{
+		assert(std::string(e.what()) == "member \"pDepthStencilState\" of path \"pDepthStencilState->depthTestEnable\" is a null pointer");
+	}
+
+	try // test range check
+	{
+		viewport.scissorCount = 1;
+		width.get_raw(&info);
+		assert(false);
+	}
+	catch(const std::runtime_error& e)
+	{
+		assert(std::string(e.what()) == "array index 1 for member \"pScissors\" exceeds its length of 1 which can be found in member \"scissorCount\"");
+	}
+
+	try // test unknown element size
+	{
+		compile_path("ppEnabledLayerNames[0]", "VkInstanceCreateInfo");
+		assert(false);
+	}
+	catch(const std::runtime_error& e)
+	{
+		assert(std::string(e.what()) == "cannot index member \"ppEnabledLayerNames\" of type \"VkInstanceCreateInfo\", because the size of its element type \"char\" is unknown");
+	}
+
+	return 0;
+}